@@ -14,8 +14,16 @@ BaseNode::BaseNode(const QMapLibre::Settings &settings, const QSize &size, qreal
     m_map.reset(
         new QMapLibre::Map(nullptr, settings, size.expandedTo(MIN_TEXTURE_SIZE), pixelRatio));
 
-    QObject::connect(m_map.data(), &QMapLibre::Map::needsRendering, item, &QQuickItem::update);
-    QObject::connect(m_map.data(), &QMapLibre::Map::copyrightsChanged, item, &QQuickItem::update);
+    QObject::connect(m_map.data(), &QMapLibre::Map::needsRendering, this,
+                     [this]() { setDirty(true); });
+
+    // item is not given for rendering without Qt Quick
+    if (item) {
+        QObject::connect(m_map.data(), &QMapLibre::Map::needsRendering, item,
+                         &QQuickItem::update);
+        QObject::connect(m_map.data(), &QMapLibre::Map::copyrightsChanged, item,
+                         &QQuickItem::update);
+    }
 }
 
 void BaseNode::resize(const QSize &size, qreal pixelRatio) {
@@ -23,6 +31,13 @@ void BaseNode::resize(const QSize &size, qreal pixelRatio) {
     m_pixel_ratio = pixelRatio;
 }
 
+void BaseNode::setRenderScale(qreal scale) {
+    if (m_render_scale == scale)
+        return;
+    m_render_scale = scale;
+    resize(m_item_size, m_pixel_ratio); // framebuffer is kept as the size is the same
+}
+
 float BaseNode::mapToQtPixelRatio() const {
     return 0.5 * (width() / m_item_size.width() + height() / m_item_size.height());
 }
@@ -39,13 +54,45 @@ void BaseNode::queryLayerExists(const QString &sourceID) {
 }
 
 void BaseNode::queryCoordinateForPixel(QPointF p, const QVariant &tag) {
+    QGeoCoordinate coor;
+    qreal degLatPerPixel, degLonPerPixel;
+    p = coordinateForPixel(p, coor, degLatPerPixel, degLonPerPixel);
+    emit replyCoordinateForPixel(p, coor, degLatPerPixel, degLonPerPixel, tag);
+}
+
+void BaseNode::queryCoordinatesForPixels(const QVector<QPointF> &points,
+                                         const QVariant &requestId) {
+    // result is packed as latitude, longitude, degLatPerPixel, degLonPerPixel for each pixel
+    QByteArray result(points.size() * 4 * sizeof(double), Qt::Uninitialized);
+    double *r = reinterpret_cast<double *>(result.data());
+    for (const QPointF &p : points) {
+        QGeoCoordinate coor;
+        qreal degLatPerPixel, degLonPerPixel;
+        coordinateForPixel(p, coor, degLatPerPixel, degLonPerPixel);
+        r[0] = coor.latitude();
+        r[1] = coor.longitude();
+        r[2] = degLatPerPixel;
+        r[3] = degLonPerPixel;
+        r += 4;
+    }
+
+    emit replyCoordinatesForPixels(result, requestId);
+}
+
+void BaseNode::queryFeaturesAt(const QRectF &area, const QVector<FeatureQuery::Layer> &layers,
+                               const QVariant &requestId) {
+    const FeatureQuery query(area, m_map.data(), mapToQtPixelRatio());
+    emit replyFeaturesAt(query.find(layers, m_map->zoom()), requestId, QString());
+}
+
+QPointF BaseNode::coordinateForPixel(const QPointF &pixel, QGeoCoordinate &coordinate,
+                                     qreal &degLatPerPixel, qreal &degLonPerPixel) const {
     float rx = ((float)m_map_size.width()) / ((float)m_item_size.width());
     float ry = ((float)m_map_size.height()) / ((float)m_item_size.height());
 
-    p.setX(p.x() * rx);
-    p.setY(p.y() * ry);
+    QPointF p(pixel.x() * rx, pixel.y() * ry);
     QMapLibre::Coordinate mbc = m_map->coordinateForPixel(p);
-    QGeoCoordinate coor(mbc.first, mbc.second);
+    coordinate = QGeoCoordinate(mbc.first, mbc.second);
 
     // get sensitivity of coordinates to the changes in pixel coordinates
     double bearing = m_map->bearing() / 180. * M_PI;
@@ -54,8 +101,7 @@ void BaseNode::queryCoordinateForPixel(QPointF p, const QVariant &tag) {
     p += QPointF(cosB + sinB, -sinB + cosB);
     QMapLibre::Coordinate mbc_shift = m_map->coordinateForPixel(p);
 
-    qreal degLatPerPixel = fabs(mbc_shift.first - mbc.first) * rx;
-    qreal degLonPerPixel = fabs(mbc_shift.second - mbc.second) * ry;
-
-    emit replyCoordinateForPixel(p, coor, degLatPerPixel, degLonPerPixel, tag);
-}
\ No newline at end of file
+    degLatPerPixel = fabs(mbc_shift.first - mbc.first) * rx;
+    degLonPerPixel = fabs(mbc_shift.second - mbc.second) * ry;
+    return p;
+}
@@ -1,8 +1,13 @@
 #ifndef BASENODE_H
 #define BASENODE_H
 
+#include "featurequery.h"
+#include "mapimagereader.h"
+
+#include <QAtomicInt>
 #include <QGeoCoordinate>
 #include <QQuickItem>
+#include <QVector>
 
 #include <QMapLibre/Map>
 #include <QMapLibre/Settings>
@@ -22,16 +27,59 @@ class BaseNode : public QObject {
     virtual void resize(const QSize &size, qreal pixelRatio);
     virtual void render(QQuickWindow *) {}
 
+    /// Scale of the rendered map relative to the full resolution. Map is
+    /// rendered into a part of the framebuffer and upscaled when shown
+    qreal renderScale() const { return m_render_scale; }
+    void setRenderScale(qreal scale);
+
+    /// Map has requested rendering since the flag was cleared. The flag is
+    /// set also from the render thread
+    bool dirty() const { return m_dirty.loadAcquire() != 0; }
+    void setDirty(bool dirty) { m_dirty.storeRelease(dirty ? 1 : 0); }
+
+    /// Rendering in a separate thread. While the frame is rendered, the
+    /// map cannot be changed
+    virtual bool busy() const { return false; }
+    /// Show the last frame finished by the separate thread. Returns true if shown frame changed
+    virtual bool present(QQuickWindow *) { return false; }
+    /// Frames finished by the separate thread and replaced before they were shown
+    virtual qint64 droppedFrames() const { return 0; }
+    /// Number of framebuffers allocated for rendering
+    virtual qint64 fboAllocations() const { return 0; }
+    /// Time used by the separate thread to render the last frame, in
+    /// nanoseconds. Negative if the map is rendered by render()
+    virtual qint64 frameTime() const { return -1; }
+
+    /// Start reading the shown map into an image. Images are read over the
+    /// next frames and collected by takeImages. Returns false if reading is
+    /// not supported by the node
+    virtual bool readImage(const MapImageReader::Request &) { return false; }
+    virtual QList<MapImageReader::Image> takeImages() { return {}; }
+    virtual bool imagesPending() const { return false; }
+
   public slots:
     void querySourceExists(const QString &id);
     void queryLayerExists(const QString &id);
     void queryCoordinateForPixel(QPointF p, const QVariant &tag);
+    void queryCoordinatesForPixels(const QVector<QPointF> &pixels, const QVariant &requestId);
+    /// Features drawn by the layers within the area given in Qt pixels of the item
+    void queryFeaturesAt(const QRectF &area, const QVector<FeatureQuery::Layer> &layers,
+                         const QVariant &requestId);
 
   signals:
     void replySourceExists(const QString id, bool exists);
     void replyLayerExists(const QString id, bool exists);
     void replyCoordinateForPixel(const QPointF p, QGeoCoordinate geo, qreal degLatPerPixel,
                                  qreal degLonPerPixel, const QVariant &tag);
+    void replyCoordinatesForPixels(const QByteArray &coordinates, const QVariant &requestId);
+    void replyFeaturesAt(const QVariantList &features, const QVariant &requestId,
+                         const QString &error);
+
+  protected:
+    /// Coordinate for a pixel in Qt item together with its sensitivity to the pixel changes.
+    /// Returns the map pixel used for the sensitivity, as reported by replyCoordinateForPixel
+    QPointF coordinateForPixel(const QPointF &p, QGeoCoordinate &coordinate,
+                               qreal &degLatPerPixel, qreal &degLonPerPixel) const;
 
   protected:
     QScopedPointer<QMapLibre::Map> m_map;
@@ -39,6 +87,8 @@ class BaseNode : public QObject {
     QSize m_item_size; ///<- size of Qt item in Qt logical pixels units
     qreal m_pixel_ratio;
     qreal m_device_pixel_ratio{1};
+    QAtomicInt m_dirty{1};
+    qreal m_render_scale{1};
 };
 
 #endif // BASENODE_H
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include "basetexturenode.h"
 
+#include "macros.h"
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+#include <QOpenGLContext>
+#endif
+
 BaseTextureNode::BaseTextureNode(const QMapLibre::Settings &settings, const QSize &size,
                                  qreal devicePixelRatio, qreal pixelRatio, QQuickItem *item)
     : BaseNode(settings, size, devicePixelRatio, pixelRatio, item), QSGSimpleTextureNode() {
@@ -7,4 +13,59 @@ BaseTextureNode::BaseTextureNode(const QMapLibre::Settings &settings, const QSiz
     setFiltering(QSGTexture::Linear);
 }
 
-BaseTextureNode::~BaseTextureNode() {}
+BaseTextureNode::~BaseTextureNode() {
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+    // node is destroyed by the scene graph with its context current
+    m_image_reader.release();
+#endif
+}
+
+namespace {
+const int FboStep = 128; ///< Step of framebuffer sizes, in physical pixels
+
+int fboDimension(int size) { return ((size + FboStep - 1) / FboStep) * FboStep; }
+} // namespace
+
+QSize BaseTextureNode::fboSize(const QSize &size) {
+    return QSize(fboDimension(size.width()), fboDimension(size.height()));
+}
+
+bool BaseTextureNode::fboFits(const QSize &fbo, const QSize &size) {
+    const QSize bucket = fboSize(size);
+    return fbo.width() >= size.width() && fbo.height() >= size.height() &&
+           fbo.width() <= bucket.width() + FboStep && fbo.height() <= bucket.height() + FboStep;
+}
+
+QSize BaseTextureNode::renderSize(const QSize &fbSize) const {
+    if (m_render_scale >= 1)
+        return fbSize;
+    return (fbSize * m_render_scale).expandedTo(MIN_TEXTURE_SIZE);
+}
+
+/// Map is rendered starting from the first row of the texture. With the
+/// texture mirrored vertically, it is shown from the top of the source rect
+void BaseTextureNode::setMapTextureRect(const QSize &size) {
+    // geometry is updated by the node only if the source rect changes
+    const QSize textureSize = texture() ? texture()->textureSize() : QSize();
+    if (textureSize != m_source_texture_size) {
+        setSourceRect(QRectF());
+        m_source_texture_size = textureSize;
+    }
+    setSourceRect(QRectF(QPointF(), size));
+}
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+/// Image size is given relative to the full resolution of the map, also
+/// when the map is shown with a reduced render scale
+bool BaseTextureNode::readImage(const MapImageReader::Request &request) {
+    GLuint texture = 0;
+    QSize size;
+    if (!QOpenGLContext::currentContext() || !shownTexture(texture, size) || !texture)
+        return false;
+
+    const qreal scale = qBound(qreal(0.01), request.scale, qreal(1));
+    const QSize imageSize = (m_item_size * m_device_pixel_ratio * scale).expandedTo(QSize(1, 1));
+    m_image_reader.read(texture, size, imageSize, request);
+    return true;
+}
+#endif
@@ -2,6 +2,7 @@
 #define BASETEXTURENODE_H
 
 #include "basenode.h"
+#include "macros.h"
 
 #include <QtQuick/QSGSimpleTextureNode>
 
@@ -12,6 +13,43 @@ class BaseTextureNode : public BaseNode, public QSGSimpleTextureNode {
     BaseTextureNode(const QMapLibre::Settings &, const QSize &, qreal devicePixelRatio,
                     qreal pixelRatio, QQuickItem *item);
     ~BaseTextureNode();
+
+    qint64 fboAllocations() const override { return m_fbo_allocations; }
+
+    /// Size of framebuffer allocated for the map of the given size in
+    /// physical pixels. Framebuffers are allocated in steps, leaving
+    /// headroom for growth of the map
+    static QSize fboSize(const QSize &size);
+
+    /// Framebuffer can be used for the map of the given size: it is large
+    /// enough and not larger than the next allocation step
+    static bool fboFits(const QSize &fbo, const QSize &size);
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+    bool readImage(const MapImageReader::Request &request) override;
+    QList<MapImageReader::Image> takeImages() override { return m_image_reader.take(); }
+    bool imagesPending() const override { return m_image_reader.pending(); }
+#endif
+
+  protected:
+    /// Size of the rendered map for the framebuffer size, taking into account render scale
+    QSize renderSize(const QSize &fbSize) const;
+
+    /// Show the map of the given size rendered into the bottom left corner
+    /// of the framebuffer texture
+    void setMapTextureRect(const QSize &size);
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+    /// Texture shown by the node and the size of its part used by the map
+    virtual bool shownTexture(GLuint &texture, QSize &size) const = 0;
+#endif
+
+  protected:
+    qint64 m_fbo_allocations{0};
+    QSize m_source_texture_size; ///< Texture size used with the current source rect
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+    MapImageReader m_image_reader;
+#endif
 };
 
 #endif // TEXTURENODE_H
\ No newline at end of file
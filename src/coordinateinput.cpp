@@ -0,0 +1,189 @@
+#include "coordinateinput.h"
+
+#include <QByteArray>
+#include <QGeoCoordinate>
+#include <QJSValue>
+#include <QPointF>
+#include <QVariantMap>
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+/// Data is given as binary buffer, either as ArrayBuffer or typed array
+bool isBinary(const QVariant &data) {
+    if (data.userType() == QMetaType::QByteArray)
+        return true;
+    return data.userType() == qMetaTypeId<QJSValue>() &&
+           !data.value<QJSValue>().property("buffer").isUndefined();
+}
+
+/// Bytes of the binary data. For typed arrays, only the part of the buffer
+/// covered by the array is used. Fails if the data is not given as doubles
+bool doubleBytes(const QVariant &data, QByteArray &bytes) {
+    if (data.userType() == QMetaType::QByteArray)
+        bytes = data.toByteArray();
+    else {
+        const QJSValue array = data.value<QJSValue>();
+        if (array.property("BYTES_PER_ELEMENT").toInt() != int(sizeof(double)))
+            return false;
+        const QByteArray buffer = array.property("buffer").toVariant().toByteArray();
+        const int offset = array.property("byteOffset").toInt();
+        const int length = array.property("byteLength").toInt();
+        if (offset < 0 || length < 0 || offset + length > buffer.size())
+            return false;
+        bytes = (offset == 0 && length == buffer.size()) ? buffer : buffer.mid(offset, length);
+    }
+    return bytes.size() % sizeof(double) == 0;
+}
+
+/// Values given as a list. Typed arrays are given by Qt 5 as a map with
+/// indices as keys
+bool valueList(const QVariant &data, QVariantList &list) {
+    if (data.userType() == qMetaTypeId<QJSValue>())
+        return valueList(data.value<QJSValue>().toVariant(), list);
+
+    if (data.userType() == QMetaType::QVariantMap) {
+        const QVariantMap map = data.toMap();
+        list.clear();
+        list.reserve(map.size());
+        for (int i = 0; i < map.size(); ++i)
+            list.append(QVariant());
+        for (QVariantMap::const_iterator i = map.constBegin(); i != map.constEnd(); ++i) {
+            bool ok;
+            const int index = i.key().toInt(&ok);
+            if (!ok || index < 0 || index >= list.size())
+                return false;
+            list[index] = i.value();
+        }
+        return true;
+    }
+
+    if (data.canConvert<QVariantList>()) {
+        list = data.toList();
+        return true;
+    }
+
+    return false;
+}
+} // namespace
+
+bool CoordinateInput::valid(double latitude, double longitude) {
+    return isfinite(latitude) && isfinite(longitude) && latitude >= -90 && latitude <= 90 &&
+           longitude >= -180 && longitude <= 180;
+}
+
+bool CoordinateInput::doubles(const QVariant &data, QVector<double> &values) {
+    values.clear();
+    if (isBinary(data)) {
+        QByteArray bytes;
+        if (!doubleBytes(data, bytes))
+            return false;
+        values.resize(bytes.size() / sizeof(double));
+        memcpy(values.data(), bytes.constData(), bytes.size());
+        return true;
+    }
+
+    QVariantList list;
+    if (!valueList(data, list))
+        return false;
+    values.resize(list.size());
+    for (int i = 0; i < list.size(); ++i) {
+        bool ok;
+        values[i] = list[i].toDouble(&ok);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+bool CoordinateInput::points(const QVariant &data, QVector<QPointF> &points) {
+    points.clear();
+    if (!isBinary(data)) {
+        const QVariantList list = data.toList();
+        if (!list.isEmpty() && list.first().userType() != QMetaType::Double &&
+            list.first().canConvert<QPointF>()) {
+            points.reserve(list.size());
+            for (const QVariant &v : list) {
+                if (!v.canConvert<QPointF>())
+                    return false;
+                points.append(v.toPointF());
+            }
+            return true;
+        }
+    }
+
+    QVector<double> values;
+    if (!doubles(data, values) || values.size() % 2 != 0)
+        return false;
+    points.resize(values.size() / 2);
+    for (int i = 0; i < points.size(); ++i)
+        points[i] = QPointF(values[2 * i], values[2 * i + 1]);
+    return true;
+}
+
+bool CoordinateInput::lonLat(const QVariant &data, QMapLibre::Coordinates &coordinates) {
+    coordinates.clear();
+    if (isBinary(data)) {
+        QByteArray bytes;
+        const int pair = 2 * sizeof(double);
+        if (!doubleBytes(data, bytes) || bytes.size() % pair != 0)
+            return false;
+        const int n = bytes.size() / pair;
+        const char *raw = bytes.constData();
+        coordinates.resize(n);
+        for (int i = 0; i < n; ++i) {
+            double lonlat[2];
+            memcpy(lonlat, raw + i * pair, pair);
+            coordinates[i] = QMapLibre::Coordinate(lonlat[1], lonlat[0]);
+        }
+        return true;
+    }
+
+    if (data.userType() == qMetaTypeId<QVector<QPointF>>()) {
+        const QVector<QPointF> points = data.value<QVector<QPointF>>();
+        coordinates.resize(points.size());
+        for (int i = 0; i < points.size(); ++i)
+            coordinates[i] = QMapLibre::Coordinate(points[i].y(), points[i].x());
+        return true;
+    }
+
+    QVariantList list;
+    if (!valueList(data, list) || list.size() % 2 != 0)
+        return false;
+    coordinates.resize(list.size() / 2);
+    for (int i = 0; i < coordinates.size(); ++i) {
+        bool oklon, oklat;
+        double lon = list[2 * i].toDouble(&oklon);
+        double lat = list[2 * i + 1].toDouble(&oklat);
+        if (!oklon || !oklat)
+            return false;
+        coordinates[i] = QMapLibre::Coordinate(lat, lon);
+    }
+    return true;
+}
+
+bool CoordinateInput::geo(const QVariantList &data, QMapLibre::Coordinates &coordinates,
+                          int &invalid) {
+    coordinates.resize(data.size());
+    for (int i = 0; i < data.size(); ++i) {
+        QGeoCoordinate c = data[i].value<QGeoCoordinate>();
+        if (!c.isValid()) {
+            invalid = i;
+            return false;
+        }
+        coordinates[i] = QMapLibre::Coordinate(c.latitude(), c.longitude());
+    }
+    return true;
+}
+
+bool CoordinateInput::any(const QVariant &data, QMapLibre::Coordinates &coordinates) {
+    if (!isBinary(data)) {
+        const QVariantList list = data.toList();
+        if (!list.isEmpty() && list.first().canConvert<QGeoCoordinate>()) {
+            int invalid = -1;
+            return geo(list, coordinates, invalid);
+        }
+    }
+    return lonLat(data, coordinates);
+}
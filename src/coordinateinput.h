@@ -0,0 +1,44 @@
+#ifndef COORDINATEINPUT_H
+#define COORDINATEINPUT_H
+
+#include <QMapLibre/Types>
+
+#include <QPointF>
+#include <QVariant>
+#include <QVariantList>
+#include <QVector>
+
+//////////////////////////////////////////////////////////////////////////
+/// CoordinateInput reads coordinates and numbers given through the API.
+///
+/// Numbers can be given as JS Float64Array, ArrayBuffer with doubles, or
+/// list of numbers. Typed arrays are passed by QML either as QJSValue,
+/// in which case the offset and length of the array view in its buffer
+/// are taken into account, or, with Qt 5, as a map with indices as keys.
+/// ArrayBuffer is passed as QByteArray and is used in full.
+
+class CoordinateInput {
+  public:
+    static bool valid(double latitude, double longitude);
+
+    /// Numbers given as Float64Array, ArrayBuffer with doubles, or list of numbers
+    static bool doubles(const QVariant &data, QVector<double> &values);
+
+    /// Coordinates given as interleaved longitude and latitude pairs. In
+    /// addition to the forms accepted by doubles, QVector<QPointF> with x as
+    /// longitude and y as latitude is accepted
+    static bool lonLat(const QVariant &data, QMapLibre::Coordinates &coordinates);
+
+    /// Points given as a list of points or as interleaved x and y in any of
+    /// the forms accepted by doubles. Fails on odd number of values
+    static bool points(const QVariant &data, QVector<QPointF> &points);
+
+    /// Coordinates given as list of QGeoCoordinate. On failure, index of
+    /// the invalid coordinate is given by invalid
+    static bool geo(const QVariantList &data, QMapLibre::Coordinates &coordinates, int &invalid);
+
+    /// Coordinates given either as a list of QGeoCoordinate or as longitude and latitude pairs
+    static bool any(const QVariant &data, QMapLibre::Coordinates &coordinates);
+};
+
+#endif // COORDINATEINPUT_H
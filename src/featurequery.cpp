@@ -0,0 +1,811 @@
+#include "featurequery.h"
+
+#include <QGeoCoordinate>
+#include <QJsonDocument>
+#include <QLineF>
+
+#include <math.h>
+
+namespace {
+/// Point is within the rectangle or on its border. Unlike QRectF::contains,
+/// this holds also for the rectangle of zero size given for a point
+bool inside(const QRectF &r, const QPointF &p) {
+    return p.x() >= r.left() && p.x() <= r.right() && p.y() >= r.top() && p.y() <= r.bottom();
+}
+
+/// Distance from the point to the rectangle, zero if the point is inside
+qreal pointDistance(const QRectF &r, const QPointF &p) {
+    const qreal dx = qMax(qMax(r.left() - p.x(), p.x() - r.right()), qreal(0));
+    const qreal dy = qMax(qMax(r.top() - p.y(), p.y() - r.bottom()), qreal(0));
+    return sqrt(dx * dx + dy * dy);
+}
+
+/// Distance from the point p to segment ab
+qreal segmentPointDistance(const QPointF &p, const QPointF &a, const QPointF &b) {
+    const QPointF d = b - a;
+    const qreal l2 = QPointF::dotProduct(d, d);
+    const qreal t = l2 > 0 ? qBound(qreal(0), QPointF::dotProduct(p - a, d) / l2, qreal(1)) : 0;
+    const QPointF v = a + t * d - p;
+    return sqrt(QPointF::dotProduct(v, v));
+}
+
+/// Distance from segment ab to the rectangle, zero if they intersect. Without
+/// intersection, the distance is reached at an end of the segment or at a
+/// corner of the rectangle
+qreal segmentDistance(const QRectF &r, const QPointF &a, const QPointF &b) {
+    if (inside(r, a) || inside(r, b))
+        return 0;
+
+    const QLineF segment(a, b);
+    const QPointF corners[] = {r.topLeft(), r.topRight(), r.bottomRight(), r.bottomLeft()};
+    qreal d = qMin(pointDistance(r, a), pointDistance(r, b));
+    for (int i = 0; i < 4; ++i) {
+        const QLineF edge(corners[i], corners[(i + 1) % 4]);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        if (segment.intersects(edge, nullptr) == QLineF::BoundedIntersection)
+#else
+        if (segment.intersect(edge, nullptr) == QLineF::BoundedIntersection)
+#endif
+            return 0;
+        d = qMin(d, segmentPointDistance(corners[i], a, b));
+    }
+    return d;
+}
+
+/// Point is inside the ring, using even-odd rule
+bool ringContains(const QVector<QPointF> &ring, const QPointF &p) {
+    bool inside = false;
+    for (int i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+        const QPointF &a = ring[i];
+        const QPointF &b = ring[j];
+        if ((a.y() > p.y()) != (b.y() > p.y()) &&
+            p.x() < (b.x() - a.x()) * (p.y() - a.y()) / (b.y() - a.y()) + a.x())
+            inside = !inside;
+    }
+    return inside;
+}
+
+/// GeoJSON parsing
+
+QMapLibre::Coordinate position(const QVariant &p) {
+    const QVariantList c = p.toList();
+    return QMapLibre::Coordinate(c.value(1).toDouble(), c.value(0).toDouble());
+}
+
+QMapLibre::Coordinates positions(const QVariant &p) {
+    const QVariantList list = p.toList();
+    QMapLibre::Coordinates result;
+    result.reserve(list.size());
+    for (const QVariant &c : list)
+        result.append(position(c));
+    return result;
+}
+
+QMapLibre::CoordinatesCollection lines(const QVariant &p) {
+    QMapLibre::CoordinatesCollection result;
+    for (const QVariant &line : p.toList())
+        result.append(positions(line));
+    return result;
+}
+
+void appendGeometry(const QVariantMap &geometry, const QVariantMap &properties,
+                    const QVariant &id, QVector<QMapLibre::Feature> &features) {
+    const QString type = geometry.value("type").toString();
+    const QVariant c = geometry.value("coordinates");
+    QMapLibre::Feature::Type t;
+    QMapLibre::CoordinatesCollections g;
+    if (type == "Point") {
+        t = QMapLibre::Feature::PointType;
+        g.append(QMapLibre::CoordinatesCollection(1, QMapLibre::Coordinates(1, position(c))));
+    } else if (type == "MultiPoint") {
+        t = QMapLibre::Feature::PointType;
+        g.append(QMapLibre::CoordinatesCollection(1, positions(c)));
+    } else if (type == "LineString") {
+        t = QMapLibre::Feature::LineStringType;
+        g.append(QMapLibre::CoordinatesCollection(1, positions(c)));
+    } else if (type == "MultiLineString") {
+        t = QMapLibre::Feature::LineStringType;
+        g.append(lines(c));
+    } else if (type == "Polygon") {
+        t = QMapLibre::Feature::PolygonType;
+        g.append(lines(c));
+    } else if (type == "MultiPolygon") {
+        t = QMapLibre::Feature::PolygonType;
+        for (const QVariant &polygon : c.toList())
+            g.append(lines(polygon));
+    } else {
+        if (type == "GeometryCollection")
+            for (const QVariant &part : geometry.value("geometries").toList())
+                appendGeometry(part.toMap(), properties, id, features);
+        return;
+    }
+    features.append(QMapLibre::Feature(t, g, properties, id));
+}
+
+void appendGeoJson(const QVariantMap &object, QVector<QMapLibre::Feature> &features) {
+    const QString type = object.value("type").toString();
+    if (type == "FeatureCollection") {
+        for (const QVariant &feature : object.value("features").toList())
+            appendGeoJson(feature.toMap(), features);
+    } else if (type == "Feature")
+        appendGeometry(object.value("geometry").toMap(), object.value("properties").toMap(),
+                       object.value("id"), features);
+    else
+        appendGeometry(object, QVariantMap(), QVariant(), features);
+}
+
+/// Filters
+
+QString geometryType(const QMapLibre::Feature &feature) {
+    switch (feature.type) {
+    case QMapLibre::Feature::LineStringType:
+        return "LineString";
+    case QMapLibre::Feature::PolygonType:
+        return "Polygon";
+    default:
+        return "Point";
+    }
+}
+
+bool isNumber(const QVariant &v) {
+    switch (v.userType()) {
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Float:
+    case QMetaType::Double:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool isBool(const QVariant &v) { return v.userType() == QMetaType::Bool; }
+bool isString(const QVariant &v) { return v.userType() == QMetaType::QString; }
+bool isList(const QVariant &v) { return v.userType() == QMetaType::QVariantList; }
+bool isNull(const QVariant &v) { return !v.isValid() || v.isNull(); }
+
+bool isComparison(const QString &op) {
+    return op == "==" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=";
+}
+
+/// Numbers or strings are ordered, returns false for other values
+bool compare(const QVariant &a, const QVariant &b, int &result) {
+    if (isNumber(a) && isNumber(b)) {
+        const double x = a.toDouble(), y = b.toDouble();
+        result = x < y ? -1 : (x > y ? 1 : 0);
+        return true;
+    }
+    if (isString(a) && isString(b)) {
+        result = QString::compare(a.toString(), b.toString());
+        return true;
+    }
+    return false;
+}
+
+/// Values of different types are not equal
+bool equal(const QVariant &a, const QVariant &b) {
+    int result;
+    if (compare(a, b, result))
+        return result == 0;
+    if (isBool(a) && isBool(b))
+        return a.toBool() == b.toBool();
+    return isNull(a) && isNull(b);
+}
+
+bool ordered(const QString &op, int r) {
+    return op == "<" ? r < 0 : op == "<=" ? r <= 0 : op == ">" ? r > 0 : r >= 0;
+}
+
+/// Value converted by to-boolean
+bool truthy(const QVariant &v) {
+    if (isBool(v))
+        return v.toBool();
+    if (isNumber(v))
+        return v.toDouble() != 0 && !qIsNaN(v.toDouble());
+    if (isString(v))
+        return !v.toString().isEmpty();
+    return !isNull(v);
+}
+
+/// Legacy filter syntax checked as by MapLibre on its conversion
+bool validLegacy(const QVariant &filter, QString &error) {
+    if (isBool(filter))
+        return true;
+    const QVariantList l = filter.toList();
+    if (!isList(filter) || l.isEmpty() || !isString(l[0])) {
+        error = "Legacy filter has to be an array starting with the operator";
+        return false;
+    }
+
+    const QString op = l[0].toString();
+    const int n = l.size();
+    if (op == "all" || op == "any" || op == "none") {
+        for (int i = 1; i < n; ++i)
+            if (!validLegacy(l[i], error))
+                return false;
+        return true;
+    }
+
+    bool arity;
+    if (op == "has" || op == "!has")
+        arity = (n == 2);
+    else if (isComparison(op))
+        arity = (n == 3);
+    else if (op == "in" || op == "!in")
+        arity = (n >= 2);
+    else {
+        error = QString("Unsupported legacy filter %1").arg(op);
+        return false;
+    }
+
+    if (!arity || !isString(l[1])) {
+        error = QString("Legacy filter %1 has to be given with a key and values").arg(op);
+        return false;
+    }
+    for (int i = 2; i < n; ++i)
+        if (isList(l[i]) || l[i].userType() == QMetaType::QVariantMap) {
+            error = QString("Legacy filter %1 has to be given with a key and values").arg(op);
+            return false;
+        }
+    return true;
+}
+
+/// Value of the key in the legacy filter syntax
+QVariant legacyValue(const QMapLibre::Feature &feature, const QString &key) {
+    if (key == "$type")
+        return geometryType(feature);
+    if (key == "$id")
+        return feature.id;
+    return feature.properties.value(key);
+}
+
+/// Filter is expected to be valid
+bool legacyMatches(const QVariant &filter, const QMapLibre::Feature &feature) {
+    if (isBool(filter))
+        return filter.toBool();
+
+    const QVariantList l = filter.toList();
+    const QString op = l[0].toString();
+    const int n = l.size();
+    if (op == "all" || op == "any" || op == "none") {
+        for (int i = 1; i < n; ++i) {
+            const bool value = legacyMatches(l[i], feature);
+            if (op == "all" && !value)
+                return false;
+            if (op != "all" && value)
+                return op == "any";
+        }
+        return op != "any";
+    }
+
+    const QString key = l[1].toString();
+    if (op == "has" || op == "!has") {
+        const bool has = key == "$type" || (key == "$id" ? feature.id.isValid()
+                                                          : feature.properties.contains(key));
+        return op == "has" ? has : !has;
+    }
+
+    const QVariant value = legacyValue(feature, key);
+    if (op == "in" || op == "!in") {
+        bool found = false;
+        for (int i = 2; i < n && !found; ++i)
+            found = equal(value, l[i]);
+        return op == "in" ? found : !found;
+    }
+
+    if (op == "==")
+        return equal(value, l[2]);
+    if (op == "!=")
+        return !equal(value, l[2]);
+    int r;
+    return compare(value, l[2], r) && ordered(op, r);
+}
+
+/// Expressions are checked for the supported operators and their number
+/// of arguments. Types of the values are checked on evaluation
+bool validExpression(const QVariant &expression, QString &error) {
+    if (!isList(expression))
+        return true;
+    const QVariantList l = expression.toList();
+    if (l.isEmpty() || !isString(l[0])) {
+        error = "Expression has to start with the operator, use literal for arrays";
+        return false;
+    }
+
+    const QString op = l[0].toString();
+    const int n = l.size();
+    bool arity;
+    if (op == "literal")
+        return n == 2;
+    else if (op == "id" || op == "geometry-type" || op == "zoom")
+        arity = (n == 1);
+    else if (op == "get" || op == "has" || op == "!" || op == "to-string" ||
+             op == "to-number" || op == "to-boolean")
+        arity = (n == 2);
+    else if (isComparison(op) || op == "in")
+        arity = (n == 3);
+    else if (op == "all" || op == "any")
+        arity = true;
+    else if (op == "coalesce" || op == "string" || op == "number" || op == "boolean")
+        arity = (n >= 2);
+    else if (op == "case")
+        arity = (n >= 4 && n % 2 == 0);
+    else if (op == "match")
+        arity = (n >= 5 && n % 2 == 1);
+    else {
+        error = QString("Unsupported filter expression %1").arg(op);
+        return false;
+    }
+
+    if (!arity) {
+        error = QString("Unsupported number of arguments of filter expression %1").arg(op);
+        return false;
+    }
+
+    for (int i = 1; i < n; ++i) {
+        // labels of match are values
+        if (op == "match" && i >= 2 && i < n - 1 && i % 2 == 0)
+            continue;
+        if (!validExpression(l[i], error))
+            return false;
+    }
+    return true;
+}
+
+/// Evaluation of a valid filter expression for a feature. Values of wrong
+/// type fail the evaluation as in MapLibre
+class ExpressionEvaluator {
+  public:
+    ExpressionEvaluator(const QMapLibre::Feature &feature, double zoom)
+        : m_feature(feature), m_zoom(zoom) {}
+
+    QVariant evaluate(const QVariant &expression);
+    bool failed() const { return m_failed; }
+
+  private:
+    QVariant fail() {
+        m_failed = true;
+        return QVariant();
+    }
+
+  private:
+    const QMapLibre::Feature &m_feature;
+    double m_zoom;
+    bool m_failed{false};
+};
+
+QVariant ExpressionEvaluator::evaluate(const QVariant &expression) {
+    if (m_failed || !isList(expression))
+        return expression;
+    const QVariantList l = expression.toList();
+    const QString op = l[0].toString();
+    const int n = l.size();
+
+    if (op == "literal")
+        return l[1];
+    if (op == "get" || op == "has") {
+        const QVariant key = evaluate(l[1]);
+        if (!isString(key))
+            return fail();
+        if (op == "has")
+            return m_feature.properties.contains(key.toString());
+        return m_feature.properties.value(key.toString());
+    }
+    if (op == "id")
+        return m_feature.id;
+    if (op == "geometry-type")
+        return geometryType(m_feature);
+    if (op == "zoom")
+        return m_zoom;
+
+    if (op == "!") {
+        const QVariant value = evaluate(l[1]);
+        return isBool(value) ? QVariant(!value.toBool()) : fail();
+    }
+
+    if (op == "all" || op == "any") {
+        const bool all = (op == "all");
+        for (int i = 1; i < n; ++i) {
+            const QVariant value = evaluate(l[i]);
+            if (!isBool(value))
+                return fail();
+            if (value.toBool() != all)
+                return !all;
+        }
+        return all;
+    }
+
+    if (op == "==" || op == "!=") {
+        const bool eq = equal(evaluate(l[1]), evaluate(l[2]));
+        return op == "==" ? eq : !eq;
+    }
+
+    if (isComparison(op)) {
+        int r;
+        if (!compare(evaluate(l[1]), evaluate(l[2]), r))
+            return fail();
+        return ordered(op, r);
+    }
+
+    if (op == "in") {
+        // as in MapLibre, string haystack is searched for the needle as a substring
+        const QVariant needle = evaluate(l[1]);
+        const QVariant haystack = evaluate(l[2]);
+        if (isList(needle) || needle.userType() == QMetaType::QVariantMap)
+            return fail();
+        if (isList(haystack)) {
+            for (const QVariant &v : haystack.toList())
+                if (equal(needle, v))
+                    return true;
+            return false;
+        }
+        if (isString(haystack))
+            return !isNull(needle) && haystack.toString().contains(needle.toString());
+        return isNull(haystack) ? QVariant(false) : fail();
+    }
+
+    if (op == "match") {
+        // input, pairs of labels and outputs, fallback
+        const QVariant input = evaluate(l[1]);
+        for (int i = 2; i + 1 < n - 1; i += 2) {
+            bool found = false;
+            if (isList(l[i])) {
+                for (const QVariant &label : l[i].toList())
+                    found = found || equal(input, label);
+            } else
+                found = equal(input, l[i]);
+            if (found)
+                return evaluate(l[i + 1]);
+        }
+        return evaluate(l[n - 1]);
+    }
+
+    if (op == "case") {
+        // pairs of conditions and outputs, fallback
+        for (int i = 1; i + 1 < n - 1; i += 2) {
+            const QVariant condition = evaluate(l[i]);
+            if (!isBool(condition))
+                return fail();
+            if (condition.toBool())
+                return evaluate(l[i + 1]);
+        }
+        return evaluate(l[n - 1]);
+    }
+
+    if (op == "coalesce") {
+        for (int i = 1; i < n; ++i) {
+            const QVariant value = evaluate(l[i]);
+            if (!isNull(value))
+                return value;
+        }
+        return QVariant();
+    }
+
+    if (op == "string" || op == "number" || op == "boolean") {
+        // type assertions return the first argument of the type
+        for (int i = 1; i < n; ++i) {
+            const QVariant value = evaluate(l[i]);
+            if ((op == "string" && isString(value)) || (op == "number" && isNumber(value)) ||
+                (op == "boolean" && isBool(value)))
+                return value;
+        }
+        return fail();
+    }
+
+    if (op == "to-string") {
+        const QVariant value = evaluate(l[1]);
+        if (isNull(value))
+            return QString();
+        if (isBool(value))
+            return value.toBool() ? QString("true") : QString("false");
+        return value.toString();
+    }
+
+    if (op == "to-number") {
+        const QVariant value = evaluate(l[1]);
+        if (isNull(value))
+            return 0.0;
+        if (isBool(value))
+            return value.toBool() ? 1.0 : 0.0;
+        bool ok = false;
+        const double number = value.toDouble(&ok);
+        return ok ? QVariant(number) : fail();
+    }
+
+    if (op == "to-boolean")
+        return truthy(evaluate(l[1]));
+
+    return fail();
+}
+
+/// Hit test
+
+/// Constant number given for the property or its default value
+bool constant(const QVariantMap &properties, const QString &name, qreal defaultValue,
+              qreal &value, QString &error) {
+    const QVariant v = properties.value(name);
+    if (isNull(v)) {
+        value = defaultValue;
+        return true;
+    }
+    if (!isNumber(v)) {
+        error = QString("Feature query supports only constant %1").arg(name);
+        return false;
+    }
+    value = v.toDouble();
+    return true;
+}
+} // namespace
+
+/// Filter
+
+FeatureFilter::FeatureFilter(const QVariant &filter) : m_filter(filter) {
+    if (isNull(filter))
+        return;
+    m_legacy = !isExpression(filter);
+    if (m_legacy)
+        validLegacy(filter, m_error);
+    else
+        validExpression(filter, m_error);
+}
+
+bool FeatureFilter::matches(const QMapLibre::Feature &feature, double zoom) const {
+    if (!isValid())
+        return false;
+    if (isNull(m_filter))
+        return true;
+    if (m_legacy)
+        return legacyMatches(m_filter, feature);
+
+    ExpressionEvaluator evaluator(feature, zoom);
+    const QVariant result = evaluator.evaluate(m_filter);
+    return !evaluator.failed() && isBool(result) && result.toBool();
+}
+
+/// Filter syntax is decided as in MapLibre
+bool FeatureFilter::isExpression(const QVariant &filter) {
+    const QVariantList l = filter.toList();
+    if (!isList(filter) || l.isEmpty() || !isString(l[0]))
+        return false;
+
+    const QString op = l[0].toString();
+    if (op == "has")
+        return l.size() >= 2 && isString(l[1]) && l[1].toString() != "$id" &&
+               l[1].toString() != "$type";
+    if (op == "in" || op == "!in" || op == "!has" || op == "none")
+        return false;
+    if (isComparison(op))
+        return l.size() != 3 || isList(l[1]) || isList(l[2]);
+    if (op == "any" || op == "all") {
+        for (int i = 1; i < l.size(); ++i)
+            if (!isExpression(l[i]) && !isBool(l[i]))
+                return false;
+        return true;
+    }
+    return true;
+}
+
+/// Query
+
+FeatureQuery::FeatureQuery(const QRectF &area, QMapLibre::Map *map, qreal mapToQtPixelRatio)
+    : m_area(area), m_projection(Projection::fromMap(map, mapToQtPixelRatio)), m_map(map),
+      m_ratio(mapToQtPixelRatio) {}
+
+void FeatureQuery::project(const QMapLibre::Coordinates &coordinates,
+                           QVector<QPointF> &pixels) const {
+    pixels.resize(coordinates.size());
+    if (m_projection.isValid())
+        m_projection.project(coordinates.constData(), pixels.data(), coordinates.size());
+    else
+        for (int i = 0; i < coordinates.size(); ++i)
+            pixels[i] = m_map->pixelForCoordinate(coordinates[i]) / m_ratio;
+}
+
+bool FeatureQuery::nearLine(const QVector<QPointF> &line, qreal tolerance) const {
+    if (line.size() == 1)
+        return pointDistance(m_area, line.first()) <= tolerance;
+    for (int i = 1; i < line.size(); ++i)
+        if (segmentDistance(m_area, line[i - 1], line[i]) <= tolerance)
+            return true;
+    return false;
+}
+
+bool FeatureQuery::nearPolygon(const QMapLibre::CoordinatesCollection &polygon,
+                               qreal tolerance) const {
+    QVector<QPointF> ring;
+    bool inside = false;
+    for (int i = 0; i < polygon.size(); ++i) {
+        project(polygon[i], ring);
+        if (ring.isEmpty())
+            continue;
+
+        // boundary is close to the area
+        ring.append(ring.first());
+        if (nearLine(ring, tolerance))
+            return true;
+
+        // area within the outer ring and not within the holes
+        if (ringContains(ring, m_area.center()))
+            inside = (i == 0);
+        else if (i == 0)
+            return false;
+    }
+    return inside;
+}
+
+/// Geometries are drawn as in MapLibre: fill layers draw polygons, line
+/// layers lines and outlines of polygons, and circle layers all vertices.
+/// Symbol layers are considered only for points, with the icon centered
+/// on the point
+bool FeatureQuery::intersects(const QMapLibre::Feature &feature, const QString &layerType,
+                              qreal tolerance) const {
+    const bool circle = (layerType == "circle");
+    QVector<QPointF> pixels;
+    for (const QMapLibre::CoordinatesCollection &collection : feature.geometry) {
+        if (circle || (feature.type == QMapLibre::Feature::PointType && layerType == "symbol")) {
+            for (const QMapLibre::Coordinates &coordinates : collection) {
+                project(coordinates, pixels);
+                for (const QPointF &p : pixels)
+                    if (pointDistance(m_area, p) <= tolerance)
+                        return true;
+            }
+        } else if (feature.type == QMapLibre::Feature::PolygonType && layerType == "fill") {
+            if (nearPolygon(collection, tolerance))
+                return true;
+        } else if (feature.type != QMapLibre::Feature::PointType && layerType == "line") {
+            for (const QMapLibre::Coordinates &coordinates : collection) {
+                project(coordinates, pixels);
+                if (feature.type == QMapLibre::Feature::PolygonType && !pixels.isEmpty())
+                    pixels.append(pixels.first());
+                if (nearLine(pixels, tolerance))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+QVariantList FeatureQuery::find(const QVector<Layer> &layers, double zoom) const {
+    QVariantList result;
+    for (const Layer &layer : layers) {
+        const qreal tolerance = layer.tolerance / m_ratio;
+        for (const QMapLibre::Feature &feature : layer.features) {
+            if (!intersects(feature, layer.type, tolerance) || !layer.filter.matches(feature, zoom))
+                continue;
+            QVariantMap f = toVariant(feature);
+            f.insert("layer", layer.id);
+            f.insert("source", layer.source);
+            result.append(f);
+        }
+    }
+    return result;
+}
+
+bool FeatureQuery::tolerance(const QString &type, const QVariantMap &paint,
+                             const QVariantMap &layout, const QHash<QString, QSize> &icons,
+                             qreal &tolerance, QString &error) {
+    if (type == "fill") {
+        tolerance = 0;
+        return true;
+    }
+
+    if (type == "circle") {
+        qreal radius, stroke;
+        if (!constant(paint, "circle-radius", 5, radius, error) ||
+            !constant(paint, "circle-stroke-width", 0, stroke, error))
+            return false;
+        tolerance = radius + stroke;
+        return true;
+    }
+
+    if (type == "line") {
+        qreal width, gap, offset;
+        if (!constant(paint, "line-width", 1, width, error) ||
+            !constant(paint, "line-gap-width", 0, gap, error) ||
+            !constant(paint, "line-offset", 0, offset, error))
+            return false;
+        // line with a gap is drawn on both sides of the gap
+        tolerance = (gap > 0 ? gap / 2 + width : width / 2) + qAbs(offset);
+        return true;
+    }
+
+    if (type == "symbol") {
+        const QVariant image = layout.value("icon-image");
+        if (!isString(image)) {
+            error = "Feature query supports only symbols with constant icon-image";
+            return false;
+        }
+        const auto icon = icons.constFind(image.toString());
+        if (icon == icons.constEnd()) {
+            error = QString("Feature query supports only icons added as images, %1 is not")
+                        .arg(image.toString());
+            return false;
+        }
+        qreal size;
+        if (!constant(layout, "icon-size", 1, size, error))
+            return false;
+        tolerance = 0.5 * qMax(icon->width(), icon->height()) * size;
+        return true;
+    }
+
+    error = QString("Feature query does not support %1 layers").arg(type);
+    return false;
+}
+
+QVector<QMapLibre::Feature> FeatureQuery::features(const QVariant &data) {
+    if (data.userType() == qMetaTypeId<QMapLibre::Feature>())
+        return QVector<QMapLibre::Feature>(1, data.value<QMapLibre::Feature>());
+    if (data.userType() == qMetaTypeId<QVector<QMapLibre::Feature>>())
+        return data.value<QVector<QMapLibre::Feature>>();
+
+    // GeoJSON is given as JSON text after conversion for the map. Text
+    // that is not JSON is taken as URL
+    QVariantMap geojson;
+    if (data.userType() == QMetaType::QVariantMap)
+        geojson = data.toMap();
+    else if (data.userType() == QMetaType::QByteArray || data.userType() == QMetaType::QString) {
+        const QByteArray json =
+            data.userType() == QMetaType::QString ? data.toString().toUtf8() : data.toByteArray();
+        QJsonParseError error;
+        const QJsonDocument doc = QJsonDocument::fromJson(json, &error);
+        if (error.error != QJsonParseError::NoError || !doc.isObject())
+            return QVector<QMapLibre::Feature>();
+        geojson = doc.toVariant().toMap();
+    }
+
+    QVector<QMapLibre::Feature> result;
+    appendGeoJson(geojson, result);
+    return result;
+}
+
+QVariantMap FeatureQuery::toVariant(const QMapLibre::Feature &feature) {
+    QVariantMap f;
+    switch (feature.type) {
+    case QMapLibre::Feature::PointType:
+        f.insert("type", "Point");
+        break;
+    case QMapLibre::Feature::LineStringType:
+        f.insert("type", "LineString");
+        break;
+    case QMapLibre::Feature::PolygonType:
+        f.insert("type", "Polygon");
+        break;
+    }
+
+    if (feature.id.isValid())
+        f.insert("id", feature.id);
+    f.insert("properties", feature.properties);
+
+    if (feature.type == QMapLibre::Feature::PointType && !feature.geometry.isEmpty() &&
+        !feature.geometry.first().isEmpty() && !feature.geometry.first().first().isEmpty()) {
+        const QMapLibre::Coordinate &c = feature.geometry.first().first().first();
+        f.insert("coordinate", QVariant::fromValue(QGeoCoordinate(c.first, c.second)));
+    }
+    return f;
+}
+
+/// Cache
+
+const QVector<QMapLibre::Feature> &FeatureCache::features(const QString &sourceID,
+                                                          const QVariant &data) {
+    // features given directly are not parsed and are always taken as given
+    Entry &entry = m_entries[sourceID];
+    const bool parsed = data.userType() == QMetaType::QByteArray ||
+                        data.userType() == QMetaType::QString ||
+                        data.userType() == QMetaType::QVariantMap;
+    if (!parsed || entry.data.userType() != data.userType() || entry.data != data) {
+        entry.data = data;
+        entry.features = FeatureQuery::features(data);
+    }
+    return entry.features;
+}
+
+void FeatureCache::retain(const QSet<QString> &sourceIDs) {
+    for (auto i = m_entries.begin(); i != m_entries.end();)
+        if (sourceIDs.contains(i.key()))
+            ++i;
+        else
+            i = m_entries.erase(i);
+}
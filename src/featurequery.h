@@ -0,0 +1,127 @@
+#ifndef FEATUREQUERY_H
+#define FEATUREQUERY_H
+
+#include "projection.h"
+
+#include <QMapLibre/Map>
+#include <QMapLibre/Types>
+
+#include <QHash>
+#include <QRectF>
+#include <QSet>
+#include <QSize>
+#include <QVariantMap>
+#include <QVector>
+
+//////////////////////////////////////////////////////////////////////////
+/// FeatureFilter evaluates layer filters for features found by
+/// FeatureQuery. As in MapLibre, the filter is either an expression or
+/// given in the legacy filter syntax. The syntax is decided for the whole
+/// filter by the same rules as used by MapLibre.
+///
+/// Only the expressions commonly used in filters are supported. Filter
+/// using any other expression is invalid and its error describes the
+/// unsupported part. Evaluation errors, such as comparison of a number
+/// with a string, filter the feature out as in MapLibre.
+
+class FeatureFilter {
+  public:
+    FeatureFilter(const QVariant &filter = QVariant()); ///< Missing filter passes all features
+
+    bool isValid() const { return m_error.isEmpty(); }
+    const QString &error() const { return m_error; } ///< Reason why the filter is invalid
+    bool isLegacy() const { return m_legacy; }
+
+    /// Feature passes the filter. Invalid filter passes no features
+    bool matches(const QMapLibre::Feature &feature, double zoom) const;
+
+    /// Filter is given as an expression rather than in the legacy syntax
+    static bool isExpression(const QVariant &filter);
+
+  private:
+    QVariant m_filter;
+    bool m_legacy{false};
+    QString m_error;
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// FeatureQuery finds features that are drawn within an area of the
+/// widget. As the map does not expose its rendered features, features are
+/// taken from the source data given to the map, either as QMapLibre
+/// features or as GeoJSON, and tested against the area using their
+/// geometry expanded by the size of their rendering. The size is taken
+/// from the paint and layout properties of the layer. Only constant sizes
+/// are supported.
+///
+/// Area and pixels are given in Qt pixels of the widget.
+
+class FeatureQuery {
+  public:
+    /// \brief Layer prepared for the query with the features of its source
+    struct Layer {
+        QString id;
+        QString source;
+        QString type;    ///< circle, line, fill, or symbol
+        qreal tolerance{0}; ///< Distance from the geometry covered by rendering, in map pixels
+        FeatureFilter filter;
+        QVector<QMapLibre::Feature> features;
+    };
+
+  public:
+    FeatureQuery(const QRectF &area, QMapLibre::Map *map, qreal mapToQtPixelRatio);
+
+    /// Feature, as drawn by the layer, is within the area. Tolerance is given in Qt pixels
+    bool intersects(const QMapLibre::Feature &feature, const QString &layerType,
+                    qreal tolerance) const;
+
+    /// Features drawn by the layers within the area, listed in the order of the layers
+    QVariantList find(const QVector<Layer> &layers, double zoom) const;
+
+    /// Distance from the geometry of the features covered by their rendering by the layer
+    /// of the given type, in map pixels. Paint and layout properties of the layer are given
+    /// as maps, icons as their sizes by image id. Returns false and sets error if the layer
+    /// type is not supported or the size is not constant
+    static bool tolerance(const QString &type, const QVariantMap &paint,
+                          const QVariantMap &layout, const QHash<QString, QSize> &icons,
+                          qreal &tolerance, QString &error);
+
+    /// Features in the source data given as QMapLibre features or as GeoJSON,
+    /// either parsed into a map or as JSON text. Data given by URL has no features
+    static QVector<QMapLibre::Feature> features(const QVariant &data);
+
+    /// Feature as a map with its id, type, properties, and, for points, coordinate
+    static QVariantMap toVariant(const QMapLibre::Feature &feature);
+
+  private:
+    void project(const QMapLibre::Coordinates &coordinates, QVector<QPointF> &pixels) const;
+    bool nearLine(const QVector<QPointF> &line, qreal tolerance) const;
+    bool nearPolygon(const QMapLibre::CoordinatesCollection &polygon, qreal tolerance) const;
+
+  private:
+    QRectF m_area;
+    Projection m_projection;
+    QMapLibre::Map *m_map;
+    qreal m_ratio;
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// FeatureCache keeps features of the source data, so that GeoJSON is
+/// parsed only once for each version of the data.
+
+class FeatureCache {
+  public:
+    /// Features of the source. Data is parsed again only if it has changed
+    const QVector<QMapLibre::Feature> &features(const QString &sourceID, const QVariant &data);
+
+    void retain(const QSet<QString> &sourceIDs); ///< Drop sources that are not listed
+
+  private:
+    struct Entry {
+        QVariant data;
+        QVector<QMapLibre::Feature> features;
+    };
+
+    QHash<QString, Entry> m_entries;
+};
+
+#endif // FEATUREQUERY_H
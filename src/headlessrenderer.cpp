@@ -0,0 +1,125 @@
+#include "headlessrenderer.h"
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QOpenGLFunctions>
+#include <QTimer>
+
+#include <QDebug>
+
+HeadlessRenderer::HeadlessRenderer(const QMapLibre::Settings &settings, const QSize &size,
+                                   qreal pixelRatio)
+    : BaseNode(settings, size, pixelRatio, pixelRatio, nullptr) {
+    m_surface.reset(new QOffscreenSurface);
+    m_surface->setFormat(QSurfaceFormat::defaultFormat());
+    m_surface->create();
+
+    m_context.reset(new QOpenGLContext);
+    m_context->setFormat(m_surface->format());
+    if (!m_context->create()) {
+        qWarning() << "HeadlessRenderer: failed to create GL context";
+        m_context.reset();
+    }
+
+    resize(size, pixelRatio);
+}
+
+HeadlessRenderer::~HeadlessRenderer() {
+    // GL resources are released with the context current
+    if (m_context && m_context->makeCurrent(m_surface.get())) {
+        if (m_renderer_created)
+            m_map->destroyRenderer();
+        m_fbo.reset();
+        m_context->doneCurrent();
+    }
+}
+
+void HeadlessRenderer::resize(const QSize &size, qreal pixelRatio) {
+    const QSize minSize = size.expandedTo(MIN_TEXTURE_SIZE);
+    BaseNode::resize(minSize, pixelRatio);
+
+    m_fb_size = minSize * m_device_pixel_ratio;                  // physical pixels
+    m_map_size = minSize * m_device_pixel_ratio / m_pixel_ratio; // ensure zoom
+    m_map->resize(m_map_size);
+}
+
+void HeadlessRenderer::setCamera(const QGeoCoordinate &center, qreal zoom, qreal bearing,
+                                 qreal pitch) {
+    m_map->setCoordinateZoom({center.latitude(), center.longitude()}, zoom);
+    m_map->setBearing(bearing);
+    m_map->setPitch(pitch);
+}
+
+/// Called with the context current
+bool HeadlessRenderer::renderFrame() {
+    if (!m_fbo || m_fbo->size() != m_fb_size) {
+        QOpenGLFramebufferObjectFormat fmt;
+        fmt.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+        fmt.setTextureTarget(GL_TEXTURE_2D);
+        fmt.setInternalTextureFormat(GL_RGBA);
+        m_fbo.reset(new QOpenGLFramebufferObject(m_fb_size, fmt));
+        if (!m_fbo->isValid()) {
+            qWarning() << "HeadlessRenderer: failed to create FBO";
+            m_fbo.reset();
+            return false;
+        }
+    }
+
+    if (!m_renderer_created) {
+        m_map->createRenderer();
+        m_renderer_created = true;
+    }
+
+    setDirty(false);
+    m_context->functions()->glViewport(0, 0, m_fb_size.width(), m_fb_size.height());
+    m_fbo->bind();
+    m_map->setOpenGLFramebufferObject(static_cast<quint32>(m_fbo->handle()), m_fb_size);
+    m_map->render();
+    m_fbo->release();
+    return true;
+}
+
+/// Map loads resources asynchronously and requests rendering as they
+/// arrive. Events are processed between the frames until the map is
+/// fully loaded and has nothing more to render.
+QImage HeadlessRenderer::grab(int timeout) {
+    if (!isValid() || !m_context->makeCurrent(m_surface.get())) {
+        qWarning() << "HeadlessRenderer: GL context is not available";
+        return QImage();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QImage image;
+    forever {
+        if (!renderFrame())
+            break;
+
+        if (m_map->isFullyLoaded() && !dirty()) {
+            image = m_fbo->toImage();
+            break;
+        }
+
+        const qint64 remaining = timeout - timer.elapsed();
+        if (remaining <= 0) {
+            qWarning() << "HeadlessRenderer: map was not loaded within" << timeout << "ms";
+            break;
+        }
+
+        // wait for the map to request rendering, checking the state periodically
+        if (!dirty()) {
+            QEventLoop loop;
+            QObject::connect(m_map.data(), &QMapLibre::Map::needsRendering, &loop,
+                             &QEventLoop::quit);
+            QTimer::singleShot(int(qMin<qint64>(remaining, 100)), &loop, &QEventLoop::quit);
+            loop.exec();
+        }
+    }
+
+    m_context->doneCurrent();
+    return image;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef HEADLESSRENDERER_H
+#define HEADLESSRENDERER_H
+
+#include "macros.h"
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+
+#include "basenode.h"
+
+#include <QImage>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+
+#include <memory>
+
+//////////////////////////////////////////////////////////////////////////
+/// HeadlessRenderer renders the map into an image without Qt Quick scene
+/// graph or a window, for example, in tests and batch jobs. It uses its own
+/// offscreen surface and GL context, and works with software OpenGL
+/// implementations such as Mesa llvmpipe.
+///
+/// Renderer has to be created and used in the GUI thread with a running
+/// QGuiApplication. Set the style and camera through map() or setCamera
+/// and call grab to get the image once the map is fully loaded. The map
+/// is kept between the grabs.
+
+class HeadlessRenderer : public BaseNode {
+    Q_OBJECT
+
+  public:
+    HeadlessRenderer(const QMapLibre::Settings &settings, const QSize &size, qreal pixelRatio = 1);
+    ~HeadlessRenderer();
+
+    bool isValid() const { return m_context && m_context->isValid(); }
+
+    void resize(const QSize &size, qreal pixelRatio) override;
+
+    void setCamera(const QGeoCoordinate &center, qreal zoom, qreal bearing = 0, qreal pitch = 0);
+
+    /// Render the map until it is fully loaded and return its image in
+    /// physical pixels. Null image is returned on failure or if the map
+    /// is not loaded within timeout, given in milliseconds
+    QImage grab(int timeout = 30000);
+
+  private:
+    bool renderFrame();
+
+  private:
+    std::unique_ptr<QOffscreenSurface> m_surface;
+    std::unique_ptr<QOpenGLContext> m_context;
+    std::unique_ptr<QOpenGLFramebufferObject> m_fbo;
+    QSize m_fb_size;
+    bool m_renderer_created{false};
+};
+
+#endif
+
+#endif // HEADLESSRENDERER_H
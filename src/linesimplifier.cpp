@@ -0,0 +1,136 @@
+#include "linesimplifier.h"
+
+#include "tasknotifier.h"
+
+#include <QRunnable>
+#include <QThreadPool>
+#include <QtGlobal>
+
+#include <limits>
+#include <math.h>
+
+namespace {
+struct Point {
+    double x;
+    double y;
+};
+
+/// Projects coordinate to Web Mercator with the world mapped to [0,1]
+Point project(const QMapLibre::Coordinate &c) {
+    const double lat = qBound(-85.0511287798, c.first, 85.0511287798) * M_PI / 180.0;
+    return {c.second / 360.0 + 0.5, 0.5 - log(tan(M_PI / 4 + lat / 2)) / (2 * M_PI)};
+}
+
+/// Squared distance from p to segment ab
+double segmentDistance2(const Point &p, const Point &a, const Point &b) {
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double x = a.x;
+    double y = a.y;
+    const double l2 = dx * dx + dy * dy;
+    if (l2 > 0) {
+        const double t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / l2;
+        if (t > 1) {
+            x = b.x;
+            y = b.y;
+        } else if (t > 0) {
+            x += dx * t;
+            y += dy * t;
+        }
+    }
+    dx = p.x - x;
+    dy = p.y - y;
+    return dx * dx + dy * dy;
+}
+
+class LineSimplifierTask : public QRunnable {
+  public:
+    LineSimplifierTask(const QSharedPointer<LineSimplifier> &s, QObject *receiver,
+                       const char *member)
+        : m_simplifier(s), m_notifier(new TaskNotifier(receiver, member)) {}
+
+    void run() override {
+        m_simplifier->build();
+        m_notifier->notify();
+    }
+
+  private:
+    QSharedPointer<LineSimplifier> m_simplifier;
+    TaskNotifier *m_notifier; ///< Deletes itself after notification
+};
+} // namespace
+
+LineSimplifier::LineSimplifier(const QMapLibre::Coordinates &coordinates)
+    : m_coordinates(coordinates) {}
+
+void LineSimplifier::build() {
+    if (ready())
+        return;
+
+    const int n = m_coordinates.size();
+    m_importance.fill(0, n);
+    if (n == 0) {
+        m_ready.storeRelease(1);
+        return;
+    }
+
+    QVector<Point> points(n);
+    for (int i = 0; i < n; ++i)
+        points[i] = project(m_coordinates[i]);
+
+    // end points are always kept
+    const double inf = std::numeric_limits<double>::infinity();
+    m_importance[0] = inf;
+    m_importance[n - 1] = inf;
+
+    // Douglas-Peucker without recursion. Importance of a vertex is limited by the importance of the
+    // vertex that split the segment to keep the hierarchy monotonic
+    struct Segment {
+        int first;
+        int last;
+        double importance;
+    };
+    QVector<Segment> stack;
+    stack.append({0, n - 1, inf});
+    while (!stack.isEmpty()) {
+        const Segment s = stack.takeLast();
+        if (s.last - s.first < 2)
+            continue;
+
+        double dmax = -1;
+        int imax = s.first + 1;
+        for (int i = s.first + 1; i < s.last; ++i) {
+            const double d = segmentDistance2(points[i], points[s.first], points[s.last]);
+            if (d > dmax) {
+                dmax = d;
+                imax = i;
+            }
+        }
+
+        const double importance = qMin(sqrt(dmax), s.importance);
+        m_importance[imax] = importance;
+        stack.append({s.first, imax, importance});
+        stack.append({imax, s.last, importance});
+    }
+
+    m_ready.storeRelease(1);
+}
+
+QMapLibre::Coordinates LineSimplifier::simplified(int zoom) const {
+    if (zoom >= maximalZoom)
+        return m_coordinates;
+
+    // tolerance at the largest zoom within the bucket
+    const double t = tolerance / (512.0 * pow(2.0, qMax(zoom, 0) + 1));
+
+    QMapLibre::Coordinates result;
+    for (int i = 0; i < m_coordinates.size(); ++i)
+        if (m_importance[i] > t)
+            result.append(m_coordinates[i]);
+    return result;
+}
+
+void LineSimplifier::startBuild(const QSharedPointer<LineSimplifier> &simplifier,
+                                QObject *receiver, const char *member) {
+    QThreadPool::globalInstance()->start(new LineSimplifierTask(simplifier, receiver, member));
+}
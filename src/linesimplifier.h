@@ -0,0 +1,54 @@
+#ifndef LINESIMPLIFIER_H
+#define LINESIMPLIFIER_H
+
+#include <QMapLibre/Types>
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+
+//////////////////////////////////////////////////////////////////////////
+/// LineSimplifier keeps a line together with the Douglas-Peucker hierarchy
+/// of its vertices. The hierarchy is computed once, in Web Mercator
+/// coordinates, by recording for each vertex the largest tolerance at which
+/// it is still kept by the simplification. Afterwards, the line simplified
+/// for any zoom level is obtained by a single pass over the vertices.
+///
+/// The hierarchy is computed by build(). As this takes a while for long
+/// lines, use startBuild() to compute it in the thread pool. The simplifier
+/// is immutable after it has been built and can be used from any thread
+/// after ready() returns true.
+
+class LineSimplifier {
+  public:
+    LineSimplifier() {}
+    LineSimplifier(const QMapLibre::Coordinates &coordinates);
+
+    void build();
+    bool ready() const { return m_ready.loadAcquire(); }
+
+    /// Build the hierarchy in the thread pool and invoke the member of the
+    /// receiver using queued connection when done
+    static void startBuild(const QSharedPointer<LineSimplifier> &simplifier, QObject *receiver,
+                           const char *member);
+
+    /// Line simplified for the given integer zoom level. Simplification is
+    /// done to be valid for all zoom levels in [zoom, zoom+1). Full line is
+    /// returned for zoom levels at or above maximalZoom.
+    QMapLibre::Coordinates simplified(int zoom) const;
+
+    const QMapLibre::Coordinates &coordinates() const { return m_coordinates; }
+
+  public:
+    /// Tolerance of simplification in pixels of 512-pixel tiles
+    static constexpr double tolerance = 0.5;
+    static constexpr int maximalZoom = 20;
+
+  private:
+    QMapLibre::Coordinates m_coordinates;
+    QVector<double> m_importance; ///< Largest tolerance keeping the vertex, in world units
+    QAtomicInt m_ready{0};
+};
+
+#endif // LINESIMPLIFIER_H
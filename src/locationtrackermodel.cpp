@@ -0,0 +1,128 @@
+#include "locationtrackermodel.h"
+
+#include <QMetaObject>
+#include <QMutexLocker>
+
+LocationTrackerModel::LocationTrackerModel(QObject *parent) : QAbstractListModel(parent) {}
+
+int LocationTrackerModel::rowCount(const QModelIndex &parent) const {
+    if (parent.isValid())
+        return 0;
+    return m_trackers.size();
+}
+
+QVariant LocationTrackerModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() < 0 || index.row() >= m_trackers.size())
+        return QVariant();
+
+    const Tracker &t = m_trackers[index.row()];
+    switch (role) {
+    case TrackerIdRole:
+        return t.id;
+    case CoordinateRole:
+        return QVariant::fromValue(t.coordinate);
+    case XRole:
+        return t.position.x();
+    case YRole:
+        return t.position.y();
+    case VisibleRole:
+        return t.visible;
+    }
+    return QVariant();
+}
+
+QHash<int, QByteArray> LocationTrackerModel::roleNames() const {
+    QHash<int, QByteArray> roles;
+    roles[TrackerIdRole] = "trackerId";
+    roles[CoordinateRole] = "coordinate";
+    roles[XRole] = "x";
+    roles[YRole] = "y";
+    roles[VisibleRole] = "visible";
+    return roles;
+}
+
+void LocationTrackerModel::setTracker(const QString &id, const QGeoCoordinate &coordinate) {
+    auto row = m_rows.constFind(id);
+    if (row != m_rows.constEnd()) {
+        // position is updated on the next frame
+        const int r = row.value();
+        m_trackers[r].coordinate = coordinate;
+        emit dataChanged(index(r), index(r), {CoordinateRole});
+        return;
+    }
+
+    const int r = m_trackers.size();
+    beginInsertRows(QModelIndex(), r, r);
+    Tracker t;
+    t.id = id;
+    t.coordinate = coordinate;
+    m_trackers.append(t);
+    m_rows.insert(id, r);
+    endInsertRows();
+}
+
+void LocationTrackerModel::removeTracker(const QString &id) {
+    auto row = m_rows.find(id);
+    if (row == m_rows.end())
+        return;
+
+    const int r = row.value();
+    beginRemoveRows(QModelIndex(), r, r);
+    m_trackers.remove(r);
+    m_rows.erase(row);
+    for (int i = r; i < m_trackers.size(); ++i)
+        m_rows[m_trackers[i].id] = i;
+    endRemoveRows();
+
+    QMutexLocker lk(&m_mutex);
+    m_pending.remove(id);
+}
+
+void LocationTrackerModel::clear() {
+    beginResetModel();
+    m_trackers.clear();
+    m_rows.clear();
+    endResetModel();
+
+    QMutexLocker lk(&m_mutex);
+    m_pending.clear();
+}
+
+void LocationTrackerModel::setPosition(const QString &id, const QPoint &position, bool visible) {
+    QMutexLocker lk(&m_mutex);
+    m_pending.insert(id, {position, visible});
+}
+
+void LocationTrackerModel::postFlush() {
+    QMutexLocker lk(&m_mutex);
+    if (m_pending.isEmpty() || m_flush_posted)
+        return;
+    m_flush_posted = true;
+    QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+}
+
+void LocationTrackerModel::flush() {
+    QHash<QString, Position> pending;
+    {
+        QMutexLocker lk(&m_mutex);
+        pending.swap(m_pending);
+        m_flush_posted = false;
+    }
+
+    int first = m_trackers.size();
+    int last = -1;
+    for (auto i = pending.constBegin(); i != pending.constEnd(); ++i) {
+        auto row = m_rows.constFind(i.key());
+        if (row == m_rows.constEnd())
+            continue;
+
+        Tracker &t = m_trackers[row.value()];
+        t.position = i.value().position;
+        t.visible = i.value().visible;
+        first = qMin(first, row.value());
+        last = qMax(last, row.value());
+    }
+
+    if (last >= first)
+        emit dataChanged(index(first), index(last), {XRole, YRole, VisibleRole});
+}
@@ -0,0 +1,74 @@
+#ifndef LOCATIONTRACKERMODEL_H
+#define LOCATIONTRACKERMODEL_H
+
+#include <QAbstractListModel>
+#include <QGeoCoordinate>
+#include <QHash>
+#include <QMutex>
+#include <QPoint>
+#include <QVector>
+
+//////////////////////////////////////////////////////////////////////////
+/// LocationTrackerModel exposes tracked locations and their positions on
+/// the map widget as a list model.
+///
+/// Trackers are added and removed in the GUI thread. Positions are set
+/// while rendering the map and are applied in the GUI thread on flush,
+/// with a single dataChanged signal covering all rows changed in the frame.
+
+class LocationTrackerModel : public QAbstractListModel {
+    Q_OBJECT
+
+  public:
+    enum Roles {
+        TrackerIdRole = Qt::UserRole + 1,
+        CoordinateRole,
+        XRole,
+        YRole,
+        VisibleRole
+    };
+
+  public:
+    explicit LocationTrackerModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    /// Tracker management, called from the GUI thread
+    void setTracker(const QString &id, const QGeoCoordinate &coordinate);
+    void removeTracker(const QString &id);
+    void clear();
+
+    /// Record new position of the tracker. Can be called from any thread,
+    /// positions are applied on flush
+    void setPosition(const QString &id, const QPoint &position, bool visible);
+
+    /// Schedule flush in the GUI thread if there are recorded positions
+    void postFlush();
+
+  public slots:
+    void flush(); ///< Apply recorded positions
+
+  private:
+    struct Tracker {
+        QString id;
+        QGeoCoordinate coordinate;
+        QPoint position;
+        bool visible{false};
+    };
+
+    struct Position {
+        QPoint position;
+        bool visible;
+    };
+
+    QVector<Tracker> m_trackers;
+    QHash<QString, int> m_rows; ///< Row by tracker id
+
+    QMutex m_mutex; ///< Protects pending positions
+    QHash<QString, Position> m_pending;
+    bool m_flush_posted{false};
+};
+
+#endif // LOCATIONTRACKERMODEL_H
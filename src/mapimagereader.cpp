@@ -0,0 +1,176 @@
+#include "mapimagereader.h"
+
+#include "tasknotifier.h"
+
+#include <QByteArray>
+#include <QMetaObject>
+#include <QRunnable>
+#include <QThreadPool>
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#endif
+
+#include <string.h>
+
+#include <QDebug>
+
+namespace {
+class MapImageTask : public QRunnable {
+  public:
+    MapImageTask(const MapImageReader::Image &image, QObject *receiver, const char *member)
+        : m_image(image), m_member(member), m_notifier(new TaskNotifier(receiver, member)) {}
+
+    void run() override {
+        // rows are read from GL bottom up
+        QImage image = m_image.image.mirrored();
+        if (!image.isNull() && m_image.size.isValid() && image.size() != m_image.size)
+            image = image.scaled(m_image.size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+        QString fileName;
+        const QString &requested = m_image.request.fileName;
+        if (!image.isNull() && !requested.isEmpty()) {
+            if (image.save(requested))
+                fileName = requested;
+            else
+                qWarning() << "MapImageReader: failed to save image to" << requested;
+        }
+
+        const QByteArray member = m_member;
+        const QVariant requestId = m_image.request.requestId;
+        m_notifier->notify([member, image, fileName, requestId](QObject *receiver) {
+            QMetaObject::invokeMethod(receiver, member.constData(), Qt::DirectConnection,
+                                      Q_ARG(QImage, image), Q_ARG(QString, fileName),
+                                      Q_ARG(QVariant, requestId));
+        });
+    }
+
+  private:
+    MapImageReader::Image m_image;
+    QByteArray m_member;
+    TaskNotifier *m_notifier; ///< Deletes itself after notification
+};
+} // namespace
+
+void MapImageReader::finish(const Image &image, QObject *receiver, const char *member) {
+    QThreadPool::globalInstance()->start(new MapImageTask(image, receiver, member));
+}
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+
+bool MapImageReader::init() {
+    if (m_initialized)
+        return m_fbo != 0;
+
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context) {
+        qWarning() << "MapImageReader: no current QOpenGLContext";
+        return false;
+    }
+
+    m_initialized = true;
+    const QSurfaceFormat format = context->format();
+    if (context->isOpenGLES())
+        m_async = format.majorVersion() >= 3;
+    else
+        m_async = format.version() >= qMakePair(3, 2);
+
+    context->functions()->glGenFramebuffers(1, &m_fbo);
+    return m_fbo != 0;
+}
+
+void MapImageReader::read(GLuint texture, const QSize &size, const QSize &imageSize,
+                          const Request &request) {
+    if (!texture || size.isEmpty() || !init()) {
+        m_done.append({QImage(), imageSize, request});
+        return;
+    }
+
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    QOpenGLExtraFunctions *f = context->extraFunctions();
+
+    GLint previous = 0;
+    f->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    f->glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    f->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+    if (m_async) {
+        // copy is queued on GPU, pixels are fetched after the fence is signaled
+        Read r;
+        r.size = size;
+        r.imageSize = imageSize;
+        r.request = request;
+        f->glGenBuffers(1, &r.buffer);
+        f->glBindBuffer(GL_PIXEL_PACK_BUFFER, r.buffer);
+        f->glBufferData(GL_PIXEL_PACK_BUFFER, size.width() * size.height() * 4, nullptr,
+                        GL_STREAM_READ);
+        f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        r.fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_reads.append(r);
+    } else {
+        QImage image(size, QImage::Format_RGBA8888_Premultiplied);
+        f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE,
+                        image.bits());
+        m_done.append({image, imageSize, request});
+    }
+
+    f->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    f->glBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+
+QList<MapImageReader::Image> MapImageReader::take() {
+    if (!m_reads.isEmpty()) {
+        QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+        for (auto i = m_reads.begin(); i != m_reads.end();) {
+            const GLenum status = f->glClientWaitSync(i->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                ++i;
+                continue;
+            }
+
+            QImage image(i->size, QImage::Format_RGBA8888_Premultiplied);
+            const int bytes = i->size.width() * i->size.height() * 4;
+            f->glBindBuffer(GL_PIXEL_PACK_BUFFER, i->buffer);
+            const void *data = f->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+            if (data) {
+                memcpy(image.bits(), data, bytes);
+                f->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            } else {
+                qWarning() << "MapImageReader: failed to map pixel buffer";
+                image = QImage();
+            }
+            f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            f->glDeleteBuffers(1, &i->buffer);
+            f->glDeleteSync(i->fence);
+
+            m_done.append({image, i->imageSize, i->request});
+            i = m_reads.erase(i);
+        }
+    }
+
+    QList<Image> done;
+    done.swap(m_done);
+    return done;
+}
+
+void MapImageReader::release() {
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context)
+        return;
+
+    QOpenGLExtraFunctions *f = context->extraFunctions();
+    for (Read &r : m_reads) {
+        f->glDeleteBuffers(1, &r.buffer);
+        f->glDeleteSync(r.fence);
+    }
+    m_reads.clear();
+    if (m_fbo)
+        f->glDeleteFramebuffers(1, &m_fbo);
+    m_fbo = 0;
+    m_initialized = false;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef MAPIMAGEREADER_H
+#define MAPIMAGEREADER_H
+
+#include "macros.h"
+
+#include <QImage>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QVariant>
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+#include <QtGui/qopengl.h>
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+/// MapImageReader reads the rendered map from its texture into images
+/// without waiting for GPU. Pixels are copied into pixel buffer objects
+/// and fetched on a later frame, after the fence inserted behind the copy
+/// has been signaled. If pixel buffer objects or fences are not supported
+/// by the context, pixels are read directly.
+///
+/// All GL methods have to be called with the same GL context current.
+/// Fetched images are upside down and in the size of the texture part,
+/// they are flipped and scaled by finish() in the thread pool.
+
+class MapImageReader {
+  public:
+    struct Request {
+        QVariant requestId;
+        qreal scale{1};   ///< Scale relative to the full resolution of the map
+        QString fileName; ///< Image is saved into the file if not empty
+    };
+
+    struct Image {
+        QImage image;
+        QSize size; ///< Requested size of the image
+        Request request;
+    };
+
+    /// Flip and scale the image in the thread pool, save it if requested,
+    /// and invoke the member of the receiver with the image, file name, and
+    /// request id using queued connection
+    static void finish(const Image &image, QObject *receiver, const char *member);
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+  public:
+    /// Start reading the part of the texture used by the map
+    void read(GLuint texture, const QSize &size, const QSize &imageSize, const Request &request);
+
+    QList<Image> take(); ///< Images that have been read since the last call
+    bool pending() const { return !m_reads.isEmpty(); }
+    void release();      ///< Release GL resources
+
+  private:
+    struct Read {
+        GLuint buffer{0};
+        GLsync fence{nullptr};
+        QSize size; ///< Size of the read part of the texture
+        QSize imageSize;
+        Request request;
+    };
+
+    bool init();
+
+  private:
+    bool m_initialized{false};
+    bool m_async{false};
+    GLuint m_fbo{0};
+    QList<Read> m_reads;
+    QList<Image> m_done;
+#endif
+};
+
+#endif // MAPIMAGEREADER_H
@@ -0,0 +1,341 @@
+#include "pointcluster.h"
+
+#include "tasknotifier.h"
+
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVariantMap>
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+namespace {
+const int nodeSize = 64; ///< Size of KD-tree leaves
+
+double lngX(double lng) { return lng / 360.0 + 0.5; }
+
+double latY(double lat) {
+    const double s = sin(lat * M_PI / 180.0);
+    const double y = 0.5 - 0.25 * log((1 + s) / (1 - s)) / M_PI;
+    return qBound(0.0, y, 1.0);
+}
+
+double xLng(double x) { return (x - 0.5) * 360.0; }
+
+double yLat(double y) {
+    const double y2 = (180.0 - y * 360.0) * M_PI / 180.0;
+    return 360.0 * atan(exp(y2)) / M_PI - 90.0;
+}
+
+QString abbreviate(int count) {
+    if (count >= 10000)
+        return QString("%1k").arg(count / 1000);
+    if (count >= 1000)
+        return QString("%1k").arg(count / 100 / 10.0, 0, 'f', 1);
+    return QString::number(count);
+}
+
+class PointClusterTask : public QRunnable {
+  public:
+    PointClusterTask(const QSharedPointer<PointCluster> &c, QObject *receiver, const char *member)
+        : m_cluster(c), m_notifier(new TaskNotifier(receiver, member)) {}
+
+    void run() override {
+        m_cluster->build();
+        m_notifier->notify();
+    }
+
+  private:
+    QSharedPointer<PointCluster> m_cluster;
+    TaskNotifier *m_notifier; ///< Deletes itself after notification
+};
+} // namespace
+
+/// KD-tree
+
+void PointCluster::KDTree::build(const QVector<Node> &nodes) {
+    m_items.resize(nodes.size());
+    for (int i = 0; i < nodes.size(); ++i)
+        m_items[i] = {nodes[i].x, nodes[i].y, i};
+    sort(0, m_items.size() - 1, 0);
+}
+
+void PointCluster::KDTree::sort(int left, int right, int axis) {
+    if (right - left <= nodeSize)
+        return;
+
+    const int m = (left + right) / 2;
+    std::nth_element(m_items.begin() + left, m_items.begin() + m, m_items.begin() + right + 1,
+                     [axis](const Item &a, const Item &b) {
+                         return axis == 0 ? a.x < b.x : a.y < b.y;
+                     });
+    sort(left, m - 1, 1 - axis);
+    sort(m + 1, right, 1 - axis);
+}
+
+void PointCluster::KDTree::range(double minX, double minY, double maxX, double maxY,
+                                 QVector<int> &result) const {
+    struct Range {
+        int left;
+        int right;
+        int axis;
+    };
+    QVector<Range> stack;
+    stack.append({0, m_items.size() - 1, 0});
+    while (!stack.isEmpty()) {
+        const Range r = stack.takeLast();
+        if (r.right - r.left <= nodeSize) {
+            for (int i = r.left; i <= r.right; ++i) {
+                const Item &it = m_items[i];
+                if (it.x >= minX && it.x <= maxX && it.y >= minY && it.y <= maxY)
+                    result.append(it.index);
+            }
+            continue;
+        }
+
+        const int m = (r.left + r.right) / 2;
+        const Item &it = m_items[m];
+        if (it.x >= minX && it.x <= maxX && it.y >= minY && it.y <= maxY)
+            result.append(it.index);
+
+        const double v = r.axis == 0 ? it.x : it.y;
+        if ((r.axis == 0 ? minX : minY) <= v)
+            stack.append({r.left, m - 1, 1 - r.axis});
+        if ((r.axis == 0 ? maxX : maxY) >= v)
+            stack.append({m + 1, r.right, 1 - r.axis});
+    }
+}
+
+void PointCluster::KDTree::within(double x, double y, double r, QVector<int> &result) const {
+    struct Range {
+        int left;
+        int right;
+        int axis;
+    };
+    const double r2 = r * r;
+    auto inside = [x, y, r2](const Item &it) {
+        const double dx = it.x - x;
+        const double dy = it.y - y;
+        return dx * dx + dy * dy <= r2;
+    };
+
+    QVector<Range> stack;
+    stack.append({0, m_items.size() - 1, 0});
+    while (!stack.isEmpty()) {
+        const Range s = stack.takeLast();
+        if (s.right - s.left <= nodeSize) {
+            for (int i = s.left; i <= s.right; ++i)
+                if (inside(m_items[i]))
+                    result.append(m_items[i].index);
+            continue;
+        }
+
+        const int m = (s.left + s.right) / 2;
+        const Item &it = m_items[m];
+        if (inside(it))
+            result.append(it.index);
+
+        const double v = s.axis == 0 ? it.x : it.y;
+        const double c = s.axis == 0 ? x : y;
+        if (c - r <= v)
+            stack.append({s.left, m - 1, 1 - s.axis});
+        if (c + r >= v)
+            stack.append({m + 1, s.right, 1 - s.axis});
+    }
+}
+
+/// Point cluster
+
+PointCluster::PointCluster(const QMapLibre::Coordinates &coordinates, const QStringList &names)
+    : m_coordinates(coordinates), m_names(names) {}
+
+void PointCluster::build() {
+    m_levels.resize(maxZoom + 2);
+
+    Level &points = m_levels[maxZoom + 1];
+    points.nodes.resize(m_coordinates.size());
+    for (int i = 0; i < m_coordinates.size(); ++i) {
+        const QMapLibre::Coordinate &c = m_coordinates[i];
+        points.nodes[i] = {lngX(c.second), latY(c.first), std::numeric_limits<int>::max(), i, -1,
+                           1};
+    }
+    points.tree.build(points.nodes);
+
+    for (int z = maxZoom; z >= minZoom; --z) {
+        Level &prev = m_levels[z + 1];
+        Level &level = m_levels[z];
+        level.nodes = cluster(prev.nodes, prev.tree, z);
+        level.tree.build(level.nodes);
+    }
+
+    m_ready.storeRelease(1);
+}
+
+QVector<PointCluster::Node> PointCluster::cluster(QVector<Node> &nodes, const KDTree &tree,
+                                                  int zoom) const {
+    QVector<Node> clusters;
+    const double r = radius / (extent * pow(2.0, zoom));
+    QVector<int> neighbors;
+
+    for (int i = 0; i < nodes.size(); ++i) {
+        Node &p = nodes[i];
+        if (p.zoom <= zoom)
+            continue;
+        p.zoom = zoom;
+
+        neighbors.clear();
+        tree.within(p.x, p.y, r, neighbors);
+
+        int count = p.count;
+        double wx = p.x * p.count;
+        double wy = p.y * p.count;
+        const int id = (i << 5) + (zoom + 1) + m_coordinates.size();
+        bool clustered = false;
+
+        for (int j : neighbors) {
+            Node &b = nodes[j];
+            if (b.zoom <= zoom)
+                continue;
+
+            b.zoom = zoom;
+            b.parentId = id;
+            wx += b.x * b.count;
+            wy += b.y * b.count;
+            count += b.count;
+            clustered = true;
+        }
+
+        if (clustered) {
+            p.parentId = id;
+            clusters.append({wx / count, wy / count, std::numeric_limits<int>::max(), id, -1,
+                             count});
+        } else {
+            Node n = p;
+            n.zoom = std::numeric_limits<int>::max();
+            clusters.append(n);
+        }
+    }
+
+    return clusters;
+}
+
+QVector<QMapLibre::Feature> PointCluster::features(double west, double south, double east,
+                                                   double north, int zoom) const {
+    QVector<QMapLibre::Feature> result;
+    if (!ready())
+        return result;
+
+    zoom = qBound(int(minZoom), zoom, maxZoom + 1);
+    const Level &level = m_levels[zoom];
+
+    double minLng = fmod(fmod(west + 180, 360) + 360, 360) - 180;
+    double maxLng = east == 180 ? 180 : fmod(fmod(east + 180, 360) + 360, 360) - 180;
+    const double minLat = qBound(-90.0, south, 90.0);
+    const double maxLat = qBound(-90.0, north, 90.0);
+
+    QVector<int> ids;
+    if (east - west >= 360) {
+        minLng = -180;
+        maxLng = 180;
+    } else if (minLng > maxLng) {
+        // crossing antimeridian
+        level.tree.range(lngX(minLng), latY(maxLat), lngX(180), latY(minLat), ids);
+        minLng = -180;
+    }
+    level.tree.range(lngX(minLng), latY(maxLat), lngX(maxLng), latY(minLat), ids);
+
+    result.reserve(ids.size());
+    for (int i : ids) {
+        const Node &n = level.nodes[i];
+        QVariantMap properties;
+        QMapLibre::Coordinate c;
+        QVariant id;
+        if (n.count > 1) {
+            c = QMapLibre::Coordinate(yLat(n.y), xLng(n.x));
+            properties.insert("cluster", true);
+            properties.insert("cluster_id", n.id);
+            properties.insert("point_count", n.count);
+            properties.insert("point_count_abbreviated", abbreviate(n.count));
+            id = n.id;
+        } else {
+            c = m_coordinates[n.id];
+            if (n.id < m_names.size() && !m_names[n.id].isEmpty())
+                properties.insert("name", m_names[n.id]);
+        }
+
+        QMapLibre::CoordinatesCollections geometry(
+            1, QMapLibre::CoordinatesCollection(1, QMapLibre::Coordinates(1, c)));
+        result.append(
+            QMapLibre::Feature(QMapLibre::Feature::PointType, geometry, properties, id));
+    }
+
+    return result;
+}
+
+QVector<const PointCluster::Node *> PointCluster::children(int clusterId) const {
+    QVector<const Node *> result;
+    const int oid = originId(clusterId);
+    const int oz = originZoom(clusterId);
+    if (!ready() || oz < minZoom + 1 || oz > maxZoom + 1)
+        return result;
+
+    const Level &level = m_levels[oz];
+    if (oid < 0 || oid >= level.nodes.size())
+        return result;
+
+    const Node &origin = level.nodes[oid];
+    const double r = radius / (extent * pow(2.0, oz - 1));
+    QVector<int> ids;
+    level.tree.within(origin.x, origin.y, r, ids);
+    for (int i : ids)
+        if (level.nodes[i].parentId == clusterId)
+            result.append(&level.nodes[i]);
+
+    return result;
+}
+
+void PointCluster::appendLeaves(int clusterId, int limit, int offset, int &skipped,
+                                QVector<int> &result) const {
+    for (const Node *c : children(clusterId)) {
+        if (c->count > 1) {
+            if (skipped + c->count <= offset)
+                skipped += c->count; // skip the whole cluster
+            else
+                appendLeaves(c->id, limit, offset, skipped, result);
+        } else if (skipped < offset)
+            skipped++;
+        else
+            result.append(c->id);
+
+        if (result.size() >= limit)
+            break;
+    }
+}
+
+QVector<int> PointCluster::leaves(int clusterId, int limit, int offset) const {
+    QVector<int> result;
+    int skipped = 0;
+    appendLeaves(clusterId, limit, offset, skipped, result);
+    return result;
+}
+
+int PointCluster::expansionZoom(int clusterId) const {
+    int z = originZoom(clusterId) - 1;
+    if (!ready() || z < minZoom || z > maxZoom)
+        return -1;
+
+    while (z <= maxZoom) {
+        const QVector<const Node *> c = children(clusterId);
+        z++;
+        if (c.size() != 1)
+            break;
+        clusterId = c.first()->id;
+    }
+    return z;
+}
+
+void PointCluster::startBuild(const QSharedPointer<PointCluster> &cluster, QObject *receiver,
+                              const char *member) {
+    QThreadPool::globalInstance()->start(new PointClusterTask(cluster, receiver, member));
+}
@@ -0,0 +1,107 @@
+#ifndef POINTCLUSTER_H
+#define POINTCLUSTER_H
+
+#include <QMapLibre/Types>
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
+
+//////////////////////////////////////////////////////////////////////////
+/// PointCluster is a clustering index for large sets of points. Points
+/// are clustered for each integer zoom level using hierarchical greedy
+/// clustering, as done by supercluster. On each zoom level, clusters and
+/// points are kept in a static KD-tree allowing to look up the ones
+/// within the visible area.
+///
+/// The index is built by build(). As building of the index takes a while
+/// for large sets, use startBuild() to build it in the thread pool. The
+/// index is immutable after it has been built and can be used from any
+/// thread after ready() returns true.
+
+class PointCluster {
+  public:
+    PointCluster(const QMapLibre::Coordinates &coordinates, const QStringList &names);
+
+    void build();
+    bool ready() const { return m_ready.loadAcquire(); }
+
+    /// Clusters and points on the given zoom level within bounds. Longitudes
+    /// can extend beyond [-180, 180] for areas crossing the antimeridian
+    QVector<QMapLibre::Feature> features(double west, double south, double east, double north,
+                                         int zoom) const;
+
+    /// Original points of the cluster, returned as indexes of the points
+    QVector<int> leaves(int clusterId, int limit, int offset) const;
+
+    /// Zoom level at which the cluster splits into several children. Returns -1 if the
+    /// cluster is not found
+    int expansionZoom(int clusterId) const;
+
+    const QMapLibre::Coordinates &coordinates() const { return m_coordinates; }
+    const QStringList &names() const { return m_names; }
+
+    /// Build the index in the thread pool and invoke the member of the receiver
+    /// using queued connection when done
+    static void startBuild(const QSharedPointer<PointCluster> &cluster, QObject *receiver,
+                           const char *member);
+
+  public:
+    static constexpr int minZoom = 0;
+    static constexpr int maxZoom = 16;
+    static constexpr double radius = 40;  ///< Cluster radius in pixels
+    static constexpr double extent = 512; ///< Tile extent in pixels
+
+  private:
+    /// \brief Cluster or point on a zoom level
+    struct Node {
+        double x;
+        double y;
+        int zoom;     ///< Last zoom level where the node was processed
+        int id;       ///< Point index or cluster id
+        int parentId; ///< Cluster id of the parent, -1 if none
+        int count;    ///< Number of points in cluster, 1 for points
+    };
+
+    /// \brief Static KD-tree over nodes of a zoom level
+    class KDTree {
+      public:
+        void build(const QVector<Node> &nodes);
+        void range(double minX, double minY, double maxX, double maxY, QVector<int> &result) const;
+        void within(double x, double y, double r, QVector<int> &result) const;
+
+      private:
+        void sort(int left, int right, int axis);
+
+      private:
+        struct Item {
+            double x;
+            double y;
+            int index;
+        };
+        QVector<Item> m_items;
+    };
+
+    /// \brief Nodes on a zoom level with their KD-tree
+    struct Level {
+        QVector<Node> nodes;
+        KDTree tree;
+    };
+
+    QVector<Node> cluster(QVector<Node> &nodes, const KDTree &tree, int zoom) const;
+    QVector<const Node *> children(int clusterId) const;
+    void appendLeaves(int clusterId, int limit, int offset, int &skipped,
+                      QVector<int> &result) const;
+    int originId(int clusterId) const { return (clusterId - m_coordinates.size()) >> 5; }
+    int originZoom(int clusterId) const { return (clusterId - m_coordinates.size()) % 32; }
+
+  private:
+    QMapLibre::Coordinates m_coordinates;
+    QStringList m_names;
+    QVector<Level> m_levels; ///< Indexed by zoom, maxZoom+1 keeps the points
+    QAtomicInt m_ready{0};
+};
+
+#endif // POINTCLUSTER_H
@@ -0,0 +1,347 @@
+#include "projection.h"
+
+#include <QMutexLocker>
+#include <QtGlobal>
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PROJECTION_SSE2
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PROJECTION_AVX2
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define PROJECTION_NEON
+#endif
+
+namespace {
+const double tileSize = 512;
+const double sampleDistance = 256; ///< Distance of samples from the center in world pixels
+const double tolerance = 0.25;     ///< Maximal error of the projection in map pixels
+const double behind = -1e6;        ///< Pixel coordinate for points behind the camera
+
+double lngX(double lng) { return lng / 360.0 + 0.5; }
+
+double latY(double lat) {
+    const double s = sin(qBound(-85.0511287798, lat, 85.0511287798) * M_PI / 180.0);
+    return 0.5 - 0.25 * log((1 + s) / (1 - s)) / M_PI;
+}
+
+double xLng(double x) { return (x - 0.5) * 360.0; }
+
+double yLat(double y) { return 360.0 * atan(exp((0.5 - y) * 2 * M_PI)) / M_PI - 90.0; }
+
+/// Solve 8x8 linear system in place by Gaussian elimination
+bool solve(double a[8][9]) {
+    for (int c = 0; c < 8; ++c) {
+        int pivot = c;
+        for (int r = c + 1; r < 8; ++r)
+            if (fabs(a[r][c]) > fabs(a[pivot][c]))
+                pivot = r;
+        if (fabs(a[pivot][c]) < 1e-12)
+            return false;
+        if (pivot != c)
+            for (int k = 0; k < 9; ++k)
+                qSwap(a[c][k], a[pivot][k]);
+
+        for (int r = 0; r < 8; ++r) {
+            if (r == c)
+                continue;
+            const double f = a[r][c] / a[c][c];
+            for (int k = c; k < 9; ++k)
+                a[r][k] -= f * a[c][k];
+        }
+    }
+
+    for (int r = 0; r < 8; ++r)
+        a[r][8] /= a[r][r];
+    return true;
+}
+
+/// Homography kernels: ws = h6 x + h7 y + h8, us = (h0 x + h1 y + h2) / ws,
+/// vs = (h3 x + h4 y + h5) / ws
+typedef void (*HomographyKernel)(const double *h, const double *xs, const double *ys,
+                                 double *us, double *vs, double *ws, int n);
+
+void homographyScalar(const double *h, const double *xs, const double *ys, double *us,
+                      double *vs, double *ws, int n) {
+    for (int i = 0; i < n; ++i) {
+        ws[i] = h[6] * xs[i] + h[7] * ys[i] + h[8];
+        us[i] = (h[0] * xs[i] + h[1] * ys[i] + h[2]) / ws[i];
+        vs[i] = (h[3] * xs[i] + h[4] * ys[i] + h[5]) / ws[i];
+    }
+}
+
+#ifdef PROJECTION_SSE2
+void homographySse2(const double *h, const double *xs, const double *ys, double *us,
+                    double *vs, double *ws, int n) {
+    __m128d hv[9];
+    for (int k = 0; k < 9; ++k)
+        hv[k] = _mm_set1_pd(h[k]);
+
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const __m128d x = _mm_loadu_pd(xs + i);
+        const __m128d y = _mm_loadu_pd(ys + i);
+        const __m128d w =
+            _mm_add_pd(_mm_add_pd(_mm_mul_pd(hv[6], x), _mm_mul_pd(hv[7], y)), hv[8]);
+        const __m128d u =
+            _mm_add_pd(_mm_add_pd(_mm_mul_pd(hv[0], x), _mm_mul_pd(hv[1], y)), hv[2]);
+        const __m128d v =
+            _mm_add_pd(_mm_add_pd(_mm_mul_pd(hv[3], x), _mm_mul_pd(hv[4], y)), hv[5]);
+        _mm_storeu_pd(ws + i, w);
+        _mm_storeu_pd(us + i, _mm_div_pd(u, w));
+        _mm_storeu_pd(vs + i, _mm_div_pd(v, w));
+    }
+    homographyScalar(h, xs + i, ys + i, us + i, vs + i, ws + i, n - i);
+}
+#endif
+
+#ifdef PROJECTION_AVX2
+__attribute__((target("avx2,fma"))) void homographyAvx2(const double *h, const double *xs,
+                                                         const double *ys, double *us,
+                                                         double *vs, double *ws, int n) {
+    __m256d hv[9];
+    for (int k = 0; k < 9; ++k)
+        hv[k] = _mm256_set1_pd(h[k]);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m256d x = _mm256_loadu_pd(xs + i);
+        const __m256d y = _mm256_loadu_pd(ys + i);
+        const __m256d w = _mm256_fmadd_pd(hv[6], x, _mm256_fmadd_pd(hv[7], y, hv[8]));
+        const __m256d u = _mm256_fmadd_pd(hv[0], x, _mm256_fmadd_pd(hv[1], y, hv[2]));
+        const __m256d v = _mm256_fmadd_pd(hv[3], x, _mm256_fmadd_pd(hv[4], y, hv[5]));
+        _mm256_storeu_pd(ws + i, w);
+        _mm256_storeu_pd(us + i, _mm256_div_pd(u, w));
+        _mm256_storeu_pd(vs + i, _mm256_div_pd(v, w));
+    }
+    homographyScalar(h, xs + i, ys + i, us + i, vs + i, ws + i, n - i);
+}
+#endif
+
+#ifdef PROJECTION_NEON
+void homographyNeon(const double *h, const double *xs, const double *ys, double *us,
+                    double *vs, double *ws, int n) {
+    float64x2_t hv[9];
+    for (int k = 0; k < 9; ++k)
+        hv[k] = vdupq_n_f64(h[k]);
+
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const float64x2_t x = vld1q_f64(xs + i);
+        const float64x2_t y = vld1q_f64(ys + i);
+        const float64x2_t w = vfmaq_f64(vfmaq_f64(hv[8], hv[7], y), hv[6], x);
+        const float64x2_t u = vfmaq_f64(vfmaq_f64(hv[2], hv[1], y), hv[0], x);
+        const float64x2_t v = vfmaq_f64(vfmaq_f64(hv[5], hv[4], y), hv[3], x);
+        vst1q_f64(ws + i, w);
+        vst1q_f64(us + i, vdivq_f64(u, w));
+        vst1q_f64(vs + i, vdivq_f64(v, w));
+    }
+    homographyScalar(h, xs + i, ys + i, us + i, vs + i, ws + i, n - i);
+}
+#endif
+
+HomographyKernel homographyKernel(Projection::Kernel kernel) {
+    switch (kernel) {
+#ifdef PROJECTION_SSE2
+    case Projection::Kernel::Sse2:
+        return homographySse2;
+#endif
+#ifdef PROJECTION_AVX2
+    case Projection::Kernel::Avx2:
+        return homographyAvx2;
+#endif
+#ifdef PROJECTION_NEON
+    case Projection::Kernel::Neon:
+        return homographyNeon;
+#endif
+    default:
+        return homographyScalar;
+    }
+}
+
+bool invert(const double m[9], double inv[9]) {
+    inv[0] = m[4] * m[8] - m[5] * m[7];
+    inv[1] = m[2] * m[7] - m[1] * m[8];
+    inv[2] = m[1] * m[5] - m[2] * m[4];
+    inv[3] = m[5] * m[6] - m[3] * m[8];
+    inv[4] = m[0] * m[8] - m[2] * m[6];
+    inv[5] = m[2] * m[3] - m[0] * m[5];
+    inv[6] = m[3] * m[7] - m[4] * m[6];
+    inv[7] = m[1] * m[6] - m[0] * m[7];
+    inv[8] = m[0] * m[4] - m[1] * m[3];
+    const double det = m[0] * inv[0] + m[1] * inv[3] + m[2] * inv[6];
+    if (fabs(det) < 1e-300)
+        return false;
+    for (int i = 0; i < 9; ++i)
+        inv[i] /= det;
+    return true;
+}
+} // namespace
+
+Projection Projection::fromMap(QMapLibre::Map *map, qreal mapToQtPixelRatio) {
+    Projection p;
+    if (!map || mapToQtPixelRatio <= 0)
+        return p;
+
+    const QMapLibre::Coordinate center = map->coordinate();
+    p.m_center_x = lngX(center.second);
+    p.m_center_y = latY(center.first);
+    p.m_scale = tileSize * pow(2.0, map->zoom());
+
+    auto sample = [&p, map, mapToQtPixelRatio](double x, double y) {
+        QMapLibre::Coordinate c(yLat(p.m_center_y + y / p.m_scale),
+                                xLng(p.m_center_x + x / p.m_scale));
+        return map->pixelForCoordinate(c) / mapToQtPixelRatio;
+    };
+
+    // homography with h[8] = 1 from four samples
+    const double d = sampleDistance;
+    const double xs[4] = {-d, d, d, -d};
+    const double ys[4] = {-d, -d, d, d};
+    double a[8][9];
+    for (int i = 0; i < 4; ++i) {
+        const QPointF s = sample(xs[i], ys[i]);
+        const double x = xs[i], y = ys[i], u = s.x(), v = s.y();
+        const double ru[9] = {x, y, 1, 0, 0, 0, -x * u, -y * u, u};
+        const double rv[9] = {0, 0, 0, x, y, 1, -x * v, -y * v, v};
+        for (int k = 0; k < 9; ++k) {
+            a[2 * i][k] = ru[k];
+            a[2 * i + 1][k] = rv[k];
+        }
+    }
+
+    if (!solve(a))
+        return p;
+    for (int i = 0; i < 8; ++i)
+        p.m_h[i] = a[i][8];
+    p.m_h[8] = 1;
+
+    if (!invert(p.m_h, p.m_hinv))
+        return p;
+
+    // check against the point not used for the fit
+    const double cx = d / 2, cy = -d / 3;
+    const QPointF check = sample(cx, cy);
+    const double w = p.m_h[6] * cx + p.m_h[7] * cy + p.m_h[8];
+    const double u = (p.m_h[0] * cx + p.m_h[1] * cy + p.m_h[2]) / w;
+    const double v = (p.m_h[3] * cx + p.m_h[4] * cy + p.m_h[5]) / w;
+    const double tol = tolerance / mapToQtPixelRatio;
+    p.m_valid = w > 0 && fabs(u - check.x()) < tol && fabs(v - check.y()) < tol;
+    return p;
+}
+
+QPointF Projection::project(const QMapLibre::Coordinate &coordinate) const {
+    QPointF p;
+    project(&coordinate, &p, 1);
+    return p;
+}
+
+void Projection::project(const QMapLibre::Coordinate *coordinates, QPointF *pixels,
+                         int n) const {
+    static const Kernel best = kernels().last();
+    project(coordinates, pixels, n, best);
+}
+
+void Projection::project(const QMapLibre::Coordinate *coordinates, QPointF *pixels, int n,
+                         Kernel kernel) const {
+    // Mercator projection and the homography are done in separate passes
+    // over blocks of points. The second pass is done by the SIMD kernel.
+    const int block = 256;
+    double xs[block];
+    double ys[block];
+    double us[block];
+    double vs[block];
+    double ws[block];
+
+    const HomographyKernel homography = homographyKernel(kernel);
+    for (int start = 0; start < n; start += block) {
+        const int m = qMin(block, n - start);
+        const QMapLibre::Coordinate *c = coordinates + start;
+
+        for (int i = 0; i < m; ++i) {
+            // longitude is unwrapped relative to the center
+            double x = lngX(c[i].second) - m_center_x;
+            x -= floor(x + 0.5);
+            xs[i] = x * m_scale;
+            ys[i] = (latY(c[i].first) - m_center_y) * m_scale;
+        }
+
+        homography(m_h, xs, ys, us, vs, ws, m);
+
+        QPointF *p = pixels + start;
+        for (int i = 0; i < m; ++i)
+            p[i] = ws[i] > 0 ? QPointF(us[i], vs[i]) : QPointF(behind, behind);
+    }
+}
+
+QRectF Projection::bounds(const QMapLibre::Coordinate *coordinates, int n) const {
+    if (n <= 0)
+        return QRectF();
+
+    QVector<QPointF> pixels(n);
+    project(coordinates, pixels.data(), n);
+
+    double left = pixels[0].x(), right = left, top = pixels[0].y(), bottom = top;
+    for (const QPointF &p : pixels) {
+        if (p.x() == behind)
+            return QRectF();
+        left = qMin(left, p.x());
+        right = qMax(right, p.x());
+        top = qMin(top, p.y());
+        bottom = qMax(bottom, p.y());
+    }
+    return QRectF(left, top, right - left, bottom - top);
+}
+
+QMapLibre::Coordinate Projection::unproject(const QPointF &pixel) const {
+    const double *h = m_hinv;
+    const double u = pixel.x(), v = pixel.y();
+    const double w = h[6] * u + h[7] * v + h[8];
+    if (w <= 0)
+        return QMapLibre::Coordinate(NAN, NAN);
+    const double x = (h[0] * u + h[1] * v + h[2]) / w;
+    const double y = (h[3] * u + h[4] * v + h[5]) / w;
+    double lng = xLng(m_center_x + x / m_scale);
+    lng -= 360.0 * floor((lng + 180.0) / 360.0);
+    return QMapLibre::Coordinate(yLat(m_center_y + y / m_scale), lng);
+}
+
+QVector<Projection::Kernel> Projection::kernels() {
+    QVector<Kernel> result{Kernel::Scalar};
+#ifdef PROJECTION_SSE2
+    result.append(Kernel::Sse2);
+#endif
+#ifdef PROJECTION_AVX2
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        result.append(Kernel::Avx2);
+#endif
+#ifdef PROJECTION_NEON
+    result.append(Kernel::Neon);
+#endif
+    return result;
+}
+
+/// Snapshot
+
+void ProjectionSnapshot::publish(const Projection &projection) {
+    QSharedPointer<const Projection> p(new Projection(projection));
+    QMutexLocker lk(&m_mutex);
+    m_current.swap(p);
+}
+
+Projection ProjectionSnapshot::current() const {
+    QSharedPointer<const Projection> p;
+    {
+        QMutexLocker lk(&m_mutex);
+        p = m_current;
+    }
+    return p ? *p : Projection();
+}
@@ -0,0 +1,83 @@
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include <QMapLibre/Map>
+#include <QMapLibre/Types>
+
+#include <QMutex>
+#include <QPointF>
+#include <QRectF>
+#include <QSharedPointer>
+#include <QVector>
+
+//////////////////////////////////////////////////////////////////////////
+/// Projection is a snapshot of the map camera that allows to find pixel
+/// positions of coordinates without calling the map for each of them.
+///
+/// Map is drawn as a plane viewed through a perspective camera. So,
+/// Web Mercator coordinates are mapped to the screen pixels by a
+/// homography. The homography is found from the pixel positions of four
+/// points around the map center, as given by the map, and checked
+/// against the fifth point. If the check fails, the projection is marked
+/// as invalid and the map has to be used instead.
+///
+/// Pixels are given in Qt pixels, as for the location trackers.
+///
+/// Batch projection applies the homography using SIMD kernels. The kernel
+/// is selected on the first use as the best one supported by the CPU, with
+/// the scalar kernel used as a fallback.
+
+class Projection {
+  public:
+    enum class Kernel { Scalar, Sse2, Avx2, Neon };
+
+  public:
+    Projection() {}
+
+    static Projection fromMap(QMapLibre::Map *map, qreal mapToQtPixelRatio);
+
+    bool isValid() const { return m_valid; }
+
+    QPointF project(const QMapLibre::Coordinate &coordinate) const;
+
+    /// Project n coordinates. Coordinates behind the camera are projected
+    /// far outside of any viewport
+    void project(const QMapLibre::Coordinate *coordinates, QPointF *pixels, int n) const;
+    void project(const QMapLibre::Coordinate *coordinates, QPointF *pixels, int n,
+                 Kernel kernel) const;
+
+    /// Bounding box of the projected coordinates. Empty if there are no
+    /// coordinates or if any of them is behind the camera
+    QRectF bounds(const QMapLibre::Coordinate *coordinates, int n) const;
+
+    /// Coordinate for the pixel. Pixels above the horizon are returned as NaN
+    QMapLibre::Coordinate unproject(const QPointF &pixel) const;
+
+    static QVector<Kernel> kernels(); ///< Kernels supported by the CPU, the best one last
+
+  private:
+    double m_h[9]{};    ///< Homography from world pixels relative to the center to Qt pixels
+    double m_hinv[9]{}; ///< Inverse of m_h
+    double m_center_x{0};
+    double m_center_y{0};
+    double m_scale{1}; ///< World size in pixels
+    bool m_valid{false};
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// ProjectionSnapshot allows to publish projection from the render thread
+/// and read it from the GUI thread. Published projection is immutable and
+/// shared with the readers, so the lock is held only while the pointer to
+/// it is exchanged.
+
+class ProjectionSnapshot {
+  public:
+    void publish(const Projection &projection);
+    Projection current() const; ///< Invalid projection if none was published
+
+  private:
+    QSharedPointer<const Projection> m_current;
+    mutable QMutex m_mutex;
+};
+
+#endif // PROJECTION_H
@@ -45,17 +45,22 @@
 
 #include "basenode.h"
 #include "basetexturenode.h"
+#include "coordinateinput.h"
+#include "featurequery.h"
 #include "qt5/texturenode.h"
 #include "qt6/texturenodeopengl.h"
+#include "threadedtexturenode.h"
 
 #include <mbgl/util/constants.hpp>
 
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QFont>
 #include <QGuiApplication>
 #include <QJsonDocument>
 #include <QMutexLocker>
+#include <QOffscreenSurface>
 #include <QPainter>
 #include <QScreen>
 #include <QSettings>
@@ -69,8 +74,11 @@
 
 #include <QMapLibre/Utils>
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <math.h>
+#include <string.h>
 
 #include <QDebug>
 
@@ -151,15 +159,65 @@ QQuickItemMapboxGL::QQuickItemMapboxGL(QQuickItem *parent)
 
     m_pixelRatio = m_devicePixelRatio;
 
-    m_timer.setInterval(250);
-    connect(&m_timer, &QTimer::timeout, this, &QQuickItemMapboxGL::update);
-    connect(this, SIGNAL(startRefreshTimer()), &m_timer, SLOT(start()));
+    m_clock.start();
+    m_frame_timer.setSingleShot(true);
+    connect(&m_frame_timer, &QTimer::timeout, this, &QQuickItemMapboxGL::update);
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &QQuickItemMapboxGL::onLoadingRefresh);
+    connect(this, &QQuickItemMapboxGL::startRefreshTimer, this,
+            &QQuickItemMapboxGL::startLoadingRefresh);
     connect(this, &QQuickItemMapboxGL::stopRefreshTimer, &m_timer, &QTimer::stop);
 
-    // connect query signals to update to enforce rendering thread wakeup
-    connect(this, SIGNAL(querySourceExists(QString)), this, SLOT(update()));
-    connect(this, SIGNAL(queryLayerExists(QString)), this, SLOT(update()));
-    connect(this, SIGNAL(queryCoordinateForPixel(QPointF, QVariant)), this, SLOT(update()));
+    m_tracker_model = new LocationTrackerModel(this);
+
+    // map is updated when the source data converted in the thread pool is ready
+    m_sources.setConversionReceiver(this, "update");
+
+    m_update_batch_timer.setInterval(10000);
+    m_update_batch_timer.setSingleShot(true);
+    connect(&m_update_batch_timer, &QTimer::timeout, this,
+            &QQuickItemMapboxGL::onUpdateBatchTimeout);
+
+    m_source_update_timer.setInterval(250);
+    m_source_update_timer.setSingleShot(true);
+    connect(&m_source_update_timer, &QTimer::timeout, this,
+            &QQuickItemMapboxGL::submitSourceUpdates);
+
+    // queries are recorded and answered on the next sync
+    connect(this, &QQuickItemMapboxGL::querySourceExists, this,
+            [this](const QString id) { queueQuery({Query::SourceExists, id}); });
+    connect(this, &QQuickItemMapboxGL::queryLayerExists, this,
+            [this](const QString id) { queueQuery({Query::LayerExists, id}); });
+    connect(this, &QQuickItemMapboxGL::queryCoordinateForPixel, this,
+            [this](const QPointF p, const QVariant &tag) {
+                queueQuery({Query::CoordinateForPixel, QString(), p, QVariant(), tag});
+            });
+    connect(this, &QQuickItemMapboxGL::queryCoordinatesForPixels, this,
+            [this](const QVariant &pixels, const QVariant &requestId) {
+                // pixels are read here as JS values cannot be accessed in the render thread
+                QVector<QPointF> points;
+                if (!CoordinateInput::points(pixels, points)) {
+                    QString err = "Cannot read pixels for queryCoordinatesForPixels, expected "
+                                  "points or even number of doubles";
+                    setError(err);
+                    return;
+                }
+                queueQuery({Query::CoordinatesForPixels, QString(), QPointF(),
+                            QVariant::fromValue(points), requestId});
+            });
+    connect(this, &QQuickItemMapboxGL::queryFeaturesAt, this,
+            [this](const QVariant &area, const QStringList &layerIds, const QVariant &requestId) {
+                queueQuery({Query::FeaturesAt, QString(), QPointF(), area, requestId, layerIds});
+            });
+    connect(this, &QQuickItemMapboxGL::querySourceFeatures, this,
+            [this](const QString &sourceID, const QVariant &requestId) {
+                queueQuery({Query::SourceFeatures, sourceID, QPointF(), QVariant(), requestId});
+            });
+    connect(this, &QQuickItemMapboxGL::queryMapImage, this,
+            [this](const QVariant &requestId, qreal scale, const QString &fileName) {
+                queueQuery({Query::MapImage, QString(), QPointF(), QVariant(), requestId,
+                            QStringList(), scale, fileName});
+            });
 
 #ifdef USE_CURL_SSL
     // init curl and add ssl locks
@@ -190,6 +248,57 @@ QVariantList QQuickItemMapboxGL::defaultStyles() const {
     return array;
 }
 
+QVariantMap QQuickItemMapboxGL::stats() const {
+    QVariantMap s;
+    s.insert("sources", m_sources.size());
+    s.insert("layers", m_layers.size());
+    s.insert("images", m_images.size());
+    s.insert("layoutProperties", m_layout_properties.size());
+    s.insert("layoutPropertiesReplayed", m_layout_properties.replayed());
+    s.insert("paintProperties", m_paint_properties.size());
+    s.insert("paintPropertiesReplayed", m_paint_properties.replayed());
+    s.insert("dataSyncTime", m_stats_data_sync_time * 1e-6);
+    s.insert("dataSyncTimeMax", m_stats_data_sync_time_max * 1e-6);
+    s.insert("dataConversionTime", m_stats_data_conversion_time * 1e-6);
+    s.insert("dataReplayInProgress", m_data_replay);
+    s.insert("trackerUpdateTime", m_stats_tracker_update_time * 1e-6);
+    s.insert("queries", m_stats_queries);
+    s.insert("queryOnlyFrames", m_stats_query_frames);
+    s.insert("queryOnlyTimeSaved", m_stats_query_time_saved * 1e-6);
+    s.insert("skippedFrames", m_stats_skipped_frames);
+    s.insert("lateFrames", m_stats_late_frames);
+    s.insert("droppedFrames", m_stats_dropped_frames);
+    s.insert("fboAllocations", m_stats_fbo_allocations);
+    s.insert("renderScale", m_render_scale);
+    s.insert("reducedFrames", m_stats_reduced_frames);
+    s.insert("renderedFrames", m_stats_rendered_frames);
+    s.insert("coalescedFrames", m_stats_coalesced_frames);
+
+    int wakeups = 0;
+    const qint64 minuteAgo = m_clock.elapsed() - 60000;
+    for (qint64 t : m_loading_wakeups)
+        if (t > minuteAgo)
+            wakeups++;
+    s.insert("loadingWakeupsPerMinute", wakeups);
+    return s;
+}
+
+/// Conversion between coordinates and pixels
+QGeoCoordinate QQuickItemMapboxGL::coordinateForPixel(const QPointF &pixel) const {
+    const Projection projection = m_projection_snapshot.current();
+    if (!projection.isValid())
+        return QGeoCoordinate();
+    const QMapLibre::Coordinate c = projection.unproject(pixel);
+    return QGeoCoordinate(c.first, c.second);
+}
+
+QPointF QQuickItemMapboxGL::pixelForCoordinate(const QGeoCoordinate &coordinate) const {
+    const Projection projection = m_projection_snapshot.current();
+    if (!projection.isValid() || !coordinate.isValid())
+        return QPointF(NAN, NAN);
+    return projection.project({coordinate.latitude(), coordinate.longitude()});
+}
+
 /// Properties that have to be set during construction of the map
 QString QQuickItemMapboxGL::accessToken() const { return m_settings.apiKey(); }
 
@@ -283,6 +392,53 @@ void QQuickItemMapboxGL::setUseFBO(bool fbo) {
         << "Support for rendering without FBO has been dropped (useFBO is set to true always)";
 }
 
+int QQuickItemMapboxGL::dataApplyBudget() const { return m_dataApplyBudget; }
+
+void QQuickItemMapboxGL::setDataApplyBudget(int budget) {
+    budget = qMax(0, budget);
+    if (m_dataApplyBudget == budget)
+        return;
+    m_dataApplyBudget = budget;
+    emit dataApplyBudgetChanged(m_dataApplyBudget);
+}
+
+int QQuickItemMapboxGL::sourceUpdateInterval() const { return m_source_update_timer.interval(); }
+
+void QQuickItemMapboxGL::setSourceUpdateInterval(int interval) {
+    interval = qMax(0, interval);
+    if (m_source_update_timer.interval() == interval)
+        return;
+    m_source_update_timer.setInterval(interval);
+    emit sourceUpdateIntervalChanged(interval);
+}
+
+int QQuickItemMapboxGL::loadingRefreshInterval() const { return m_loading_refresh_interval; }
+
+void QQuickItemMapboxGL::setLoadingRefreshInterval(int interval) {
+    interval = qMax(0, interval);
+    if (m_loading_refresh_interval == interval)
+        return;
+    m_loading_refresh_interval = interval;
+    if (m_timer.isActive()) {
+        if (interval > 0)
+            startLoadingRefresh();
+        else
+            m_timer.stop();
+    }
+    emit loadingRefreshIntervalChanged(interval);
+}
+
+QAbstractItemModel *QQuickItemMapboxGL::trackerModel() const { return m_tracker_model; }
+
+bool QQuickItemMapboxGL::emitLocationChanged() const { return m_emit_location_changed; }
+
+void QQuickItemMapboxGL::setEmitLocationChanged(bool enabled) {
+    if (m_emit_location_changed == enabled)
+        return;
+    m_emit_location_changed = enabled;
+    emit emitLocationChangedChanged(enabled);
+}
+
 /// Error feedback
 QString QQuickItemMapboxGL::errorString() const { return m_errorString; }
 
@@ -338,6 +494,9 @@ void QQuickItemMapboxGL::setZoomLevel(qreal zoom, const QPointF &center) {
     m_zoomLevel = zoom;
     m_zoomLevelPoint = center;
 
+    if (!m_source_lines_simplified.isEmpty())
+        updateSimplifiedLines();
+
     m_syncState |= ZoomNeedsSync;
     update();
 
@@ -375,10 +534,12 @@ void QQuickItemMapboxGL::fitView(const QVariantList &coordinates, bool preserve)
     if (!preserve)
         stopFitView();
 
+    m_fit_coordinates.clear();
     for (int i = 0; i < coordinates.size(); ++i) {
         QGeoCoordinate c = coordinates[i].value<QGeoCoordinate>();
         if (c.isValid()) {
             counter++;
+            m_fit_coordinates.append({c.latitude(), c.longitude()});
 
             if (counter == 1 || c.latitude() < m_fit_sw.first)
                 m_fit_sw.first = c.latitude();
@@ -413,6 +574,43 @@ void QQuickItemMapboxGL::fitView(const QVariantList &coordinates, bool preserve)
 void QQuickItemMapboxGL::stopFitView() {
     m_fit_preserve_box = false;
     m_fit_preserve_center = false;
+    m_fit_refine = 0;
+}
+
+/// Coordinates are projected by the batch projection for the camera of the
+/// last frame and the view is scaled and moved to fit their bounding box.
+/// For pitched map, the scaling is not exact and the fit converges over
+/// several frames
+void QQuickItemMapboxGL::refineFitView() {
+    --m_fit_refine;
+    const QRectF box = m_projection.bounds(m_fit_coordinates.constData(), m_fit_coordinates.size());
+    const QRectF view(m_margins.left() * width(), m_margins.top() * height(),
+                      (1 - m_margins.left() - m_margins.right()) * width(),
+                      (1 - m_margins.top() - m_margins.bottom()) * height());
+    if (box.isNull() || view.isEmpty()) {
+        m_fit_refine = 0;
+        return;
+    }
+
+    const double scale = qMin(view.width() / qMax(box.width(), 1.0),
+                              view.height() / qMax(box.height(), 1.0));
+    const QPointF shift = box.center() - view.center();
+    const double dz = log2(scale);
+    if (fabs(dz) < 0.01 && fabs(shift.x()) < 1 && fabs(shift.y()) < 1) {
+        m_fit_refine = 0;
+        return;
+    }
+
+    const QMapLibre::Coordinate c = m_projection.unproject(box.center());
+    if (!isfinite(c.first) || !isfinite(c.second)) {
+        m_fit_refine = 0;
+        return;
+    }
+
+    m_fit_center = QGeoCoordinate(c.first, c.second);
+    m_fit_zoomLevel = m_zoomLevel + dz;
+    setCenter(m_fit_center);
+    setZoomLevel(m_fit_zoomLevel);
 }
 
 qreal QQuickItemMapboxGL::metersPerPixel() const { return m_metersPerPixel; }
@@ -510,6 +708,31 @@ void QQuickItemMapboxGL::setDevicePixelRatio(qreal devicePixelRatio) {
     emit devicePixelRatioChanged(m_devicePixelRatio);
 }
 
+bool QQuickItemMapboxGL::renderThreaded() const { return m_render_threaded; }
+
+void QQuickItemMapboxGL::setRenderThreaded(bool threaded) {
+    if (m_first_init_done) {
+        qWarning() << "RenderThreaded cannot be changed after the initialization of the map. Set "
+                      "it at creation of the widget";
+        return;
+    }
+
+    if (m_render_threaded == threaded)
+        return;
+    m_render_threaded = threaded;
+
+    // surface has to be created in the GUI thread. It is shared with
+    // the node and deleted in the GUI thread after both release it
+    if (threaded) {
+        m_render_surface.reset(new QOffscreenSurface, &QObject::deleteLater);
+        m_render_surface->setFormat(QSurfaceFormat::defaultFormat());
+        m_render_surface->create();
+    } else
+        m_render_surface.reset();
+
+    emit renderThreadedChanged(m_render_threaded);
+}
+
 qreal QQuickItemMapboxGL::pixelRatio() const { return m_pixelRatio; }
 
 void QQuickItemMapboxGL::setPixelRatio(qreal pixelRatio) {
@@ -521,6 +744,56 @@ void QQuickItemMapboxGL::setPixelRatio(qreal pixelRatio) {
 
 qreal QQuickItemMapboxGL::mapToQtPixelRatio() const { return m_mapToQtPixelRatio; }
 
+bool QQuickItemMapboxGL::adaptiveResolution() const { return m_adaptive_resolution; }
+
+void QQuickItemMapboxGL::setAdaptiveResolution(bool adaptive) {
+    if (m_adaptive_resolution == adaptive)
+        return;
+    m_adaptive_resolution = adaptive;
+    update();
+    emit adaptiveResolutionChanged(m_adaptive_resolution);
+}
+
+qreal QQuickItemMapboxGL::minimumResolutionScale() const { return m_minimum_resolution_scale; }
+
+void QQuickItemMapboxGL::setMinimumResolutionScale(qreal scale) {
+    scale = qBound(0.1, scale, 1.0);
+    if (m_minimum_resolution_scale == scale)
+        return;
+    m_minimum_resolution_scale = scale;
+    emit minimumResolutionScaleChanged(m_minimum_resolution_scale);
+}
+
+int QQuickItemMapboxGL::maximumFrameRate() const { return m_maximum_frame_rate; }
+
+void QQuickItemMapboxGL::setMaximumFrameRate(int frameRate) {
+    frameRate = qMax(0, frameRate);
+    if (m_maximum_frame_rate == frameRate)
+        return;
+    m_maximum_frame_rate = frameRate;
+    emit maximumFrameRateChanged(m_maximum_frame_rate);
+}
+
+int QQuickItemMapboxGL::idleFrameRate() const { return m_idle_frame_rate; }
+
+void QQuickItemMapboxGL::setIdleFrameRate(int frameRate) {
+    frameRate = qMax(0, frameRate);
+    if (m_idle_frame_rate == frameRate)
+        return;
+    m_idle_frame_rate = frameRate;
+    emit idleFrameRateChanged(m_idle_frame_rate);
+}
+
+int QQuickItemMapboxGL::targetFrameTime() const { return m_target_frame_time; }
+
+void QQuickItemMapboxGL::setTargetFrameTime(int frameTime) {
+    frameTime = qMax(0, frameTime);
+    if (m_target_frame_time == frameTime)
+        return;
+    m_target_frame_time = frameTime;
+    emit targetFrameTimeChanged(m_target_frame_time);
+}
+
 QString QQuickItemMapboxGL::styleJson() const { return m_styleJson; }
 
 void QQuickItemMapboxGL::setStyleJson(const QString &json) {
@@ -575,12 +848,54 @@ void QQuickItemMapboxGL::setGestureInProgress(bool progress) {
 #define DATA_UPDATE                                                                                \
     {                                                                                              \
         m_syncState |= DataNeedsSync;                                                              \
-        update();                                                                                  \
+        if (m_update_depth == 0)                                                                   \
+            update();                                                                              \
+    }
+
+/// Batch updates
+
+void QQuickItemMapboxGL::beginUpdate() {
+    if (m_update_depth++ == 0)
+        m_update_batch_timer.start();
+}
+
+void QQuickItemMapboxGL::commitUpdate() {
+    if (m_update_depth == 0) {
+        qWarning() << "commitUpdate called without matching beginUpdate";
+        return;
     }
 
+    if (--m_update_depth > 0)
+        return;
+
+    m_update_batch_timer.stop();
+
+    // properties of the layers that end up removed are not applied
+    for (const QString &id : m_layers.compact()) {
+        m_layout_properties.remove_layer(id);
+        m_paint_properties.remove_layer(id);
+    }
+    m_images.compact();
+    DATA_UPDATE;
+}
+
+/// Batch that is not committed would block application of all data
+void QQuickItemMapboxGL::onUpdateBatchTimeout() {
+    if (m_update_depth == 0)
+        return;
+
+    qWarning() << "beginUpdate was not followed by commitUpdate within"
+               << m_update_batch_timer.interval() << "ms, applying the changes";
+    m_update_depth = 1;
+    commitUpdate();
+}
+
 /// Sources
 
 void QQuickItemMapboxGL::addSource(const QString &sourceID, const QVariantMap &params) {
+    m_source_lines.remove(sourceID);
+    m_source_clusters.remove(sourceID);
+    m_source_features.remove(sourceID);
     m_sources.add(sourceID, params);
     DATA_UPDATE;
 }
@@ -605,7 +920,20 @@ void QQuickItemMapboxGL::addSourceLine(const QString &sourceID, const QVariantLi
     updateSourceLine(sourceID, coordinates, name);
 }
 
+void QQuickItemMapboxGL::addSourcePointsArray(const QString &sourceID, const QVariant &coordinates,
+                                              const QVariantList &names) {
+    updateSourcePointsArray(sourceID, coordinates, names);
+}
+
+void QQuickItemMapboxGL::addSourceLineArray(const QString &sourceID, const QVariant &coordinates,
+                                            const QString &name) {
+    updateSourceLineArray(sourceID, coordinates, name);
+}
+
 void QQuickItemMapboxGL::updateSource(const QString &sourceID, const QVariantMap &params) {
+    m_source_lines.remove(sourceID);
+    m_source_clusters.remove(sourceID);
+    m_source_features.remove(sourceID);
     m_sources.update(sourceID, params);
     DATA_UPDATE;
 }
@@ -615,91 +943,564 @@ void QQuickItemMapboxGL::updateSourcePoint(const QString &sourceID,
     updateSourcePoint(sourceID, coordinate.latitude(), coordinate.longitude(), name);
 }
 
-static QVariantMap pointJson(qreal latitude, qreal longitude, const QString &name) {
-    QVariantList coordinates({longitude, latitude});
-    QVariantMap geometry({{"type", "Point"}, {"coordinates", coordinates}});
-    QVariantMap data({{"type", "Feature"}, {"geometry", geometry}});
+/// Sources constructed from coordinates are passed to the map as
+/// QMapLibre features. This avoids construction of GeoJSON for each
+/// point and its parsing by the map.
+static QVariantMap nameProperties(const QString &name) {
     QVariantMap properties;
     if (!name.isEmpty())
         properties.insert("name", name);
-    data.insert("properties", properties);
-    return data;
+    return properties;
+}
+
+static QMapLibre::Feature pointFeature(const QMapLibre::Coordinate &coordinate,
+                                       const QString &name) {
+    QMapLibre::CoordinatesCollections geometry(
+        1, QMapLibre::CoordinatesCollection(1, QMapLibre::Coordinates(1, coordinate)));
+    return QMapLibre::Feature(QMapLibre::Feature::PointType, geometry, nameProperties(name));
+}
+
+static QStringList stringList(const QVariantList &list) {
+    QStringList names;
+    for (const QVariant &v : list)
+        names.append(v.canConvert<QString>() ? v.toString() : QString());
+    return names;
 }
 
 void QQuickItemMapboxGL::updateSourcePoint(const QString &sourceID, qreal latitude, qreal longitude,
                                            const QString &name) {
-    QVariantMap params({{"type", "geojson"}, {"data", pointJson(latitude, longitude, name)}});
+    QVariantMap params({{"type", "geojson"},
+                        {"data", QVariant::fromValue(pointFeature(
+                                     QMapLibre::Coordinate(latitude, longitude), name))}});
     updateSource(sourceID, params);
 }
 
 void QQuickItemMapboxGL::updateSourcePoints(const QString &sourceID,
                                             const QVariantList &coordinates,
                                             const QVariantList &names) {
-    QVariantMap feature_collection({{"type", "FeatureCollection"}});
-    QVariantList points;
+    QMapLibre::Coordinates coor;
+    int invalid = -1;
+    if (!CoordinateInput::geo(coordinates, coor, invalid)) {
+        QString err =
+            QString("Illegal point coordinates when read as QGeoCoordinate, point %1").arg(invalid);
+        setError(err);
+        return;
+    }
 
-    for (int i = 0; i < coordinates.size(); ++i) {
-        QGeoCoordinate c = coordinates[i].value<QGeoCoordinate>();
-        if (c.isValid()) {
-            QString name;
-            if (i < names.size() && names[i].canConvert<QString>())
-                name = names[i].toString();
+    setSourcePoints(sourceID, coor, stringList(names));
+}
 
-            points.append(pointJson(c.latitude(), c.longitude(), name));
-        } else {
-            QString err =
-                QString("Illegal point coordinates when read as QGeoCoordinate, point %1").arg(i);
+void QQuickItemMapboxGL::updateSourcePoints(const QString &sourceID,
+                                            const QVector<QPointF> &coordinates,
+                                            const QStringList &names) {
+    setSourcePointsLonLat(sourceID, QVariant::fromValue(coordinates), names);
+}
+
+void QQuickItemMapboxGL::updateSourcePointsArray(const QString &sourceID,
+                                                 const QVariant &coordinates,
+                                                 const QVariantList &names) {
+    setSourcePointsLonLat(sourceID, coordinates, stringList(names));
+}
+
+void QQuickItemMapboxGL::setSourcePointsLonLat(const QString &sourceID,
+                                               const QVariant &coordinates,
+                                               const QStringList &names) {
+    QMapLibre::Coordinates coor;
+    if (!CoordinateInput::lonLat(coordinates, coor)) {
+        QString err = QString("Cannot read point coordinates for source %1").arg(sourceID);
+        setError(err);
+        return;
+    }
+
+    setSourcePoints(sourceID, coor, names);
+}
+
+void QQuickItemMapboxGL::setSourcePoints(const QString &sourceID,
+                                         const QMapLibre::Coordinates &coordinates,
+                                         const QStringList &names) {
+    QVector<QMapLibre::Feature> features;
+    features.reserve(coordinates.size());
+
+    for (int i = 0; i < coordinates.size(); ++i) {
+        const QMapLibre::Coordinate &c = coordinates[i];
+        if (!CoordinateInput::valid(c.first, c.second)) {
+            QString err = QString("Illegal point coordinates, point %1").arg(i);
             setError(err);
-            qWarning() << err;
             return;
         }
+
+        features.append(pointFeature(c, i < names.size() ? names[i] : QString()));
     }
 
-    feature_collection.insert("features", points);
-    QVariantMap params({{"type", "geojson"}, {"data", feature_collection}});
+    QVariantMap params({{"type", "geojson"}, {"data", QVariant::fromValue(features)}});
     updateSource(sourceID, params);
 }
 
 void QQuickItemMapboxGL::updateSourceLine(const QString &sourceID, const QVariantList &coordinates,
                                           const QString &name) {
-    QVariantList coor;
+    QMapLibre::Coordinates coor;
+    int invalid = -1;
+    if (!CoordinateInput::geo(coordinates, coor, invalid)) {
+        QString err =
+            QString("Illegal point coordinates when read as QGeoCoordinate, line point %1")
+                .arg(invalid);
+        setError(err);
+        return;
+    }
+
+    setSourceLine(sourceID, coor, name);
+}
+
+void QQuickItemMapboxGL::updateSourceLine(const QString &sourceID,
+                                          const QVector<QPointF> &coordinates,
+                                          const QString &name) {
+    updateSourceLineArray(sourceID, QVariant::fromValue(coordinates), name);
+}
+
+void QQuickItemMapboxGL::updateSourceLineArray(const QString &sourceID, const QVariant &coordinates,
+                                               const QString &name) {
+    QMapLibre::Coordinates coor;
+    if (!CoordinateInput::lonLat(coordinates, coor)) {
+        QString err = QString("Cannot read line coordinates for source %1").arg(sourceID);
+        setError(err);
+        return;
+    }
+
+    setSourceLine(sourceID, coor, name);
+}
+
+/// Deep copy that does not share the data with the original
+static QMapLibre::Coordinates copyCoordinates(const QMapLibre::Coordinates &coordinates) {
+    QMapLibre::Coordinates copy(coordinates.size());
+    std::copy(coordinates.constBegin(), coordinates.constEnd(), copy.begin());
+    return copy;
+}
+
+void QQuickItemMapboxGL::setSourceLine(const QString &sourceID,
+                                       const QMapLibre::Coordinates &coordinates,
+                                       const QString &name) {
+    for (int i = 0; i < coordinates.size(); ++i)
+        if (!CoordinateInput::valid(coordinates[i].first, coordinates[i].second)) {
+            QString err = QString("Illegal point coordinates, line point %1").arg(i);
+            setError(err);
+            return;
+        }
+
+    m_source_clusters.remove(sourceID);
+    m_source_features.remove(sourceID);
+
+    SourceLine line{coordinates, name};
+    if (m_source_lines_simplified.contains(sourceID) && coordinates.size() >= 2)
+        simplifySourceLine(line);
+
+    submitSourceLine(sourceID, line);
+    m_source_lines.insert(sourceID, line);
+}
+
+/// Coordinates of the line are expected to be validated already
+void QQuickItemMapboxGL::submitSourceLine(const QString &sourceID, SourceLine &line) {
+    line.pending = false;
 
     // Mapbox geojson-hpp requires at least 2 points for a line. As a result, source addition or
     // update will fail unless it is imported as an empty feature - done by the point import.
     // Related issue: https://github.com/rinigus/pure-maps/issues/639
-    if (coordinates.size() < 2) {
-        QVariantList names;
-        for (int i = 0; i < coordinates.size(); ++i)
-            names.append(name);
-        updateSourcePoints(sourceID, coordinates, names);
+    if (line.coordinates.size() < 2) {
+        QVector<QMapLibre::Feature> features;
+        for (const QMapLibre::Coordinate &c : line.coordinates)
+            features.append(pointFeature(c, line.name));
+        QVariantMap params({{"type", "geojson"}, {"data", QVariant::fromValue(features)}});
+        m_sources.update(sourceID, params);
+        DATA_UPDATE;
         return;
     }
 
-    for (int i = 0; i < coordinates.size(); ++i) {
-        QGeoCoordinate c = coordinates[i].value<QGeoCoordinate>();
-        if (c.isValid())
-            coor.push_back(QVariantList({c.longitude(), c.latitude()}));
-        else {
-            QString err =
-                QString("Illegal point coordinates when read as QGeoCoordinate, line point %1")
-                    .arg(i);
+    // submitted line is a separate copy of the kept coordinates. Otherwise,
+    // the next append would detach and copy the kept coordinates while the
+    // map still holds the submitted feature. Points appended after the start
+    // of the simplifier build are submitted as they are until the next build
+    QMapLibre::Coordinates coordinates;
+    if (line.simplifier) {
+        line.zoom = simplificationZoom();
+        coordinates = line.simplifier->simplified(line.zoom);
+        for (int i = line.simplifier->coordinates().size(); i < line.coordinates.size(); ++i)
+            coordinates.append(line.coordinates[i]);
+    } else
+        coordinates = copyCoordinates(line.coordinates);
+
+    QMapLibre::CoordinatesCollections geometry(1, QMapLibre::CoordinatesCollection(1, coordinates));
+    QMapLibre::Feature feature(QMapLibre::Feature::LineStringType, geometry,
+                               nameProperties(line.name));
+
+    QVariantMap params({{"type", "geojson"}, {"data", QVariant::fromValue(feature)}});
+    m_sources.update(sourceID, params);
+    DATA_UPDATE;
+}
+
+/// Simplifier gets its own copy of the coordinates as the kept line is
+/// appended while the simplifier is built
+void QQuickItemMapboxGL::simplifySourceLine(SourceLine &line) {
+    line.building =
+        QSharedPointer<LineSimplifier>(new LineSimplifier(copyCoordinates(line.coordinates)));
+    LineSimplifier::startBuild(line.building, this, "onLineSimplified");
+}
+
+void QQuickItemMapboxGL::onLineSimplified() {
+    for (auto i = m_source_lines.begin(); i != m_source_lines.end(); ++i) {
+        if (!i->building || !i->building->ready())
+            continue;
+
+        i->simplifier = i->building;
+        i->building.clear();
+
+        // points appended during the build are covered by the next one
+        if (i->coordinates.size() > i->simplifier->coordinates().size())
+            simplifySourceLine(*i);
+
+        // pending lines are submitted by the source update timer
+        if (!i->pending)
+            submitSourceLine(i.key(), *i);
+    }
+}
+
+int QQuickItemMapboxGL::simplificationZoom() const { return int(floor(m_zoomLevel)); }
+
+void QQuickItemMapboxGL::setSourceLineSimplification(const QString &sourceID, bool enabled) {
+    if (enabled == m_source_lines_simplified.contains(sourceID))
+        return;
+
+    if (enabled)
+        m_source_lines_simplified.insert(sourceID);
+    else
+        m_source_lines_simplified.remove(sourceID);
+
+    // resubmit already set line
+    auto line = m_source_lines.find(sourceID);
+    if (line == m_source_lines.end() || line->coordinates.size() < 2)
+        return;
+
+    // simplified line is submitted when the simplifier is built
+    if (enabled) {
+        simplifySourceLine(*line);
+        return;
+    }
+
+    line->simplifier.clear();
+    line->building.clear();
+    submitSourceLine(sourceID, *line);
+}
+
+void QQuickItemMapboxGL::updateSimplifiedLines() {
+    const int zoom = simplificationZoom();
+    for (const QString &id : m_source_lines_simplified) {
+        auto line = m_source_lines.find(id);
+        if (line != m_source_lines.end() && line->simplifier && line->zoom != zoom &&
+            !line->pending)
+            submitSourceLine(id, *line);
+    }
+}
+
+void QQuickItemMapboxGL::appendSourceLine(const QString &sourceID,
+                                          const QVariantList &coordinates) {
+    QMapLibre::Coordinates coor;
+    int invalid = -1;
+    if (!CoordinateInput::geo(coordinates, coor, invalid)) {
+        QString err =
+            QString("Illegal point coordinates when read as QGeoCoordinate, line point %1")
+                .arg(invalid);
+        setError(err);
+        return;
+    }
+
+    appendSourceLineCoordinates(sourceID, coor);
+}
+
+void QQuickItemMapboxGL::appendSourceLineArray(const QString &sourceID,
+                                               const QVariant &coordinates) {
+    QMapLibre::Coordinates coor;
+    if (!CoordinateInput::lonLat(coordinates, coor)) {
+        QString err = QString("Cannot read line coordinates for source %1").arg(sourceID);
+        setError(err);
+        return;
+    }
+
+    appendSourceLineCoordinates(sourceID, coor);
+}
+
+void QQuickItemMapboxGL::appendSourceLineCoordinates(const QString &sourceID,
+                                                     const QMapLibre::Coordinates &coordinates) {
+    for (int i = 0; i < coordinates.size(); ++i)
+        if (!CoordinateInput::valid(coordinates[i].first, coordinates[i].second)) {
+            QString err = QString("Illegal point coordinates, line point %1").arg(i);
+            setError(err);
+            return;
+        }
+
+    if (coordinates.isEmpty())
+        return;
+
+    auto line = m_source_lines.find(sourceID);
+    if (line == m_source_lines.end()) {
+        if (m_sources.contains(sourceID)) {
+            QString err = QString("Cannot append coordinates to source %1 that is not a line")
+                              .arg(sourceID);
             setError(err);
-            qWarning() << err;
             return;
         }
+        line = m_source_lines.insert(sourceID, SourceLine());
     }
 
-    QVariantMap geometry({{"type", "LineString"}, {"coordinates", coor}});
-    QVariantMap properties;
-    if (!name.isEmpty())
-        properties.insert("name", name);
-    QVariantMap data({{"type", "Feature"}, {"properties", properties}, {"geometry", geometry}});
+    // only the appended points are validated, the kept ones were checked before
+    line->coordinates.append(coordinates);
+    line->pending = true;
 
-    QVariantMap params({{"type", "geojson"}, {"data", data}});
-    updateSource(sourceID, params);
+    scheduleSourceUpdates();
+}
+
+/// Feature tables
+
+void QQuickItemMapboxGL::upsertSourceFeatures(const QString &sourceID, const QVariantList &ids,
+                                              const QVariant &coordinates,
+                                              const QVariantList &properties) {
+    QMapLibre::Coordinates coor;
+    if (!CoordinateInput::any(coordinates, coor) || coor.size() != ids.size() ||
+        (!properties.isEmpty() && properties.size() != ids.size())) {
+        QString err = QString("Cannot read features for source %1").arg(sourceID);
+        setError(err);
+        return;
+    }
+
+    for (int i = 0; i < coor.size(); ++i)
+        if (!CoordinateInput::valid(coor[i].first, coor[i].second)) {
+            QString err = QString("Illegal point coordinates, feature %1").arg(i);
+            setError(err);
+            return;
+        }
+
+    m_source_lines.remove(sourceID);
+    m_source_clusters.remove(sourceID);
+
+    SourceFeatures &table = m_source_features[sourceID];
+    for (int i = 0; i < ids.size(); ++i) {
+        const QString key = ids[i].toString();
+        QMapLibre::CoordinatesCollections geometry(
+            1, QMapLibre::CoordinatesCollection(1, QMapLibre::Coordinates(1, coor[i])));
+        auto index = table.index.constFind(key);
+        if (index == table.index.constEnd()) {
+            table.index.insert(key, table.features.size());
+            table.features.append(QMapLibre::Feature(
+                QMapLibre::Feature::PointType, geometry,
+                properties.isEmpty() ? QVariantMap() : properties[i].toMap(), ids[i]));
+        } else {
+            QMapLibre::Feature &feature = table.features[index.value()];
+            feature.geometry = geometry;
+            if (!properties.isEmpty())
+                feature.properties = properties[i].toMap();
+        }
+    }
+
+    table.pending = true;
+    scheduleSourceUpdates();
+}
+
+void QQuickItemMapboxGL::removeSourceFeatures(const QString &sourceID, const QVariantList &ids) {
+    auto table = m_source_features.find(sourceID);
+    if (table == m_source_features.end())
+        return;
+
+    for (const QVariant &id : ids) {
+        auto index = table->index.find(id.toString());
+        if (index == table->index.end())
+            continue;
+
+        // move the last feature into the place of the removed one
+        const int i = index.value();
+        const int last = table->features.size() - 1;
+        table->index.erase(index);
+        if (i != last) {
+            table->features[i] = table->features[last];
+            table->index[table->features[i].id.toString()] = i;
+        }
+        table->features.removeLast();
+        table->pending = true;
+    }
+
+    if (table->pending)
+        scheduleSourceUpdates();
+}
+
+/// Clustered points
+
+void QQuickItemMapboxGL::addSourceClusteredPoints(const QString &sourceID,
+                                                  const QVariant &coordinates,
+                                                  const QVariantList &names) {
+    updateSourceClusteredPoints(sourceID, coordinates, names);
+}
+
+void QQuickItemMapboxGL::updateSourceClusteredPoints(const QString &sourceID,
+                                                     const QVariant &coordinates,
+                                                     const QVariantList &names) {
+    QMapLibre::Coordinates coor;
+    if (!CoordinateInput::any(coordinates, coor)) {
+        QString err = QString("Cannot read point coordinates for source %1").arg(sourceID);
+        setError(err);
+        return;
+    }
+
+    for (int i = 0; i < coor.size(); ++i)
+        if (!CoordinateInput::valid(coor[i].first, coor[i].second)) {
+            QString err = QString("Illegal point coordinates, point %1").arg(i);
+            setError(err);
+            return;
+        }
+
+    QSharedPointer<PointCluster> cluster(new PointCluster(coor, stringList(names)));
+    PointCluster::startBuild(cluster, this, "update");
+
+    // clusters of the earlier points are shown until the new index is built
+    auto source = m_source_clusters.find(sourceID);
+    if (source != m_source_clusters.end()) {
+        source->building = cluster;
+        return;
+    }
+
+    // new source is kept empty until the index is built to allow adding layers using it
+    updateSource(sourceID, {{"type", "geojson"},
+                            {"data", QVariant::fromValue(QVector<QMapLibre::Feature>())}});
+    m_source_clusters[sourceID].cluster = cluster;
+}
+
+QVariantList QQuickItemMapboxGL::clusterLeaves(const QString &sourceID, int clusterId, int limit,
+                                               int offset) const {
+    QVariantList result;
+    auto source = m_source_clusters.constFind(sourceID);
+    if (source == m_source_clusters.constEnd() || !source->cluster->ready())
+        return result;
+
+    const PointCluster &cluster = *source->cluster;
+    for (int i : cluster.leaves(clusterId, limit, offset)) {
+        const QMapLibre::Coordinate &c = cluster.coordinates()[i];
+        QVariantMap leaf;
+        leaf.insert("index", i);
+        leaf.insert("coordinate", QVariant::fromValue(QGeoCoordinate(c.first, c.second)));
+        if (i < cluster.names().size())
+            leaf.insert("name", cluster.names()[i]);
+        result.append(leaf);
+    }
+    return result;
+}
+
+int QQuickItemMapboxGL::clusterExpansionZoom(const QString &sourceID, int clusterId) const {
+    auto source = m_source_clusters.constFind(sourceID);
+    if (source == m_source_clusters.constEnd())
+        return -1;
+    return source->cluster->expansionZoom(clusterId);
+}
+
+/// Largest angle from nadir, in degrees, of the rays of pixels used to find
+/// the visible area of clustered sources. Rays of pixels above the horizon
+/// do not reach the map and the ones close to it reach far away areas
+static constexpr double clusterMaxRayAngle = 75.0;
+
+/// Top of the viewport used to find the visible area of the pitched map.
+/// Only pixels with rays at most clusterMaxRayAngle from nadir are used.
+/// Vertical field of view of the camera is the one used by MapLibre
+static double visibleTop(double height, double pitch) {
+    if (pitch <= 0)
+        return 0;
+    if (pitch >= clusterMaxRayAngle)
+        return height / 2;
+
+    // distance of the camera from the viewport plane in pixels
+    const double distance = height / 2 / tan(mbgl::util::DEFAULT_FOV / 2);
+    const double top = height / 2 - distance * tan((clusterMaxRayAngle - pitch) * M_PI / 180.0);
+    return qBound(0.0, top, height / 2);
+}
+
+void QQuickItemMapboxGL::updateClusteredSources(QMapLibre::Map *map, BaseNode *node) {
+    // visible area with longitudes unwrapped relative to the center. When
+    // the map is pitched, the top of the viewport is clamped below horizon
+    const double lon0 = map->coordinate().second;
+    const double inf = std::numeric_limits<double>::infinity();
+    double west = inf, east = -inf, south = inf, north = -inf;
+    const double top = visibleTop(node->height(), map->pitch());
+    const QPointF corners[] = {QPointF(0, top), QPointF(node->width(), top),
+                               QPointF(0, node->height()), QPointF(node->width(), node->height())};
+    for (const QPointF &p : corners) {
+        const QMapLibre::Coordinate c = map->coordinateForPixel(p);
+        const double lon = c.second - 360.0 * floor((c.second - lon0 + 180.0) / 360.0);
+        west = qMin(west, lon);
+        east = qMax(east, lon);
+        south = qMin(south, c.first);
+        north = qMax(north, c.first);
+    }
+
+    const QRectF visible(west, south, east - west, north - south);
+    const int zoom = int(floor(map->zoom()));
+
+    for (auto i = m_source_clusters.begin(); i != m_source_clusters.end(); ++i) {
+        ClusteredSource &source = i.value();
+        if (source.building && source.building->ready()) {
+            source.cluster = source.building;
+            source.building.clear();
+            source.zoom = -1;
+        }
+
+        if (!source.cluster->ready() ||
+            (source.zoom == zoom && source.bounds.contains(visible)))
+            continue;
+
+        // publish area larger than visible to avoid updates on small pans
+        source.zoom = zoom;
+        source.bounds = visible.adjusted(-visible.width() / 2, -visible.height() / 2,
+                                         visible.width() / 2, visible.height() / 2);
+        QVector<QMapLibre::Feature> features =
+            source.cluster->features(source.bounds.left(), source.bounds.top(),
+                                     source.bounds.right(), source.bounds.bottom(), zoom);
+        m_sources.update(i.key(), {{"type", "geojson"}, {"data", QVariant::fromValue(features)}});
+        m_syncState |= DataNeedsSync;
+    }
+}
+
+/// Submission of lines and features collected by append and upsert methods
+
+void QQuickItemMapboxGL::scheduleSourceUpdates() {
+    if (m_source_update_timer.interval() == 0)
+        submitSourceUpdates();
+    else if (!m_source_update_timer.isActive())
+        m_source_update_timer.start();
+}
+
+void QQuickItemMapboxGL::submitSourceUpdates() {
+    m_source_update_timer.stop();
+
+    for (auto i = m_source_lines.begin(); i != m_source_lines.end(); ++i) {
+        if (!i->pending)
+            continue;
+
+        // while the simplifier is built, appended points are submitted as they are
+        if (m_source_lines_simplified.contains(i.key()) && i->coordinates.size() >= 2 &&
+            !i->building)
+            simplifySourceLine(*i);
+        submitSourceLine(i.key(), *i);
+    }
+
+    for (auto i = m_source_features.begin(); i != m_source_features.end(); ++i) {
+        if (!i->pending)
+            continue;
+
+        // features are shared with the source asset until the table is modified
+        QVariantMap params({{"type", "geojson"}, {"data", QVariant::fromValue(i->features)}});
+        m_sources.update(i.key(), params);
+        i->pending = false;
+        DATA_UPDATE;
+    }
 }
 
 void QQuickItemMapboxGL::removeSource(const QString &sourceID) {
+    m_source_lines.remove(sourceID);
+    m_source_clusters.remove(sourceID);
+    m_source_features.remove(sourceID);
+    m_source_lines_simplified.remove(sourceID);
     m_sources.remove(sourceID);
     DATA_UPDATE;
 }
@@ -714,6 +1515,8 @@ void QQuickItemMapboxGL::addLayer(const QString &id, const QVariantMap &params,
 
 void QQuickItemMapboxGL::removeLayer(const QString &id) {
     m_layers.remove(id);
+    m_layout_properties.remove_layer(id);
+    m_paint_properties.remove_layer(id);
     DATA_UPDATE;
 }
 
@@ -788,11 +1591,182 @@ void QQuickItemMapboxGL::setPaintPropertyList(const QString &layer, const QStrin
     DATA_UPDATE;
 }
 
+/// Queries
+void QQuickItemMapboxGL::queueQuery(const Query &query) {
+    m_queries.append(query);
+    m_syncState |= QueriesNeedSync;
+    update();
+}
+
+void QQuickItemMapboxGL::runQueries(BaseNode *node) {
+    // feature queries repeated within a frame are answered once, for the
+    // last of them with the same request id
+    QSet<QString> answered;
+    for (int i = m_queries.size() - 1; i >= 0; --i) {
+        const Query &q = m_queries[i];
+        if (q.type != Query::FeaturesAt && q.type != Query::SourceFeatures)
+            continue;
+        const QString key = QString::number(q.type) + QLatin1Char(':') + q.id + QLatin1Char(':') +
+                            q.tag.toString();
+        if (answered.contains(key))
+            m_queries[i].type = Query::Skipped;
+        else
+            answered.insert(key);
+    }
+
+    // parsed features of removed sources are dropped
+    if (!answered.isEmpty()) {
+        QSet<QString> sourceIDs;
+        for (const QMapLibreSync::Asset &source : m_sources.assets())
+            sourceIDs.insert(source.id);
+        m_feature_cache.retain(sourceIDs);
+    }
+
+    for (const Query &q : m_queries) {
+        switch (q.type) {
+        case Query::SourceExists:
+            node->querySourceExists(q.id);
+            break;
+        case Query::LayerExists:
+            node->queryLayerExists(q.id);
+            break;
+        case Query::CoordinateForPixel:
+            node->queryCoordinateForPixel(q.pixel, q.tag);
+            break;
+        case Query::CoordinatesForPixels:
+            node->queryCoordinatesForPixels(q.pixels.value<QVector<QPointF>>(), q.tag);
+            break;
+        case Query::FeaturesAt:
+            findFeaturesAt(node, q.pixels, q.layers, q.tag);
+            break;
+        case Query::SourceFeatures:
+            emit replySourceFeatures(q.id, sourceFeatures(q.id), q.tag);
+            break;
+        case Query::MapImage:
+            m_image_requests.append({q.tag, q.scale, q.fileName});
+            break;
+        case Query::Skipped:
+            break;
+        }
+    }
+
+    m_stats_queries += m_queries.size();
+    m_queries.clear();
+}
+
+void QQuickItemMapboxGL::setRenderTime(qint64 time) {
+    m_render_time = time;
+    m_render_time_average =
+        m_render_time_average == 0 ? time : (7 * m_render_time_average + time) / 8;
+}
+
+/// Map images are read from the shown frame without waiting for GPU,
+/// also while the next frame is rendered by the render thread. Finished
+/// reads are collected on the following frames and flipped, scaled, and
+/// saved in the thread pool
+void QQuickItemMapboxGL::readMapImages(BaseNode *node) {
+    for (const MapImageReader::Request &request : m_image_requests)
+        if (!node->readImage(request)) {
+            qWarning() << "queryMapImage: map image cannot be read";
+            emit replyMapImage(QImage(), QString(), request.requestId);
+        }
+    m_image_requests.clear();
+
+    for (const MapImageReader::Image &image : node->takeImages())
+        MapImageReader::finish(image, this, "replyMapImage");
+
+    // pending reads are checked on the next frame
+    if (node->imagesPending())
+        update();
+}
+
+/// Layers are resolved here as the styling is tracked by the item. Only
+/// the visible layers with GeoJSON sources are queried, from the top, in
+/// the order they were added. Features are then found by the node using
+/// the camera of the frame
+void QQuickItemMapboxGL::findFeaturesAt(BaseNode *node, const QVariant &area,
+                                        const QStringList &layerIds, const QVariant &requestId) {
+    QRectF rect;
+    if (area.userType() == QMetaType::QPointF || area.userType() == QMetaType::QPoint)
+        rect = QRectF(area.toPointF(), QSizeF());
+    else if (area.userType() == QMetaType::QRectF || area.userType() == QMetaType::QRect)
+        rect = area.toRectF();
+    else {
+        emit replyFeaturesAt(QVariantList(), requestId,
+                             "queryFeaturesAt: area has to be given as point or rect");
+        return;
+    }
+
+    const double zoom = node->map()->zoom();
+    QHash<QString, QSize> icons;
+    QVector<FeatureQuery::Layer> layers;
+    for (const QMapLibreSync::Asset &layer : m_layers.assets()) {
+        if (!layerIds.isEmpty() && !layerIds.contains(layer.id))
+            continue;
+
+        QVariantMap paint = layer.params.value("paint").toMap();
+        QVariantMap layout = layer.params.value("layout").toMap();
+        m_paint_properties.insertValues(layer.id, paint);
+        m_layout_properties.insertValues(layer.id, layout);
+
+        const double minzoom = layer.params.value("minzoom", 0.0).toDouble();
+        const double maxzoom = layer.params.value("maxzoom", 24.0).toDouble();
+        if (zoom < minzoom || zoom >= maxzoom || layout.value("visibility").toString() == "none")
+            continue;
+
+        const QString sourceID = layer.params.value("source").toString();
+        const QMapLibreSync::Asset *source = m_sources.assets().find(sourceID);
+        if (!source || source->params.value("type").toString() != "geojson")
+            continue;
+
+        const QString type = layer.params.value("type").toString();
+        if (type == "symbol" && icons.isEmpty())
+            for (const QMapLibreSync::Image &image : m_images.images())
+                icons.insert(image.id, image.image.size());
+
+        FeatureQuery::Layer l;
+        QString error;
+        l.filter = FeatureFilter(layer.params.value("filter"));
+        if (!l.filter.isValid())
+            error = l.filter.error();
+        else
+            FeatureQuery::tolerance(type, paint, layout, icons, l.tolerance, error);
+        if (!error.isEmpty()) {
+            emit replyFeaturesAt(QVariantList(), requestId,
+                                 QString("queryFeaturesAt: layer %1: %2").arg(layer.id, error));
+            return;
+        }
+
+        l.id = layer.id;
+        l.source = sourceID;
+        l.type = type;
+        l.features = m_feature_cache.features(sourceID, source->params.value("data"));
+        layers.prepend(l);
+    }
+
+    node->queryFeaturesAt(rect, layers, requestId);
+}
+
+QVariantList QQuickItemMapboxGL::sourceFeatures(const QString &sourceID) const {
+    QVariantList result;
+    const QMapLibreSync::Asset *source = m_sources.assets().find(sourceID);
+    if (!source || source->params.value("type").toString() != "geojson")
+        return result;
+    for (const QMapLibre::Feature &feature :
+         m_feature_cache.features(sourceID, source->params.value("data"))) {
+        QVariantMap f = FeatureQuery::toVariant(feature);
+        f.insert("source", sourceID);
+        result.append(f);
+    }
+    return result;
+}
+
 /// Location tracking
 QQuickItemMapboxGL::LocationTracker::LocationTracker(const QGeoCoordinate &location)
     : m_location(location), m_last_visible(false) {}
 
 bool QQuickItemMapboxGL::LocationTracker::set_position(const QPoint &p, const QSize &sz) {
+    m_dirty = false;
     bool visible = (p.x() >= 0 && p.y() >= 0 && p.x() <= sz.width() && p.y() <= sz.height());
 
     if (!visible && !m_last_visible) {
@@ -816,15 +1790,21 @@ bool QQuickItemMapboxGL::LocationTracker::set_position(const QPoint &p, const QS
 
 void QQuickItemMapboxGL::trackLocation(const QString &id, const QGeoCoordinate &location) {
     m_location_tracker[id] = LocationTracker(location);
+    m_tracker_model->setTracker(id, location);
     update();
 }
 
 void QQuickItemMapboxGL::removeLocationTracking(const QString &id) {
-    if (m_location_tracker.remove(id) > 0)
+    if (m_location_tracker.remove(id) > 0) {
+        m_tracker_model->removeTracker(id);
         emit locationTrackingRemoved(id);
+    }
 }
 
-void QQuickItemMapboxGL::removeAllLocationTracking() { m_location_tracker.clear(); }
+void QQuickItemMapboxGL::removeAllLocationTracking() {
+    m_location_tracker.clear();
+    m_tracker_model->clear();
+}
 
 /// Cache clearing
 void QQuickItemMapboxGL::clearCache() {
@@ -851,6 +1831,14 @@ void QQuickItemMapboxGL::clearCache() {
 
 /// Update map
 QSGNode *QQuickItemMapboxGL::updatePaintNode(QSGNode *node, UpdatePaintNodeData *) {
+    // map is rendered only if camera, style, or data are changed or
+    // the map has requested rendering. Queries and the gesture state
+    // do not change the rendered map
+    // pending data changes lead to rendering only when they are applied
+    bool renderNeeded =
+        (m_syncState & ~(QueriesNeedSync | GestureInProgressNeedsSync | DataNeedsSync));
+    const bool queriesAsked = (m_syncState & QueriesNeedSync);
+
     QSize sz(width(), height());
     QMapLibre::Map *map = nullptr;
     m_first_init_done = true;
@@ -871,16 +1859,25 @@ QSGNode *QQuickItemMapboxGL::updatePaintNode(QSGNode *node, UpdatePaintNodeData
 
         m_block_data_until_loaded = true;
         m_finalize_data_loading = false; // set to true only if data is loaded on full style load
+        m_render_scale = 1;
 
         /////////////////////////////////////////////////////
         /// create node and connect all queries
         {
-            BaseTextureNode *sgn =
+            BaseTextureNode *sgn = nullptr;
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+            if (m_render_threaded)
+                sgn = new ThreadedTextureNode(m_settings, sz, m_devicePixelRatio, m_pixelRatio,
+                                              this, m_render_surface);
+            else
+#endif
+                sgn =
 #if IS_QT5
-                new MLNQT5::TextureNode(m_settings, sz, m_devicePixelRatio, m_pixelRatio, this);
+                    new MLNQT5::TextureNode(m_settings, sz, m_devicePixelRatio, m_pixelRatio,
+                                            this);
 #elif defined(MLN_RENDER_BACKEND_OPENGL)
-                new MLNQT6::TextureNodeOpenGL(m_settings, sz, m_devicePixelRatio, m_pixelRatio,
-                                              this);
+                    new MLNQT6::TextureNodeOpenGL(m_settings, sz, m_devicePixelRatio,
+                                                  m_pixelRatio, this);
 #endif
             n = sgn;
             node = sgn;
@@ -894,32 +1891,81 @@ QSGNode *QQuickItemMapboxGL::updatePaintNode(QSGNode *node, UpdatePaintNodeData
 
         map = n->map();
 
+        // queries are run by runQueries, replies are delivered to the GUI thread
         connect(n, &BaseNode::replySourceExists, this, &QQuickItemMapboxGL::replySourceExists,
                 Qt::QueuedConnection);
-        connect(this, &QQuickItemMapboxGL::querySourceExists, n, &BaseNode::querySourceExists,
-                Qt::QueuedConnection);
-
         connect(n, &BaseNode::replyLayerExists, this, &QQuickItemMapboxGL::replyLayerExists,
                 Qt::QueuedConnection);
-        connect(this, &QQuickItemMapboxGL::queryLayerExists, n, &BaseNode::queryLayerExists,
-                Qt::QueuedConnection);
-
         connect(n, &BaseNode::replyCoordinateForPixel, this,
                 &QQuickItemMapboxGL::replyCoordinateForPixel, Qt::QueuedConnection);
-        connect(this, &QQuickItemMapboxGL::queryCoordinateForPixel, n,
-                &BaseNode::queryCoordinateForPixel, Qt::QueuedConnection);
+        connect(n, &BaseNode::replyCoordinatesForPixels, this,
+                &QQuickItemMapboxGL::replyCoordinatesForPixels, Qt::QueuedConnection);
+        connect(n, &BaseNode::replyFeaturesAt, this, &QQuickItemMapboxGL::replyFeaturesAt,
+                Qt::QueuedConnection);
+
+        // map rendered by the scene graph is finished on GPU when the frame is swapped
+        m_render_start = -1;
+        if (window())
+            connect(
+                window(), &QQuickWindow::frameSwapped, n,
+                [this]() {
+                    if (m_render_start < 0)
+                        return;
+                    setRenderTime(m_clock.nsecsElapsed() - m_render_start);
+                    m_render_start = -1;
+                },
+                Qt::DirectConnection);
 
         /////////////////////////////////////////////////////
         /// connect map changed and failure signals
         connect(map, &QMapLibre::Map::mapChanged, this, &QQuickItemMapboxGL::onMapChanged,
                 Qt::QueuedConnection);
+        connect(map, &QMapLibre::Map::needsRendering, this,
+                &QQuickItemMapboxGL::onLoadingProgress, Qt::QueuedConnection);
         connect(map, &QMapLibre::Map::mapLoadingFailed, this,
                 &QQuickItemMapboxGL::onMapLoadingFailed, Qt::QueuedConnection);
-    } else
+    } else {
         map = n->map();
 
+        // map rendered in a separate thread is changed only between its
+        // frames. Sync is done after the frame is finished
+        if (n->busy()) {
+            m_stats_late_frames++;
+            if (n->present(window()))
+                node->markDirty(QSGNode::DirtyMaterial);
+            readMapImages(n);
+            return node;
+        }
+
+        // changes leading to rendering, such as camera movements, are
+        // accumulated until the next paced frame
+        const int frameRate = (m_gestureInProgress || m_idle_frame_rate <= 0)
+                                  ? m_maximum_frame_rate
+                                  : m_idle_frame_rate;
+        const bool changed =
+            (m_syncState & ~(QueriesNeedSync | GestureInProgressNeedsSync)) || n->dirty();
+        if (frameRate > 0 && changed && m_last_render >= 0) {
+            // frame is rendered if its earliest time is before the next
+            // vsync, assumed to be in the middle of the refresh interval
+            const QScreen *screen = window() ? window()->screen() : nullptr;
+            const qreal refreshRate = screen ? screen->refreshRate() : 60;
+            const qint64 tolerance = qRound(500 / qMax(refreshRate, qreal(1)));
+            const qint64 wait = 1000 / frameRate - (m_clock.elapsed() - m_last_render);
+            if (wait > tolerance) {
+                m_stats_coalesced_frames++;
+                QMetaObject::invokeMethod(&m_frame_timer, "start", Qt::QueuedConnection,
+                                          Q_ARG(int, int(wait)));
+                if (n->present(window()))
+                    node->markDirty(QSGNode::DirtyMaterial);
+                readMapImages(n);
+                return node;
+            }
+        }
+    }
+
     if (sz != m_last_size || m_syncState & PixelRatioNeedsSync) {
         n->resize(sz, m_pixelRatio);
+        renderNeeded = true;
         m_syncState |= MarginsNeedSync;
         m_last_size = sz;
     }
@@ -935,12 +1981,21 @@ QSGNode *QQuickItemMapboxGL::updatePaintNode(QSGNode *node, UpdatePaintNodeData
             m_syncState |= FitViewCenterNeedsSync;
     }
 
+    bool fitRefineNeeded = false;
     if (m_syncState & FitViewNeedsSync) {
-        QMapLibre::CoordinateZoom cz = map->coordinateZoomForBounds(m_fit_sw, m_fit_ne);
-        m_fit_center = QGeoCoordinate(cz.first.first, cz.first.second);
-        m_fit_zoomLevel = cz.second;
-        setCenter(m_fit_center);
-        setZoomLevel(m_fit_zoomLevel);
+        if (m_fit_refine > 0 && m_projection.isValid())
+            refineFitView();
+        else {
+            QMapLibre::CoordinateZoom cz = map->coordinateZoomForBounds(m_fit_sw, m_fit_ne);
+            m_fit_center = QGeoCoordinate(cz.first.first, cz.first.second);
+            m_fit_zoomLevel = cz.second;
+            setCenter(m_fit_center);
+            setZoomLevel(m_fit_zoomLevel);
+
+            // fit of the bounds ignores bearing and pitch, refined on the next frames
+            m_fit_refine = (m_bearing != 0 || m_pitch != 0) ? maxFitRefinements : 0;
+        }
+        fitRefineNeeded = (m_fit_refine > 0);
     }
 
     if (m_syncState & FitViewCenterNeedsSync) {
@@ -990,23 +2045,81 @@ QSGNode *QQuickItemMapboxGL::updatePaintNode(QSGNode *node, UpdatePaintNodeData
             map->setStyleJson(m_styleJson);
     }
 
+    int deferredSync = NothingNeedsSync;
+
+    if (fitRefineNeeded) {
+        deferredSync |= FitViewNeedsSync;
+        update();
+    }
+
+    if (!m_source_clusters.isEmpty())
+        updateClusteredSources(map, n);
+
     if (!m_block_data_until_loaded && m_syncState & DataNeedsSetupSync) {
-        // setup new map
-        m_sources.setup(map);
-        m_layers.setup(map);
-        m_images.setup(map);
-        m_layout_properties.setup(map);
-        m_paint_properties.setup(map);
+        // setup new map: assets are replayed below in the order of
+        // their dependencies, possibly over several frames
+        m_sources.setup();
+        m_images.setup();
+        m_layers.setup();
+        m_layout_properties.setup();
+        m_paint_properties.setup();
+        m_data_replay = true;
     }
 
-    if (!m_block_data_until_loaded && m_syncState & DataNeedsSync) {
-        m_sources.apply(map);
-        m_layers.apply(map);
-        m_images.apply(map);
-        m_layout_properties.apply(map);
-        m_paint_properties.apply(map);
+    // pending data is applied when the batch of updates is committed
+    const bool dataApply =
+        !m_block_data_until_loaded && m_update_depth == 0 && m_syncState & DataNeedsSync;
+
+    if (!m_block_data_until_loaded && (m_data_replay || dataApply)) {
+        QElapsedTimer dataTimer;
+        dataTimer.start();
+
+        // sources are added before layers using them and images
+        // before symbol layers referencing them
+        QMapLibreSync::Budget budget(m_dataApplyBudget);
+        bool done = m_sources.replay(map, budget) && m_images.replay(map, budget) &&
+                    m_layers.replay(map, budget) && m_layout_properties.replay(map, budget) &&
+                    m_paint_properties.replay(map, budget);
+        const bool replayed = done;
+
+        if (done && dataApply) {
+            done = m_sources.apply(map, budget) && m_images.apply(map, budget) &&
+                   m_layers.apply(map, budget) && m_layout_properties.apply(map, budget) &&
+                   m_paint_properties.apply(map, budget);
+            m_stats_data_conversion_time = m_sources.conversion_time();
+        }
+
+        m_stats_data_sync_time = dataTimer.nsecsElapsed();
+        m_stats_data_sync_time_max = qMax(m_stats_data_sync_time_max, m_stats_data_sync_time);
+
+        // while the backlog is applied over several frames, the map is
+        // rendered only if it requests it. Full render follows when done
+        if (done && budget.taken() > 0)
+            renderNeeded = true;
+
+        if (!done) {
+            // continue on the next frame. Data converted in the thread pool
+            // requests the update when the conversion is finished
+            if (dataApply)
+                deferredSync |= DataNeedsSync;
+            if (!m_sources.converting())
+                update();
+        }
+
+        if (replayed && m_data_replay) {
+            m_data_replay = false;
+            m_overlays_ready_pending = true;
+        }
+
+        if (done && m_overlays_ready_pending) {
+            m_overlays_ready_pending = false;
+            emit overlaysReady();
+        }
     }
 
+    if (!m_queries.isEmpty())
+        runQueries(n);
+
     // check if style changed
     if (m_syncState & DataNeedsSetupSync) {
         QString style = map->styleJson();
@@ -1017,25 +2130,34 @@ QSGNode *QQuickItemMapboxGL::updatePaintNode(QSGNode *node, UpdatePaintNodeData
     }
 
     // settings done
-    m_syncState = NothingNeedsSync;
+    m_syncState = deferredSync;
 
     // render the map and trigger the timer if the map is not loaded fully
     bool loaded = map->isFullyLoaded();
-    n->render(window());
-    node->markDirty(QSGNode::DirtyMaterial);
-
-    // check if we can add user-added sources, layers ...
-    // its probably not needed here since the condition should be reached
-    // earlier in onMapChanged slot. keeping the check here for safety
-    if (loaded && (m_block_data_until_loaded || m_finalize_data_loading)) {
-        m_syncState |= DataNeedsSetupSync;
-        m_syncState |= DataNeedsSync;
-        m_block_data_until_loaded = false;
-        m_finalize_data_loading = false;
-        update();
+    // resolution is lowered during gestures and on slow frames. Full
+    // resolution is restored when the map is idle
+    if (m_adaptive_resolution || m_render_scale < 1) {
+        const bool idle = !renderNeeded && !n->dirty();
+        qreal scale = m_render_scale; // kept while the map is changing
+        if (!m_adaptive_resolution)
+            scale = 1;
+        else if (m_gestureInProgress)
+            scale = m_minimum_resolution_scale;
+        else if (idle)
+            scale = 1;
+        else if (m_target_frame_time > 0 && m_render_time > m_target_frame_time * 1000000LL)
+            scale = qMax(m_minimum_resolution_scale, m_render_scale - 0.1);
+
+        if (scale != m_render_scale) {
+            m_render_scale = scale;
+            n->setRenderScale(scale);
+            renderNeeded = true;
+        }
     }
 
-    // check the variables that are tracked on the map
+    // check the variables that are tracked on the map. The camera is read
+    // before the frame is started as the map rendered in a separate thread
+    // is not accessed until the frame is finished
 
     { // metersPerPixel
         const double tol =
@@ -1061,15 +2183,104 @@ QSGNode *QQuickItemMapboxGL::updatePaintNode(QSGNode *node, UpdatePaintNodeData
         }
     }
 
-    for (QHash<QString, LocationTracker>::iterator i = m_location_tracker.begin();
-         i != m_location_tracker.end(); ++i) {
-        LocationTracker &tracker = i.value();
-        QPointF pf = map->pixelForCoordinate(
-            {tracker.coordinate().latitude(), tracker.coordinate().longitude()});
-        pf /= n->mapToQtPixelRatio();
-        QPoint p(pf.x(), pf.y());
-        if (tracker.set_position(p, sz))
-            emit locationChanged(i.key(), tracker.visible(), tracker.position());
+    { // location trackers are projected for the new camera or when they are new
+        QElapsedTimer trackerTimer;
+        trackerTimer.start();
+
+        CameraState camera;
+        camera.center = map->coordinate();
+        camera.zoom = map->zoom();
+        camera.bearing = map->bearing();
+        camera.pitch = map->pitch();
+        camera.margins = map->margins();
+        camera.size = sz;
+        camera.pixelRatio = n->mapToQtPixelRatio();
+        const bool cameraChanged = (camera != m_location_tracker_camera);
+        if (cameraChanged) {
+            m_location_tracker_camera = camera;
+            m_projection = Projection::fromMap(map, n->mapToQtPixelRatio());
+            m_projection_snapshot.publish(m_projection);
+        }
+
+        QVector<QHash<QString, LocationTracker>::iterator> trackers;
+        QMapLibre::Coordinates coordinates;
+        for (QHash<QString, LocationTracker>::iterator i = m_location_tracker.begin();
+             i != m_location_tracker.end(); ++i) {
+            const LocationTracker &tracker = i.value();
+            if (!cameraChanged && !tracker.dirty())
+                continue;
+            trackers.append(i);
+            coordinates.append({tracker.coordinate().latitude(), tracker.coordinate().longitude()});
+        }
+
+        // all trackers are projected in one batch unless the map has to be asked directly
+        QVector<QPointF> pixels(coordinates.size());
+        if (m_projection.isValid())
+            m_projection.project(coordinates.constData(), pixels.data(), coordinates.size());
+        else
+            for (int k = 0; k < coordinates.size(); ++k)
+                pixels[k] = map->pixelForCoordinate(coordinates[k]) / n->mapToQtPixelRatio();
+
+        for (int k = 0; k < trackers.size(); ++k) {
+            LocationTracker &tracker = trackers[k].value();
+            QPoint p(pixels[k].x(), pixels[k].y());
+            if (tracker.set_position(p, sz)) {
+                m_tracker_model->setPosition(trackers[k].key(), tracker.position(),
+                                             tracker.visible());
+                if (m_emit_location_changed)
+                    emit locationChanged(trackers[k].key(), tracker.visible(), tracker.position());
+            }
+        }
+
+        // model is updated in the GUI thread once per frame
+        m_tracker_model->postFlush();
+
+        m_stats_tracker_update_time = trackerTimer.nsecsElapsed();
+    }
+
+    if (!renderNeeded && !n->dirty() && loaded) {
+        m_stats_skipped_frames++;
+        if (queriesAsked) {
+            m_stats_query_frames++;
+            m_stats_query_time_saved += m_render_time_average;
+        }
+    } else {
+        // render() covers only the submission of the frame. Rendering time
+        // is measured by the render thread or, for the map rendered by the
+        // scene graph, until the frame is swapped
+        n->setDirty(false);
+        if (n->frameTime() < 0)
+            m_render_start = m_clock.nsecsElapsed();
+        n->render(window());
+        node->markDirty(QSGNode::DirtyMaterial);
+        if (n->frameTime() >= 0)
+            setRenderTime(n->frameTime());
+        m_last_render = m_clock.elapsed();
+        m_stats_rendered_frames++;
+
+        // check on the next update whether full resolution can be restored
+        if (m_render_scale < 1) {
+            m_stats_reduced_frames++;
+            update();
+        }
+    }
+
+    // show the frame finished by the render thread
+    if (n->present(window()))
+        node->markDirty(QSGNode::DirtyMaterial);
+    readMapImages(n);
+    m_stats_dropped_frames = n->droppedFrames();
+    m_stats_fbo_allocations = n->fboAllocations();
+
+    // check if we can add user-added sources, layers ...
+    // its probably not needed here since the condition should be reached
+    // earlier in onMapChanged slot. keeping the check here for safety
+    if (loaded && (m_block_data_until_loaded || m_finalize_data_loading)) {
+        m_syncState |= DataNeedsSetupSync;
+        m_syncState |= DataNeedsSync;
+        m_block_data_until_loaded = false;
+        m_finalize_data_loading = false;
+        update();
     }
 
     // check if timer is needed
@@ -1081,6 +2292,14 @@ QSGNode *QQuickItemMapboxGL::updatePaintNode(QSGNode *node, UpdatePaintNodeData
 }
 
 void QQuickItemMapboxGL::onMapChanged(QMapLibre::Map::MapChange change) {
+    // rendering of frames is not counted as progress as it is
+    // triggered by the refresh itself
+    if (change == QMapLibre::Map::MapChangeWillStartLoadingMap ||
+        change == QMapLibre::Map::MapChangeDidFinishLoadingMap ||
+        change == QMapLibre::Map::MapChangeDidFinishLoadingStyle ||
+        change == QMapLibre::Map::MapChangeSourceDidChange)
+        onLoadingProgress();
+
     // check if we can add user-added sources, layers ...
     if (QMapLibre::Map::MapChangeDidFinishLoadingStyle == change && m_block_data_until_loaded) {
         m_syncState |= DataNeedsSetupSync;
@@ -1096,6 +2315,39 @@ void QQuickItemMapboxGL::onMapChanged(QMapLibre::Map::MapChange change) {
     }
 }
 
+/// While the map is loading, it requests rendering when resources
+/// arrive. Refresh is used as a fallback if the map has not progressed
+/// within the interval. Interval is doubled on each refresh, up to
+/// 16 times of loadingRefreshInterval, and is reset on progress.
+void QQuickItemMapboxGL::startLoadingRefresh() {
+    if (m_loading_refresh_interval <= 0)
+        return;
+    m_loading_refresh_backoff = m_loading_refresh_interval;
+    m_timer.start(m_loading_refresh_backoff);
+}
+
+void QQuickItemMapboxGL::onLoadingProgress() {
+    if (m_timer.isActive())
+        startLoadingRefresh();
+}
+
+void QQuickItemMapboxGL::onLoadingRefresh() {
+    const qint64 now = m_clock.elapsed();
+    m_loading_wakeups.enqueue(now);
+    while (m_loading_wakeups.head() <= now - 60000)
+        m_loading_wakeups.dequeue();
+
+    update();
+
+    m_loading_refresh_backoff =
+        loadingRefreshBackoff(m_loading_refresh_backoff, m_loading_refresh_interval);
+    m_timer.start(m_loading_refresh_backoff);
+}
+
+int QQuickItemMapboxGL::loadingRefreshBackoff(int backoff, int interval) {
+    return qMin(2 * backoff, 16 * interval);
+}
+
 void QQuickItemMapboxGL::onMapLoadingFailed(QMapLibre::Map::MapLoadingFailure /*type*/,
                                             const QString &description) {
     setError(description);
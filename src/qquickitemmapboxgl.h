@@ -44,24 +44,41 @@
 #ifndef QQUICKITEMMAPBOXGL_H
 #define QQUICKITEMMAPBOXGL_H
 
+#include <QElapsedTimer>
 #include <QHash>
+#include <QMargins>
 #include <QMarginsF>
 #include <QMutex>
 #include <QPoint>
 #include <QPointF>
+#include <QQueue>
 #include <QQuickItem>
 #include <QRectF>
+#include <QSet>
+#include <QSharedPointer>
+#include <QStringList>
 #include <QTimer>
 #include <QVariantList>
+#include <QVector>
 
 #include <QGeoCoordinate>
 #include <QMapLibre/Map>
 #include <QMapLibre/Settings>
+#include <QMapLibre/Types>
 
 #include <string>
 
+#include "featurequery.h"
+#include "linesimplifier.h"
+#include "locationtrackermodel.h"
+#include "mapimagereader.h"
+#include "pointcluster.h"
+#include "projection.h"
 #include "sync.h"
 
+class BaseNode;
+class QOffscreenSurface;
+
 ///////////////////////////////////////////////////////////////////////////////////
 /// \brief The QQuickItemMapboxGL class
 ///
@@ -88,7 +105,27 @@ class QQuickItemMapboxGL : public QQuickItem {
 
     Q_PROPERTY(qreal devicePixelRatio READ devicePixelRatio WRITE setDevicePixelRatio NOTIFY
                    devicePixelRatioChanged)
+    /// render the map in a separate thread. Has to be set at construction
+    Q_PROPERTY(bool renderThreaded READ renderThreaded WRITE setRenderThreaded NOTIFY
+                   renderThreadedChanged)
     Q_PROPERTY(qreal pixelRatio READ pixelRatio WRITE setPixelRatio NOTIFY pixelRatioChanged)
+
+    /// lower resolution of the rendered map during gestures or slow frames
+    Q_PROPERTY(bool adaptiveResolution READ adaptiveResolution WRITE setAdaptiveResolution NOTIFY
+                   adaptiveResolutionChanged)
+    Q_PROPERTY(qreal minimumResolutionScale READ minimumResolutionScale WRITE
+                   setMinimumResolutionScale NOTIFY minimumResolutionScaleChanged)
+    /// frame time in milliseconds above which the resolution is lowered. 0 to disable
+    Q_PROPERTY(int targetFrameTime READ targetFrameTime WRITE setTargetFrameTime NOTIFY
+                   targetFrameTimeChanged)
+
+    /// maximal rate of map rendering during gestures and, unless idleFrameRate is set,
+    /// otherwise. 0 for no limit
+    Q_PROPERTY(int maximumFrameRate READ maximumFrameRate WRITE setMaximumFrameRate NOTIFY
+                   maximumFrameRateChanged)
+    /// maximal rate of map rendering when no gesture is in progress. 0 to use maximumFrameRate
+    Q_PROPERTY(int idleFrameRate READ idleFrameRate WRITE setIdleFrameRate NOTIFY
+                   idleFrameRateChanged)
     Q_PROPERTY(qreal mapToQtPixelRatio READ mapToQtPixelRatio NOTIFY mapToQtPixelRatioChanged)
     Q_PROPERTY(QString styleJson READ styleJson WRITE setStyleJson NOTIFY styleJsonChanged)
     Q_PROPERTY(QString styleUrl READ styleUrl WRITE setStyleUrl)
@@ -96,6 +133,21 @@ class QQuickItemMapboxGL : public QQuickItem {
     Q_PROPERTY(bool urlDebug READ urlDebug WRITE setUrlDebug NOTIFY urlDebugChanged)
     Q_PROPERTY(bool useFBO READ useFBO WRITE setUseFBO NOTIFY useFBOChanged)
 
+    /// time in milliseconds given per frame for applying sources, layers, images, and
+    /// properties on the map. 0 for no limit
+    Q_PROPERTY(int dataApplyBudget READ dataApplyBudget WRITE setDataApplyBudget NOTIFY
+                   dataApplyBudgetChanged)
+
+    /// minimal interval in milliseconds between submissions of lines extended by
+    /// appendSourceLine to the map. 0 for submission on every append
+    Q_PROPERTY(int sourceUpdateInterval READ sourceUpdateInterval WRITE setSourceUpdateInterval
+                   NOTIFY sourceUpdateIntervalChanged)
+
+    /// interval in milliseconds for refreshing the map while it is loading and
+    /// nothing has changed. 0 to disable
+    Q_PROPERTY(int loadingRefreshInterval READ loadingRefreshInterval WRITE
+                   setLoadingRefreshInterval NOTIFY loadingRefreshIntervalChanged)
+
     /// tracks meters per pixel for the map center
     Q_PROPERTY(qreal metersPerPixel READ metersPerPixel NOTIFY metersPerPixelChanged)
     Q_PROPERTY(qreal metersPerMapPixel READ metersPerMapPixel NOTIFY metersPerPixelChanged)
@@ -105,6 +157,11 @@ class QQuickItemMapboxGL : public QQuickItem {
     // error
     Q_PROPERTY(QString errorString READ errorString NOTIFY errorChanged)
 
+    // location tracking
+    Q_PROPERTY(QAbstractItemModel *trackerModel READ trackerModel CONSTANT)
+    Q_PROPERTY(bool emitLocationChanged READ emitLocationChanged WRITE setEmitLocationChanged
+                   NOTIFY emitLocationChangedChanged)
+
     // for internal use. used by map area to notify that the gesture is in progress
     Q_PROPERTY(bool gestureInProgress READ gestureInProgress WRITE setGestureInProgress NOTIFY
                    gestureInProgressChanged)
@@ -162,6 +219,24 @@ class QQuickItemMapboxGL : public QQuickItem {
     void setDevicePixelRatio(qreal devicePixelRatio);
     qreal devicePixelRatio() const;
 
+    bool renderThreaded() const;
+    void setRenderThreaded(bool threaded);
+
+    bool adaptiveResolution() const;
+    void setAdaptiveResolution(bool adaptive);
+
+    qreal minimumResolutionScale() const;
+    void setMinimumResolutionScale(qreal scale);
+
+    int targetFrameTime() const;
+    void setTargetFrameTime(int frameTime);
+
+    int maximumFrameRate() const;
+    void setMaximumFrameRate(int frameRate);
+
+    int idleFrameRate() const;
+    void setIdleFrameRate(int frameRate);
+
     void setPixelRatio(qreal pixelRatio);
     qreal pixelRatio() const;
 
@@ -198,6 +273,23 @@ class QQuickItemMapboxGL : public QQuickItem {
     bool useFBO() const;
     void setUseFBO(bool fbo);
 
+    int dataApplyBudget() const;
+    void setDataApplyBudget(int budget);
+
+    int sourceUpdateInterval() const;
+    void setSourceUpdateInterval(int interval);
+
+    int loadingRefreshInterval() const;
+    void setLoadingRefreshInterval(int interval);
+    /// Interval of the next loading refresh after the refresh with the given
+    /// interval, doubled up to 16 times of loadingRefreshInterval
+    static int loadingRefreshBackoff(int backoff, int interval);
+
+    QAbstractItemModel *trackerModel() const;
+
+    bool emitLocationChanged() const;
+    void setEmitLocationChanged(bool enabled);
+
     bool gestureInProgress() const;
     void setGestureInProgress(bool progress);
 
@@ -244,6 +336,22 @@ class QQuickItemMapboxGL : public QQuickItem {
     /////////////////////////////////////////////////////////////////////////////
     /// Map interaction methods
 
+    /// \brief Start a batch of data updates
+    ///
+    /// Changes of sources, layers, images and properties are not applied
+    /// on the map until the matching commitUpdate is called. Batches can
+    /// be nested, in which case the data is applied on the commit of the
+    /// outermost batch.
+    Q_INVOKABLE void beginUpdate();
+
+    /// \brief Apply the batch of data updates
+    ///
+    /// Applies all changes made since beginUpdate in a single update of
+    /// the map. Layers and images that were added and removed within the
+    /// batch are only removed, without adding them first. Batch that is
+    /// not committed within 10 seconds is committed automatically.
+    Q_INVOKABLE void commitUpdate();
+
     Q_INVOKABLE void addSource(const QString &sourceID, const QVariantMap &params);
 
     /// \brief Add source consisting of a single point coordinate
@@ -273,6 +381,59 @@ class QQuickItemMapboxGL : public QQuickItem {
     Q_INVOKABLE void updateSourceLine(const QString &sourceID, const QVariantList &coordinates,
                                       const QString &name = QString());
 
+    /// in *SourcePointsArray and *SourceLineArray, coordinates are given as interleaved
+    /// longitude and latitude pairs: either as Float64Array, ArrayBuffer with doubles,
+    /// QVector<QPointF>, or a list of numbers. The coordinates are
+    /// passed to the map without construction of GeoJSON for each point.
+    Q_INVOKABLE void addSourcePointsArray(const QString &sourceID, const QVariant &coordinates,
+                                          const QVariantList &names = QVariantList());
+    Q_INVOKABLE void addSourceLineArray(const QString &sourceID, const QVariant &coordinates,
+                                        const QString &name = QString());
+    Q_INVOKABLE void updateSourcePointsArray(const QString &sourceID, const QVariant &coordinates,
+                                             const QVariantList &names = QVariantList());
+    Q_INVOKABLE void updateSourceLineArray(const QString &sourceID, const QVariant &coordinates,
+                                           const QString &name = QString());
+
+    /// in C++, points and lines can be given as QPointF with x as longitude and y as latitude
+    void updateSourcePoints(const QString &sourceID, const QVector<QPointF> &coordinates,
+                            const QStringList &names = QStringList());
+    void updateSourceLine(const QString &sourceID, const QVector<QPointF> &coordinates,
+                          const QString &name = QString());
+
+    /// append coordinates to the line source. Coordinates are given as a list of
+    /// QGeoCoordinate or, for appendSourceLineArray, as in updateSourceLineArray.
+    /// The line is submitted to the map at most once per sourceUpdateInterval.
+    /// Appending to a source that is not a line fails with an error
+    Q_INVOKABLE void appendSourceLine(const QString &sourceID, const QVariantList &coordinates);
+    Q_INVOKABLE void appendSourceLineArray(const QString &sourceID, const QVariant &coordinates);
+
+    /// point sources with features identified by ids. Features are added or updated by
+    /// upsertSourceFeatures and removed by removeSourceFeatures. Coordinates are given as a
+    /// list of QGeoCoordinate or as in updateSourcePointsArray, properties as a list of maps.
+    /// Changes are submitted at most once per sourceUpdateInterval
+    Q_INVOKABLE void upsertSourceFeatures(const QString &sourceID, const QVariantList &ids,
+                                          const QVariant &coordinates,
+                                          const QVariantList &properties = QVariantList());
+    Q_INVOKABLE void removeSourceFeatures(const QString &sourceID, const QVariantList &ids);
+
+    /// points clustered by the map object. Only clusters and points within the visible
+    /// area and for the current zoom level are submitted to the map. Coordinates are
+    /// given as a list of QGeoCoordinate or as in updateSourcePointsArray
+    Q_INVOKABLE void addSourceClusteredPoints(const QString &sourceID, const QVariant &coordinates,
+                                              const QVariantList &names = QVariantList());
+    Q_INVOKABLE void updateSourceClusteredPoints(const QString &sourceID,
+                                                 const QVariant &coordinates,
+                                                 const QVariantList &names = QVariantList());
+    Q_INVOKABLE QVariantList clusterLeaves(const QString &sourceID, int clusterId, int limit = 10,
+                                           int offset = 0) const;
+    Q_INVOKABLE int clusterExpansionZoom(const QString &sourceID, int clusterId) const;
+
+    /// when enabled, line source is simplified for the current zoom level before
+    /// submission to the map. Applies to lines set by *SourceLine* methods.
+    /// Simplification is prepared in the thread pool and the line is submitted
+    /// again when it is ready
+    Q_INVOKABLE void setSourceLineSimplification(const QString &sourceID, bool enabled);
+
     Q_INVOKABLE void removeSource(const QString &sourceID);
 
     Q_INVOKABLE void addLayer(const QString &id, const QVariantMap &params,
@@ -304,6 +465,19 @@ class QQuickItemMapboxGL : public QQuickItem {
     ///
     Q_INVOKABLE QVariantList defaultStyles() const;
 
+    /// \brief Statistics collected by the map
+    ///
+    /// Counters describing the state of the synchronization with the map,
+    /// returned as a map of counter names and values. Intended for debugging
+    /// and checking the performance of applications.
+    Q_INVOKABLE QVariantMap stats() const;
+
+    /// Conversion between coordinates and pixels in the widget using the camera of the
+    /// last rendered frame. Can be called without waiting for the rendering thread.
+    /// Invalid coordinate or NaN pixel is returned if the conversion is not available
+    Q_INVOKABLE QGeoCoordinate coordinateForPixel(const QPointF &pixel) const;
+    Q_INVOKABLE QPointF pixelForCoordinate(const QGeoCoordinate &coordinate) const;
+
   signals:
     void startRefreshTimer();
     void stopRefreshTimer();
@@ -318,12 +492,22 @@ class QQuickItemMapboxGL : public QQuickItem {
     void marginsChanged(const QMarginsF &margins);
 
     void devicePixelRatioChanged(qreal devicePixelRatio);
+    void renderThreadedChanged(bool renderThreaded);
+    void adaptiveResolutionChanged(bool adaptiveResolution);
+    void minimumResolutionScaleChanged(qreal minimumResolutionScale);
+    void targetFrameTimeChanged(int targetFrameTime);
+    void maximumFrameRateChanged(int maximumFrameRate);
+    void idleFrameRateChanged(int idleFrameRate);
     void pixelRatioChanged(qreal pixelRatio);
     void styleJsonChanged(QString json);
     void styleUrlChanged(QString url);
     void urlSuffixChanged(QString urlSuffix);
     void urlDebugChanged(bool urlDebug);
     void useFBOChanged(bool useFBO);
+    void dataApplyBudgetChanged(int dataApplyBudget);
+    void sourceUpdateIntervalChanged(int sourceUpdateInterval);
+    void loadingRefreshIntervalChanged(int loadingRefreshInterval);
+    void emitLocationChangedChanged(bool emitLocationChanged);
 
     void errorChanged(QString error);
 
@@ -339,6 +523,10 @@ class QQuickItemMapboxGL : public QQuickItem {
     void cacheDatabaseDefaultPathChanged(bool defaultpath);
     void cacheDatabaseStoreSettingsChanged(bool storesettings);
 
+    /// emitted when all sources, layers, images, and properties have been
+    /// applied on the map after loading of the style
+    void overlaysReady();
+
     void locationChanged(QString id, bool visible, const QPoint pixel);
     void locationTrackingRemoved(QString id);
 
@@ -363,6 +551,22 @@ class QQuickItemMapboxGL : public QQuickItem {
     void replyCoordinateForPixel(const QPointF pixel, QGeoCoordinate geocoordinate,
                                  qreal degLatPerPixel, qreal degLonPerPixel, const QVariant &tag);
 
+    void queryCoordinatesForPixels(const QVariant &pixels, const QVariant &requestId);
+    void replyCoordinatesForPixels(const QByteArray &coordinates, const QVariant &requestId);
+
+    void queryFeaturesAt(const QVariant &area, const QStringList &layerIds = QStringList(),
+                         const QVariant &requestId = QVariant());
+    void replyFeaturesAt(const QVariantList &features, const QVariant &requestId,
+                         const QString &error);
+
+    void querySourceFeatures(const QString &sourceID, const QVariant &requestId = QVariant());
+    void replySourceFeatures(const QString &sourceID, const QVariantList &features,
+                             const QVariant &requestId);
+
+    void queryMapImage(const QVariant &requestId = QVariant(), qreal scale = 1,
+                       const QString &fileName = QString());
+    void replyMapImage(const QImage &image, const QString &fileName, const QVariant &requestId);
+
     /////////////////////////////////////////////////////////
     /// Tracking the state of the map
     void metersPerPixelChanged(qreal metersPerPixel);
@@ -372,18 +576,43 @@ class QQuickItemMapboxGL : public QQuickItem {
   public slots:
     void setCenter(const QGeoCoordinate &center);
 
+  private slots:
+    void onLineSimplified(); ///< Line simplifier has been built in the thread pool
+
   protected:
     QSGNode *updatePaintNode(QSGNode *node, UpdatePaintNodeData *) override;
 
   private:
     void onMapChanged(QMapLibre::Map::MapChange change); ///< Follow the state of the map
+
+    /// Refresh of the map while it is loading
+    void startLoadingRefresh();
+    void onLoadingProgress(); ///< Map has progressed, refresh is postponed
+    void onLoadingRefresh();  ///< Nothing has progressed within interval
     void onMapLoadingFailed(QMapLibre::Map::MapLoadingFailure type, const QString &description);
+    void onUpdateBatchTimeout(); ///< Batch has not been committed in time
+    void refineFitView();        ///< Fit projected coordinates of fitView into the view
 
     std::string resourceTransform(
         const std::string &url); ///< Use resource transform API to change requested URL
 
     void setError(QString error); ///< Set error string, used internally
 
+    /// Sources constructed from coordinates
+    void setSourcePointsLonLat(const QString &sourceID, const QVariant &coordinates,
+                               const QStringList &names);
+    void setSourcePoints(const QString &sourceID, const QMapLibre::Coordinates &coordinates,
+                         const QStringList &names);
+    void setSourceLine(const QString &sourceID, const QMapLibre::Coordinates &coordinates,
+                       const QString &name);
+    void appendSourceLineCoordinates(const QString &sourceID,
+                                     const QMapLibre::Coordinates &coordinates);
+    void scheduleSourceUpdates(); ///< Start timer for submission of lines and features
+    void submitSourceUpdates();   ///< Submit pending lines and feature tables to the map
+    void updateSimplifiedLines(); ///< Submit simplified lines after change of zoom level
+    void updateClusteredSources(QMapLibre::Map *map,
+                                BaseNode *node); ///< Submit clusters for the visible area
+
   private:
     /// \brief Private class to track locations
     class LocationTracker {
@@ -396,11 +625,65 @@ class QQuickItemMapboxGL : public QQuickItem {
         const QGeoCoordinate &coordinate() const { return m_location; }
         bool visible() const { return m_last_visible; }
         const QPoint &position() const { return m_last_position; }
+        bool dirty() const { return m_dirty; } ///< Position has to be projected
 
       protected:
         QGeoCoordinate m_location;
         bool m_last_visible;
         QPoint m_last_position;
+        bool m_dirty{true};
+    };
+
+    /// \brief Query recorded for execution on the next sync
+    struct Query {
+        enum Type {
+            SourceExists,
+            LayerExists,
+            CoordinateForPixel,
+            CoordinatesForPixels,
+            FeaturesAt,
+            SourceFeatures,
+            MapImage,
+            Skipped ///< Superseded by a later query
+        };
+        Type type;
+        QString id; ///< Source or layer id
+        QPointF pixel;
+        QVariant pixels; ///< Pixels or area for features
+        QVariant tag;
+        QStringList layers;
+        qreal scale;      ///< Scale of map image
+        QString fileName; ///< File name for map image
+    };
+
+    void queueQuery(const Query &query);
+    void runQueries(BaseNode *node);
+    void findFeaturesAt(BaseNode *node, const QVariant &area, const QStringList &layerIds,
+                        const QVariant &requestId);
+    QVariantList sourceFeatures(const QString &sourceID) const;
+    void readMapImages(BaseNode *node); ///< Start requested and deliver finished map images
+    void setRenderTime(qint64 time);    ///< Record the time used to render a frame, in ns
+
+    QList<Query> m_queries;
+    mutable FeatureCache m_feature_cache; ///< Features parsed from the data of sources
+    QList<MapImageReader::Request> m_image_requests; ///< Read after the frame is shown
+
+    /// \brief Camera state used to detect whether trackers have to be projected again
+    struct CameraState {
+        QMapLibre::Coordinate center;
+        double zoom{-1};
+        double bearing{0};
+        double pitch{0};
+        QMargins margins;
+        QSize size;
+        qreal pixelRatio{0};
+
+        bool operator==(const CameraState &o) const {
+            return center == o.center && zoom == o.zoom && bearing == o.bearing &&
+                   pitch == o.pitch && margins == o.margins && size == o.size &&
+                   pixelRatio == o.pixelRatio;
+        }
+        bool operator!=(const CameraState &o) const { return !(*this == o); }
     };
 
   private:
@@ -414,7 +697,11 @@ class QQuickItemMapboxGL : public QQuickItem {
     bool m_cache_store_settings{false};
 
     QSize m_last_size; ///< Size of the item
-    QTimer m_timer;    ///< Timer used to refresh the map
+    QTimer m_timer;    ///< Timer used to refresh the map while it is loading
+    int m_loading_refresh_interval{250};
+    int m_loading_refresh_backoff{0}; ///< Current refresh interval, extended if nothing progresses
+    QElapsedTimer m_clock;
+    QQueue<qint64> m_loading_wakeups; ///< Times of refreshes within the last minute, in ms
 
     qreal m_minimumZoomLevel = 0;
     qreal m_maximumZoomLevel = 20;
@@ -438,10 +725,28 @@ class QQuickItemMapboxGL : public QQuickItem {
     qreal m_fit_zoomLevel = -1;
     bool m_fit_preserve_box = false;
     bool m_fit_preserve_center = false;
+    QMapLibre::Coordinates m_fit_coordinates; ///< Coordinates given to fitView
+    int m_fit_refine = 0; ///< Remaining refinements of the fit for rotated or pitched map
+    static constexpr int maxFitRefinements = 5;
 
     QString m_errorString;
 
     qreal m_devicePixelRatio = 1;
+    bool m_render_threaded{false};
+    QSharedPointer<QOffscreenSurface> m_render_surface; ///< Surface used by the render thread
+
+    bool m_adaptive_resolution{false};
+    qreal m_minimum_resolution_scale{0.5};
+    int m_target_frame_time{0};
+    qreal m_render_scale{1};         ///< Resolution scale used for rendering
+    qint64 m_render_time{0};         ///< Time used to render the last frame, in nanoseconds
+    qint64 m_render_time_average{0}; ///< Moving average of m_render_time, in nanoseconds
+    qint64 m_render_start{-1};       ///< Start of the frame waiting for swap, in ns of m_clock
+
+    int m_maximum_frame_rate{0};
+    int m_idle_frame_rate{0};
+    qint64 m_last_render{-1}; ///< Time of the last rendering, in ms of m_clock
+    QTimer m_frame_timer;     ///< Triggers update for the next paced frame
     qreal m_pixelRatio = 1;
     qreal m_mapToQtPixelRatio = 1;
     QString m_styleUrl;
@@ -453,6 +758,48 @@ class QQuickItemMapboxGL : public QQuickItem {
     bool m_urlDebug{false};
 
     QHash<QString, LocationTracker> m_location_tracker;
+    CameraState m_location_tracker_camera; ///< Camera used for the last projection of trackers
+    Projection m_projection; ///< Projection for the camera of the last frame
+    ProjectionSnapshot m_projection_snapshot; ///< m_projection published for GUI thread
+    LocationTrackerModel *m_tracker_model;
+    bool m_emit_location_changed{true};
+
+    /// \brief Coordinates of line sources, kept for appendSourceLine
+    struct SourceLine {
+        QMapLibre::Coordinates coordinates;
+        QString name;
+        bool pending{false}; ///< Appended coordinates are not submitted yet
+        QSharedPointer<LineSimplifier> simplifier; ///< Built simplifier of the line or its start
+        QSharedPointer<LineSimplifier> building;   ///< Simplifier built in the thread pool
+        int zoom{-1}; ///< Zoom level of submitted simplified line
+    };
+
+    void submitSourceLine(const QString &sourceID, SourceLine &line);
+    void simplifySourceLine(SourceLine &line); ///< Start building of the line simplifier
+    int simplificationZoom() const;
+
+    QHash<QString, SourceLine> m_source_lines;
+    QSet<QString> m_source_lines_simplified; ///< Sources with enabled line simplification
+
+    /// \brief Point features of sources, kept for upsertSourceFeatures
+    struct SourceFeatures {
+        QVector<QMapLibre::Feature> features;
+        QHash<QString, int> index; ///< Feature index by its id
+        bool pending{false};       ///< Changes are not submitted yet
+    };
+
+    QHash<QString, SourceFeatures> m_source_features;
+
+    /// \brief Clustered points with the area and zoom level submitted to the map
+    struct ClusteredSource {
+        QSharedPointer<PointCluster> cluster;  ///< Index of the published clusters
+        QSharedPointer<PointCluster> building; ///< Index replacing cluster when it is built
+        int zoom{-1};
+        QRectF bounds;
+    };
+
+    QHash<QString, ClusteredSource> m_source_clusters;
+    QTimer m_source_update_timer; ///< Timer used to limit submission of lines and features
 
     bool m_gestureInProgress = false;
 
@@ -465,6 +812,27 @@ class QQuickItemMapboxGL : public QQuickItem {
     QMapLibreSync::LayoutPropertyList m_layout_properties;
     QMapLibreSync::PaintPropertyList m_paint_properties;
     QMapLibreSync::ImageList m_images;
+    int m_update_depth{0};        ///< Depth of nested data update batches
+    QTimer m_update_batch_timer;  ///< Commits batches that are left open
+    int m_dataApplyBudget{0};
+    bool m_data_replay{false};            ///< Replay of data on the new style is in progress
+    bool m_overlays_ready_pending{false}; ///< overlaysReady has to be emitted when data is applied
+
+    /// Statistics, times in nanoseconds
+    qint64 m_stats_data_sync_time{0};       ///< Time used to apply data on the last sync
+    qint64 m_stats_data_sync_time_max{0};   ///< Maximal time used to apply data on sync
+    qint64 m_stats_data_conversion_time{0}; ///< Time used to convert data applied on last sync
+    qint64 m_stats_tracker_update_time{0};  ///< Time used to project trackers on the last sync
+    qint64 m_stats_queries{0};              ///< Number of queries answered
+    qint64 m_stats_query_frames{0};         ///< Frames with queries only, not rendered
+    qint64 m_stats_query_time_saved{0};     ///< Render time estimated as saved by query frames
+    qint64 m_stats_skipped_frames{0};       ///< Frames where the map has not changed, not rendered
+    qint64 m_stats_late_frames{0};    ///< Syncs postponed as the map was rendered in the thread
+    qint64 m_stats_dropped_frames{0}; ///< Frames rendered in the thread and never shown
+    qint64 m_stats_fbo_allocations{0}; ///< Framebuffers allocated for rendering
+    qint64 m_stats_reduced_frames{0};  ///< Frames rendered with lowered resolution
+    qint64 m_stats_rendered_frames{0};  ///< Frames where the map was rendered
+    qint64 m_stats_coalesced_frames{0}; ///< Updates postponed to the next paced frame
 
     enum SyncState {
         NothingNeedsSync = 0,
@@ -480,7 +848,8 @@ class QQuickItemMapboxGL : public QQuickItem {
         DataNeedsSetupSync = 1 << 9,
         FitViewNeedsSync = 1 << 10,
         FitViewCenterNeedsSync = 1 << 11,
-        GestureInProgressNeedsSync = 1 << 12
+        GestureInProgressNeedsSync = 1 << 12,
+        QueriesNeedSync = 1 << 13
     };
     int m_syncState = NothingNeedsSync;
 
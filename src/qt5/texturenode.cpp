@@ -80,30 +80,38 @@ void TextureNode::resize(const QSize &size, qreal pixelRatio) {
     const QSize fbSize = minSize * m_device_pixel_ratio;         // physical pixels
     m_map_size = minSize * m_device_pixel_ratio / m_pixel_ratio; // ensure zoom
 
+    m_fb_size = renderSize(fbSize);
     m_map->resize(m_map_size);
 
-    m_fbo.reset(
-        new QOpenGLFramebufferObject(fbSize, QOpenGLFramebufferObject::CombinedDepthStencil));
-    m_map->setOpenGLFramebufferObject(m_fbo->handle(), fbSize);
-
-    TexturePlain *fboTexture = static_cast<TexturePlain *>(texture());
-    if (!fboTexture)
-        fboTexture = new TexturePlain;
-
-    fboTexture->setTextureId(m_fbo->texture());
-    fboTexture->setTextureSize(fbSize);
-
-    if (!texture()) {
-        setTexture(fboTexture);
-        setOwnsTexture(true);
+    // framebuffer is kept while the map fits into it, rendering into its part
+    if (!m_fbo || !fboFits(m_fbo->size(), fbSize)) {
+        m_fbo.reset(new QOpenGLFramebufferObject(fboSize(fbSize),
+                                                 QOpenGLFramebufferObject::CombinedDepthStencil));
+        m_fbo_allocations++;
+
+        TexturePlain *fboTexture = static_cast<TexturePlain *>(texture());
+        if (!fboTexture) {
+            fboTexture = new TexturePlain;
+            fboTexture->setOwnsTexture(false); // texture is owned by framebuffer
+        }
+
+        fboTexture->setTextureId(m_fbo->texture());
+        fboTexture->setTextureSize(m_fbo->size());
+
+        if (!texture()) {
+            setTexture(fboTexture);
+            setOwnsTexture(true);
+        }
     }
 
+    m_map->setOpenGLFramebufferObject(m_fbo->handle(), m_fb_size);
+    setMapTextureRect(m_fb_size);
     setRect(QRectF(QPointF(), minSize));
 }
 
 void TextureNode::render(QQuickWindow *window) {
     QOpenGLFunctions *f = window->openglContext()->functions();
-    f->glViewport(0, 0, m_fbo->width(), m_fbo->height());
+    f->glViewport(0, 0, m_fb_size.width(), m_fb_size.height());
 
     GLint alignment;
     f->glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
@@ -120,4 +128,12 @@ void TextureNode::render(QQuickWindow *window) {
     window->resetOpenGLState();
 }
 
+bool TextureNode::shownTexture(GLuint &texture, QSize &size) const {
+    if (!m_fbo)
+        return false;
+    texture = m_fbo->texture();
+    size = m_fb_size;
+    return true;
+}
+
 #endif
\ No newline at end of file
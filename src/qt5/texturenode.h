@@ -22,8 +22,12 @@ class TextureNode : public BaseTextureNode {
     void resize(const QSize &size, qreal pixelRatio) override;
     void render(QQuickWindow *) override;
 
+  protected:
+    bool shownTexture(GLuint &texture, QSize &size) const override;
+
   private:
     QScopedPointer<QOpenGLFramebufferObject> m_fbo;
+    QSize m_fb_size; ///< Part of the framebuffer used by the map
 };
 
 } // namespace MLNQT5
@@ -31,9 +31,11 @@ void TextureNodeOpenGL::resize(const QSize &size, qreal pixelRatio) {
     const QSize fbSize = minSize * m_device_pixel_ratio;         // physical pixels
     m_map_size = minSize * m_device_pixel_ratio / m_pixel_ratio; // ensure zoom
 
+    m_fb_size = renderSize(fbSize);
     m_map->resize(m_map_size);
 
-    if (!m_fbo || m_fbo->size() != fbSize) {
+    // framebuffer is kept while the map fits into it, rendering into its part
+    if (!m_fbo || !fboFits(m_fbo->size(), fbSize)) {
         // check if we have GL context
         const QOpenGLContext *glContext = QOpenGLContext::currentContext();
         if (glContext == nullptr) {
@@ -49,7 +51,8 @@ void TextureNodeOpenGL::resize(const QSize &size, qreal pixelRatio) {
         // keep old texture/fbo before we set new texture in render
         m_prev_texture.reset(m_texture.release());
         m_prev_fbo.reset(m_fbo.release());
-        m_fbo.reset(new QOpenGLFramebufferObject(fbSize, fmt));
+        m_fbo.reset(new QOpenGLFramebufferObject(fboSize(fbSize), fmt));
+        m_fbo_allocations++;
 
         if (!m_fbo || !m_fbo->isValid()) {
             qWarning() << "Failed to create FBO or FBO is invalid after creation";
@@ -58,7 +61,8 @@ void TextureNodeOpenGL::resize(const QSize &size, qreal pixelRatio) {
         }
     }
 
-    m_map->setOpenGLFramebufferObject(static_cast<quint32>(m_fbo->handle()), fbSize);
+    m_map->setOpenGLFramebufferObject(static_cast<quint32>(m_fbo->handle()), m_fb_size);
+    setMapTextureRect(m_fb_size);
 }
 
 void TextureNodeOpenGL::render(QQuickWindow *window) {
@@ -88,7 +92,7 @@ void TextureNodeOpenGL::render(QQuickWindow *window) {
         }
 
         m_texture.reset(QNativeInterface::QSGOpenGLTexture::fromNative(
-            maplibreTextureId, window, m_map_size, QQuickWindow::TextureHasAlphaChannel));
+            maplibreTextureId, window, m_fbo->size(), QQuickWindow::TextureHasAlphaChannel));
 
         if (!m_texture) {
             qWarning()
@@ -98,6 +102,7 @@ void TextureNodeOpenGL::render(QQuickWindow *window) {
 
         setTexture(m_texture.get());
         setOwnsTexture(false);
+        setMapTextureRect(m_fb_size);
 
         // drop unused objects
         m_prev_texture.reset();
@@ -108,7 +113,7 @@ void TextureNodeOpenGL::render(QQuickWindow *window) {
 
     if (QOpenGLContext *context = QOpenGLContext::currentContext()) {
         QOpenGLFunctions *f = context->functions();
-        f->glViewport(0, 0, m_fbo->width(), m_fbo->height());
+        f->glViewport(0, 0, m_fb_size.width(), m_fb_size.height());
     }
 
     m_map->render();
@@ -118,4 +123,14 @@ void TextureNodeOpenGL::render(QQuickWindow *window) {
     QQuickOpenGLUtils::resetOpenGLState();
 }
 
+#ifdef MLN_RENDER_BACKEND_OPENGL
+bool TextureNodeOpenGL::shownTexture(GLuint &texture, QSize &size) const {
+    if (!m_fbo || !m_texture)
+        return false;
+    texture = static_cast<GLuint>(m_fbo->texture());
+    size = m_fb_size;
+    return true;
+}
+#endif
+
 #endif
@@ -29,8 +29,14 @@ class TextureNodeOpenGL final : public BaseTextureNode {
     void resize(const QSize &size, qreal pixelRatio) final;
     void render(QQuickWindow *window) final;
 
+#ifdef MLN_RENDER_BACKEND_OPENGL
+  protected:
+    bool shownTexture(GLuint &texture, QSize &size) const final;
+#endif
+
   private:
     bool m_renderer_bound{};
+    QSize m_fb_size{}; ///< Part of the framebuffer used by the map
     std::unique_ptr<QOpenGLFramebufferObject> m_fbo{};
     std::unique_ptr<QSGTexture> m_texture{};
     std::unique_ptr<QOpenGLFramebufferObject> m_prev_fbo{};
@@ -1,24 +1,109 @@
 #include "sync.h"
 
+#include "tasknotifier.h"
+
+#include <QElapsedTimer>
 #include <QJsonDocument>
+#include <QRunnable>
+#include <QStringList>
+#include <QThreadPool>
 
 #include <QDebug>
 
 using namespace QMapLibreSync;
 
+/// Budget
+
+Budget::Budget(int ms) : m_limit(ms > 0 ? ms * qint64(1000000) : -1) { m_timer.start(); }
+
+bool Budget::take() {
+    if (m_taken == 0 || m_limit < 0 || m_timer.nsecsElapsed() < m_limit) {
+        m_taken++;
+        return true;
+    }
+    return false;
+}
+
+/// Data conversion
+
+namespace {
+class DataConversionTask : public QRunnable {
+  public:
+    DataConversionTask(const QSharedPointer<DataConversion> &c, QObject *receiver,
+                       const char *member)
+        : m_conversion(c),
+          m_notifier(receiver && member ? new TaskNotifier(receiver, member) : nullptr) {}
+
+    void run() override {
+        m_conversion->run();
+        if (m_notifier)
+            m_notifier->notify();
+    }
+
+  private:
+    QSharedPointer<DataConversion> m_conversion;
+    TaskNotifier *m_notifier; ///< Deletes itself after notification
+};
+} // namespace
+
+DataConversion::DataConversion(const QVariant &data) : m_data(data) {}
+
+void DataConversion::start(const QSharedPointer<DataConversion> &conversion, QObject *receiver,
+                           const char *member) {
+    QThreadPool::globalInstance()->start(new DataConversionTask(conversion, receiver, member));
+}
+
+void DataConversion::run() {
+    QElapsedTimer timer;
+    timer.start();
+
+    QByteArray result = QJsonDocument::fromVariant(m_data).toJson(QJsonDocument::Compact);
+
+    QMutexLocker lk(&m_mutex);
+    m_result = result;
+    m_data = QVariant(); // not needed anymore
+    m_elapsed = timer.nsecsElapsed();
+    m_done = true;
+    m_condition.wakeAll();
+}
+
+bool DataConversion::done() const {
+    QMutexLocker lk(&m_mutex);
+    return m_done;
+}
+
+QByteArray DataConversion::result() const {
+    QMutexLocker lk(&m_mutex);
+    while (!m_done)
+        m_condition.wait(&m_mutex);
+    return m_result;
+}
+
 /// Source
 
-SourceList::SourceAction::SourceAction(Type t, const QString id, const QVariantMap params)
-    : Action(t), m_asset(id, params) {}
+SourceList::SourceAction::SourceAction(Type t, const QString id, const QVariantMap params,
+                                       QObject *receiver, const char *member)
+    : Action(t), m_asset(id, params) {
+    // special treatment of "data" field: GeoJSON given as an object is
+    // converted into JSON in the thread pool
+    if (m_asset.params.contains("data")) {
+        QVariant data_orig = m_asset.params["data"];
+        if (data_orig.userType() != QMetaType::QByteArray && !data_orig.canConvert<QString>() &&
+            data_orig.canConvert<QVariantMap>()) {
+            m_conversion.reset(new DataConversion(data_orig));
+            DataConversion::start(m_conversion, receiver, member);
+        }
+    }
+}
 
 void SourceList::SourceAction::apply(QMapLibre::Map *map) {
     // special treatment of "data" field
-    if (m_asset.params.contains("data")) {
+    if (m_conversion)
+        m_asset.params["data"] = m_conversion->result();
+    else if (m_asset.params.contains("data")) {
         QVariant data_orig = m_asset.params["data"];
-        if (data_orig.canConvert<QString>())
+        if (data_orig.userType() != QMetaType::QByteArray && data_orig.canConvert<QString>())
             m_asset.params["data"] = data_orig.toString().toUtf8();
-        else if (data_orig.canConvert<QVariantMap>())
-            m_asset.params["data"] = QJsonDocument::fromVariant(data_orig).toJson();
     }
 
     // apply
@@ -48,57 +133,82 @@ void SourceList::update(const QString &id, const QVariantMap &params) {
     add_to_stack(Action::Update, id, params);
 }
 
+void SourceList::setConversionReceiver(QObject *receiver, const char *member) {
+    m_receiver = receiver;
+    m_member = member;
+}
+
+bool SourceList::converting() const {
+    return !m_action_stack.isEmpty() && !m_action_stack.begin()->ready();
+}
+
+bool SourceList::contains(const QString &id) const {
+    const SourceAction *action = m_action_stack.find(id);
+    if (action)
+        return action->type() != Action::Remove;
+    return m_assets.contains(id);
+}
+
 /// To avoid populating stack of added sources (for example during
 /// initialization or longer CPU sleep or background activity without
 /// OpenGL calls), replace the last added source in the stack with the
 /// new one. If the source has been removed earlier in the stack,
 /// drop that remove as well
 void SourceList::add_to_stack(Action::Type t, const QString &id, const QVariantMap &params) {
-    // remove previous source action if existing
-    QMutableListIterator<SourceAction> i(m_action_stack);
-    while (i.hasNext())
-        if (i.next().asset().id == id)
-            i.remove();
-
-    m_action_stack.append(SourceAction(t, id, params));
+    // previous source action, if existing, is replaced
+    m_action_stack.append(id, SourceAction(t, id, params, m_receiver.data(),
+                                           m_member.isEmpty() ? nullptr : m_member.constData()));
 }
 
-void SourceList::apply(QMapLibre::Map *map) {
-    for (SourceAction &action : m_action_stack) {
+/// Sources are applied in the order they were added. If data of the
+/// source is still converted, application is continued on the next call.
+bool SourceList::apply(QMapLibre::Map *map, Budget &budget) {
+    m_conversion_time = 0;
+    while (!m_action_stack.isEmpty()) {
+        SourceAction &action = m_action_stack.first();
+        if (!action.ready() || !budget.take())
+            return false;
+
         action.apply(map);
+        m_conversion_time += action.conversion_time();
 
-        if (action.type() == Action::Remove) {
-            QMutableListIterator<Asset> i(m_assets);
-            while (i.hasNext())
-                if (i.next().id == action.asset().id)
-                    i.remove();
-        }
+        if (action.type() == Action::Remove)
+            m_assets.remove(action.asset().id);
 
         else if (action.type() == Action::Add || action.type() == Action::Update) {
-            Asset update = action.asset();
-            bool updated = false;
-            for (Asset &asset : m_assets)
-                if (update.id == asset.id) {
-                    updated = true;
-                    for (QVariantMap::const_iterator iter = update.params.constBegin();
-                         iter != update.params.constEnd(); ++iter)
-                        asset.params[iter.key()] = iter.value();
-                }
-
-            // treat update equal to add if such source does not exist
-            if (!updated)
-                m_assets.append(update);
+            const Asset &update = action.asset();
+            Asset *asset = m_assets.find(update.id);
+            if (asset) {
+                for (QVariantMap::const_iterator iter = update.params.constBegin();
+                     iter != update.params.constEnd(); ++iter)
+                    asset->params[iter.key()] = iter.value();
+            } else
+                // treat update equal to add if such source does not exist
+                m_assets.append(update.id, update);
         }
+
+        const QString id = action.asset().id;
+        m_action_stack.remove(id);
     }
 
-    m_action_stack.clear();
+    return true;
 }
 
-void SourceList::setup(QMapLibre::Map *map) {
-    for (Asset &asset : m_assets) {
+void SourceList::setup() {
+    m_replay.clear();
+    for (const Asset &asset : m_assets)
+        m_replay.append(asset);
+}
+
+bool SourceList::replay(QMapLibre::Map *map, Budget &budget) {
+    while (!m_replay.isEmpty()) {
+        if (!budget.take())
+            return false;
+        Asset asset = m_replay.takeFirst();
         SourceAction action(Action::Add, asset.id, asset.params);
         action.apply(map);
     }
+    return true;
 }
 
 /// Layer
@@ -128,50 +238,147 @@ void LayerList::remove(const QString &id) {
     m_action_stack.append(LayerAction(Action::Remove, id));
 }
 
-void LayerList::apply(QMapLibre::Map *map) {
-    for (LayerAction &action : m_action_stack) {
+bool LayerList::apply(QMapLibre::Map *map, Budget &budget) {
+    int applied = 0;
+    for (; applied < m_action_stack.size() && budget.take(); ++applied) {
+        LayerAction &action = m_action_stack[applied];
         action.apply(map);
 
+        // re-added layer is moved to the end to keep the order of
+        // layers on setup the same as on the current map
         if (action.type() == Action::Add)
-            m_assets.append(action.asset());
+            m_assets.append(action.asset().id, action.asset());
 
-        else if (action.type() == Action::Remove) {
-            QMutableListIterator<Asset> i(m_assets);
-            while (i.hasNext())
-                if (i.next().id == action.asset().id)
-                    i.remove();
-        }
+        else if (action.type() == Action::Remove)
+            m_assets.remove(action.asset().id);
     }
 
-    m_action_stack.clear();
+    m_action_stack.erase(m_action_stack.begin(), m_action_stack.begin() + applied);
+    return m_action_stack.isEmpty();
 }
 
-void LayerList::setup(QMapLibre::Map *map) {
-    for (Asset &asset : m_assets) {
+void LayerList::setup() {
+    m_replay.clear();
+    for (const Asset &asset : m_assets)
+        m_replay.append(asset);
+}
+
+bool LayerList::replay(QMapLibre::Map *map, Budget &budget) {
+    while (!m_replay.isEmpty()) {
+        if (!budget.take())
+            return false;
+        Asset asset = m_replay.takeFirst();
         LayerAction action(Action::Add, asset.id, asset.params, asset.before);
         action.apply(map);
     }
+    return true;
+}
+
+/// Layer that is added and removed later in the stack is represented by
+/// its last removal, unless it is used by other layers as a reference
+/// for placement. Removal is kept as the layer could be a part of the
+/// style or added earlier.
+QSet<QString> LayerList::compact() {
+    QHash<QString, int> last;  ///< Index of the last action for each layer
+    QHash<QString, int> count; ///< Number of actions for each layer
+    QSet<QString> before;
+    for (int i = 0; i < m_action_stack.size(); ++i) {
+        const Asset &asset = m_action_stack[i].asset();
+        last.insert(asset.id, i);
+        count[asset.id]++;
+        if (!asset.before.isEmpty() && asset.before != asset.id)
+            before.insert(asset.before);
+    }
+
+    QSet<QString> compacted;
+    for (QHash<QString, int>::const_iterator i = last.constBegin(); i != last.constEnd(); ++i)
+        if (m_action_stack[i.value()].type() == Action::Remove && count.value(i.key()) > 1 &&
+            !before.contains(i.key()))
+            compacted.insert(i.key());
+
+    if (compacted.isEmpty())
+        return compacted;
+
+    QList<LayerAction> stack;
+    for (int i = 0; i < m_action_stack.size(); ++i) {
+        const QString &id = m_action_stack[i].asset().id;
+        if (!compacted.contains(id) || last.value(id) == i)
+            stack.append(m_action_stack[i]);
+    }
+    m_action_stack = stack;
+    return compacted;
 }
 
 /// Properties
 
 void PropertyList::add(const QString &layer, const QString &property, const QVariant &value) {
-    m_action_stack.append(Property(layer, property, value));
+    m_action_stack[layer].insert(property, value);
+}
+
+/// Called on removal of the layer. Properties set before the removal
+/// are dropped from the stack as well to avoid applying them to a
+/// layer that could be added later with the same id.
+void PropertyList::remove_layer(const QString &layer) {
+    m_properties.remove(layer);
+    m_action_stack.remove(layer);
+    m_replay.remove(layer);
 }
 
-void PropertyList::apply(QMapLibre::Map *map) {
-    for (Property &p : m_action_stack) {
+void PropertyList::apply_layer(QMapLibre::Map *map, const QString &layer,
+                               const LayerProperties &props) {
+    for (LayerProperties::const_iterator i = props.constBegin(); i != props.constEnd(); ++i) {
+        Property p(layer, i.key(), i.value());
         this->apply_property(map, p);
-        m_properties.append(p);
     }
+}
+
+bool PropertyList::apply(QMapLibre::Map *map, Budget &budget) {
+    while (!m_action_stack.isEmpty()) {
+        if (!budget.take())
+            return false;
 
-    m_action_stack.clear();
+        QHash<QString, LayerProperties>::iterator i = m_action_stack.begin();
+        apply_layer(map, i.key(), i.value());
+
+        LayerProperties &stored = m_properties[i.key()];
+        for (LayerProperties::const_iterator p = i.value().constBegin();
+             p != i.value().constEnd(); ++p)
+            stored.insert(p.key(), p.value());
+
+        m_action_stack.erase(i);
+    }
+    return true;
 }
 
-void PropertyList::setup(QMapLibre::Map *map) {
-    for (Property &p : m_properties) {
-        this->apply_property(map, p);
+void PropertyList::setup() {
+    m_replay = m_properties;
+    m_replayed = 0;
+}
+
+bool PropertyList::replay(QMapLibre::Map *map, Budget &budget) {
+    while (!m_replay.isEmpty()) {
+        if (!budget.take())
+            return false;
+
+        QHash<QString, LayerProperties>::iterator i = m_replay.begin();
+        apply_layer(map, i.key(), i.value());
+        m_replayed += i.value().size();
+        m_replay.erase(i);
     }
+    return true;
+}
+
+int PropertyList::size() const {
+    int s = 0;
+    for (const LayerProperties &props : m_properties)
+        s += props.size();
+    return s;
+}
+
+void PropertyList::insertValues(const QString &layer, QVariantMap &properties) const {
+    const LayerProperties props = m_properties.value(layer);
+    for (auto i = props.constBegin(); i != props.constEnd(); ++i)
+        properties.insert(i.key(), i.value());
 }
 
 void LayoutPropertyList::apply_property(QMapLibre::Map *map, Property &p) {
@@ -184,8 +391,6 @@ void PaintPropertyList::apply_property(QMapLibre::Map *map, Property &p) {
 
 /// Images
 
-/// Layer
-
 ImageList::ImageAction::ImageAction(Type t, const QString id, const QImage im)
     : Action(t), m_image(id, im) {}
 
@@ -206,27 +411,64 @@ void ImageList::remove(const QString &id) {
     m_action_stack.append(ImageAction(Action::Remove, id));
 }
 
-void ImageList::apply(QMapLibre::Map *map) {
-    for (ImageAction &action : m_action_stack) {
+bool ImageList::apply(QMapLibre::Map *map, Budget &budget) {
+    int applied = 0;
+    for (; applied < m_action_stack.size() && budget.take(); ++applied) {
+        ImageAction &action = m_action_stack[applied];
         action.apply(map);
 
         if (action.type() == Action::Add)
-            m_images.append(action.image());
+            m_images.append(action.image().id, action.image());
 
-        else if (action.type() == Action::Remove) {
-            QMutableListIterator<Image> i(m_images);
-            while (i.hasNext())
-                if (i.next().id == action.image().id)
-                    i.remove();
-        }
+        else if (action.type() == Action::Remove)
+            m_images.remove(action.image().id);
     }
 
-    m_action_stack.clear();
+    m_action_stack.erase(m_action_stack.begin(), m_action_stack.begin() + applied);
+    return m_action_stack.isEmpty();
 }
 
-void ImageList::setup(QMapLibre::Map *map) {
-    for (Image &image : m_images) {
+void ImageList::setup() {
+    m_replay.clear();
+    for (const Image &image : m_images)
+        m_replay.append(image);
+}
+
+bool ImageList::replay(QMapLibre::Map *map, Budget &budget) {
+    while (!m_replay.isEmpty()) {
+        if (!budget.take())
+            return false;
+        Image image = m_replay.takeFirst();
         ImageAction action(Action::Add, image.id, image.image);
         action.apply(map);
     }
+    return true;
+}
+
+/// Image that is added and removed later in the stack is represented by
+/// its last removal as it could have been added earlier
+void ImageList::compact() {
+    QHash<QString, int> last;  ///< Index of the last action for each image
+    QHash<QString, int> count; ///< Number of actions for each image
+    for (int i = 0; i < m_action_stack.size(); ++i) {
+        const QString &id = m_action_stack[i].image().id;
+        last.insert(id, i);
+        count[id]++;
+    }
+
+    QSet<QString> compacted;
+    for (QHash<QString, int>::const_iterator i = last.constBegin(); i != last.constEnd(); ++i)
+        if (m_action_stack[i.value()].type() == Action::Remove && count.value(i.key()) > 1)
+            compacted.insert(i.key());
+
+    if (compacted.isEmpty())
+        return;
+
+    QList<ImageAction> stack;
+    for (int i = 0; i < m_action_stack.size(); ++i) {
+        const QString &id = m_action_stack[i].image().id;
+        if (!compacted.contains(id) || last.value(id) == i)
+            stack.append(m_action_stack[i]);
+    }
+    m_action_stack = stack;
 }
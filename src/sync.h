@@ -3,10 +3,19 @@
 
 #include <QMapLibre/Map>
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QImage>
 #include <QList>
+#include <QMutex>
+#include <QPointer>
+#include <QSet>
+#include <QSharedPointer>
 #include <QString>
 #include <QVariantMap>
+#include <QWaitCondition>
+
+#include <list>
 
 namespace QMapLibreSync {
 //////////////////////////////////////////////////////////////////////////
@@ -18,7 +27,20 @@ namespace QMapLibreSync {
 /// call method apply. On application, all manipulations are also recorded
 /// into an object variable that contains the list of all active assets.
 /// This allows to setup all the assets (add sources, layers, ...) when
-/// the map has been destroyed and recreated again. For that, call setup method.
+/// the map has been destroyed and recreated again. For that, call setup method
+/// that schedules all assets for replay and replay them using replay method.
+///
+/// Replay and application of actions can be spread over several calls
+/// by limiting the time given for each of the calls by Budget. Both replay
+/// and apply return true when all scheduled work has been done. Assets
+/// that are not applied within the budget are applied on the next call.
+///
+/// Pending actions of layers and images can be compacted before application
+/// by calling compact. Assets that are added and removed later in the same
+/// action list are represented by their removal only. Removal is kept as
+/// the asset could be on the map already, for example, as a part of the
+/// style. Sources are compacted in this way already on addition of the
+/// actions.
 ///
 /// Externally, users are expected to use SourceList, LayerList, ... classes
 
@@ -40,6 +62,111 @@ class Action {
     Type m_type;
 };
 
+//////////////////////////////////////////////////////////
+/// Time budget for application of actions
+
+class Budget {
+  public:
+    Budget(int ms); ///< Time in milliseconds, unlimited if ms <= 0
+
+    /// Returns true if the next action can be applied. The first
+    /// action is always allowed to ensure that application progresses.
+    bool take();
+
+    int taken() const { return m_taken; } ///< Number of actions allowed
+
+  private:
+    QElapsedTimer m_timer;
+    qint64 m_limit;
+    int m_taken{0};
+};
+
+//////////////////////////////////////////////////////////
+/// Ordered list of elements with lookup by id
+///
+/// Elements are kept in the order of insertion. Lookup, addition
+/// and removal of elements by their id is done in constant time.
+/// Appending an element with the id that is already present in the
+/// list replaces the old element and moves it to the end of the list.
+///
+/// Index refers to the elements of the list by iterators. On copy, the
+/// index is rebuilt for the copied elements. Moved list keeps its
+/// iterators valid.
+
+template <typename T> class IndexedList {
+  public:
+    typedef typename std::list<T>::iterator iterator;
+    typedef typename std::list<T>::const_iterator const_iterator;
+
+  public:
+    IndexedList() {}
+    IndexedList(const IndexedList &other) { copy(other); }
+    IndexedList(IndexedList &&other) = default;
+
+    IndexedList &operator=(const IndexedList &other) {
+        if (this != &other) {
+            clear();
+            copy(other);
+        }
+        return *this;
+    }
+    IndexedList &operator=(IndexedList &&other) = default;
+
+    iterator begin() { return m_items.begin(); }
+    iterator end() { return m_items.end(); }
+    const_iterator begin() const { return m_items.begin(); }
+    const_iterator end() const { return m_items.end(); }
+
+    int size() const { return m_index.size(); }
+    bool isEmpty() const { return m_index.isEmpty(); }
+    bool contains(const QString &id) const { return m_index.contains(id); }
+
+    T &first() { return m_items.front(); }
+
+    T *find(const QString &id) {
+        typename QHash<QString, iterator>::iterator i = m_index.find(id);
+        return i == m_index.end() ? nullptr : &(*i.value());
+    }
+
+    const T *find(const QString &id) const {
+        typename QHash<QString, iterator>::const_iterator i = m_index.constFind(id);
+        return i == m_index.constEnd() ? nullptr : &(*i.value());
+    }
+
+    void append(const QString &id, const T &item) {
+        remove(id);
+        m_index.insert(id, m_items.insert(m_items.end(), item));
+    }
+
+    bool remove(const QString &id) {
+        typename QHash<QString, iterator>::iterator i = m_index.find(id);
+        if (i == m_index.end())
+            return false;
+        m_items.erase(i.value());
+        m_index.erase(i);
+        return true;
+    }
+
+    void clear() {
+        m_items.clear();
+        m_index.clear();
+    }
+
+  private:
+    void copy(const IndexedList &other) {
+        QHash<const T *, QString> ids;
+        for (typename QHash<QString, iterator>::const_iterator i = other.m_index.constBegin();
+             i != other.m_index.constEnd(); ++i)
+            ids.insert(&(*i.value()), i.key());
+        for (const T &item : other.m_items)
+            m_index.insert(ids.value(&item), m_items.insert(m_items.end(), item));
+    }
+
+  private:
+    std::list<T> m_items;
+    QHash<QString, iterator> m_index;
+};
+
 //////////////////////////////////////////////////////////
 /// General asset that covers source and layer support
 
@@ -54,6 +181,38 @@ class Asset {
     QString before;
 };
 
+//////////////////////////////////////////////////////////
+/// Conversion of source data into the form accepted by the map
+///
+/// GeoJSON data given as QVariantMap has to be converted into JSON
+/// before it is passed to the map. As this can take a while for large
+/// datasets, conversion is started in the thread pool when the source
+/// is added or updated and only its result is used on application.
+/// When finished, the member of the receiver is invoked using queued
+/// connection to continue the application.
+
+class DataConversion {
+  public:
+    DataConversion(const QVariant &data);
+
+    /// Start conversion in the thread pool
+    static void start(const QSharedPointer<DataConversion> &conversion, QObject *receiver,
+                      const char *member);
+
+    void run(); ///< Called by the thread pool
+    bool done() const;
+    QByteArray result() const; ///< Waits for the conversion to finish
+    qint64 elapsed() const { return m_elapsed; } ///< Time used by conversion, in nanoseconds
+
+  private:
+    QVariant m_data;
+    QByteArray m_result;
+    qint64 m_elapsed{0};
+    bool m_done{false};
+    mutable QMutex m_mutex;
+    mutable QWaitCondition m_condition;
+};
+
 //////////////////////////////////////////////////////////
 /// Source support
 
@@ -65,25 +224,47 @@ class SourceList {
     void update(const QString &id, const QVariantMap &params);
     void remove(const QString &id);
 
-    void apply(QMapLibre::Map *map);
-    void setup(QMapLibre::Map *map);
+    /// Member of the receiver invoked when data conversion finishes
+    void setConversionReceiver(QObject *receiver, const char *member);
+    /// Application waits for the data conversion in the thread pool
+    bool converting() const;
+    /// Source exists after application of the pending actions
+    bool contains(const QString &id) const;
+
+    void setup();
+    bool replay(QMapLibre::Map *map, Budget &budget);
+    bool apply(QMapLibre::Map *map, Budget &budget);
+
+    int size() const { return m_assets.size(); } ///< Number of sources replayed on setup
+    const IndexedList<Asset> &assets() const { return m_assets; } ///< Sources applied to the map
+    qint64 conversion_time() const {
+        return m_conversion_time;
+    } ///< Time used for data conversion of sources applied last, in nanoseconds
 
   protected:
     class SourceAction : public Action {
       public:
-        SourceAction(Type t, const QString id, const QVariantMap params = QVariantMap());
+        SourceAction(Type t, const QString id, const QVariantMap params = QVariantMap(),
+                     QObject *receiver = nullptr, const char *member = nullptr);
         virtual void apply(QMapLibre::Map *map);
         Asset &asset() { return m_asset; }
+        bool ready() const { return !m_conversion || m_conversion->done(); } ///< Data converted
+        qint64 conversion_time() const { return m_conversion ? m_conversion->elapsed() : 0; }
 
       protected:
         Asset m_asset;
+        QSharedPointer<DataConversion> m_conversion;
     };
 
     void add_to_stack(Action::Type t, const QString &id, const QVariantMap &params);
 
   protected:
-    QList<Asset> m_assets;
-    QList<SourceAction> m_action_stack;
+    IndexedList<Asset> m_assets;
+    IndexedList<SourceAction> m_action_stack; ///< Only the last action is kept for each source
+    QPointer<QObject> m_receiver;
+    QByteArray m_member;
+    QList<Asset> m_replay;
+    qint64 m_conversion_time{0};
 };
 
 //////////////////////////////////////////////////////////
@@ -96,8 +277,13 @@ class LayerList {
     void add(const QString &id, const QVariantMap &params, const QString &before);
     void remove(const QString &id);
 
-    void apply(QMapLibre::Map *map);
-    void setup(QMapLibre::Map *map);
+    void setup();
+    bool replay(QMapLibre::Map *map, Budget &budget);
+    bool apply(QMapLibre::Map *map, Budget &budget);
+    QSet<QString> compact(); ///< Returns layers that are only removed after compaction
+
+    int size() const { return m_assets.size(); } ///< Number of layers replayed on setup
+    const IndexedList<Asset> &assets() const { return m_assets; } ///< Layers applied to the map
 
   protected:
     class LayerAction : public Action {
@@ -112,8 +298,9 @@ class LayerList {
     };
 
   protected:
-    QList<Asset> m_assets;
+    IndexedList<Asset> m_assets;
     QList<LayerAction> m_action_stack;
+    QList<Asset> m_replay;
 };
 
 ///////////////////////////////////////////////////////////
@@ -135,16 +322,35 @@ class PropertyList {
     PropertyList() {}
 
     void add(const QString &layer, const QString &property, const QVariant &value);
+    void remove_layer(const QString &layer); ///< Drop all properties recorded for the layer
+
+    void setup();
+    bool replay(QMapLibre::Map *map, Budget &budget);
+    bool apply(QMapLibre::Map *map, Budget &budget);
 
-    void apply(QMapLibre::Map *map);
-    void setup(QMapLibre::Map *map);
+    int size() const;                          ///< Number of properties replayed on setup
+    int replayed() const { return m_replayed; } ///< Number of properties applied by last setup
+    /// Insert values of the properties applied to the map for the layer,
+    /// replacing the values given in properties
+    void insertValues(const QString &layer, QVariantMap &properties) const;
 
   protected:
     virtual void apply_property(QMapLibre::Map *map, Property &p) = 0;
 
   protected:
-    QList<Property> m_properties;
-    QList<Property> m_action_stack;
+    /// Properties are stored by layer and property name. Only the
+    /// last value of each property is kept, ensuring that the cost of
+    /// setup is determined by the number of properties in use and not
+    /// by the number of changes made during the session.
+    typedef QHash<QString, QVariant> LayerProperties;
+
+    void apply_layer(QMapLibre::Map *map, const QString &layer, const LayerProperties &props);
+
+  protected:
+    QHash<QString, LayerProperties> m_properties;
+    QHash<QString, LayerProperties> m_action_stack;
+    QHash<QString, LayerProperties> m_replay;
+    int m_replayed{0};
 };
 
 class LayoutPropertyList : public PropertyList {
@@ -183,8 +389,13 @@ class ImageList {
     void add(const QString &id, const QImage &sprite);
     void remove(const QString &id);
 
-    void apply(QMapLibre::Map *map);
-    void setup(QMapLibre::Map *map);
+    void setup();
+    bool replay(QMapLibre::Map *map, Budget &budget);
+    bool apply(QMapLibre::Map *map, Budget &budget);
+    void compact();
+
+    int size() const { return m_images.size(); } ///< Number of images replayed on setup
+    const IndexedList<Image> &images() const { return m_images; } ///< Images applied to the map
 
   protected:
     class ImageAction : public Action {
@@ -198,8 +409,9 @@ class ImageList {
     };
 
   protected:
-    QList<Image> m_images;
+    IndexedList<Image> m_images;
     QList<ImageAction> m_action_stack;
+    QList<Image> m_replay;
 };
 
 } // namespace QMapLibreSync
@@ -0,0 +1,27 @@
+#include "tasknotifier.h"
+
+#include <QMetaObject>
+
+TaskNotifier::TaskNotifier(QObject *receiver, const char *member)
+    : QObject(), m_receiver(receiver), m_member(member) {
+    moveToThread(receiver->thread());
+}
+
+void TaskNotifier::notify() { notify(std::function<void(QObject *)>()); }
+
+/// Posting to the notifier is safe as it is deleted only by deliver
+void TaskNotifier::notify(const std::function<void(QObject *)> &callback) {
+    m_callback = callback;
+    QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+
+void TaskNotifier::deliver() {
+    if (m_receiver) {
+        if (m_callback)
+            m_callback(m_receiver.data());
+        else if (!m_member.isEmpty())
+            QMetaObject::invokeMethod(m_receiver.data(), m_member.constData(),
+                                      Qt::DirectConnection);
+    }
+    deleteLater();
+}
@@ -0,0 +1,38 @@
+#ifndef TASKNOTIFIER_H
+#define TASKNOTIFIER_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QPointer>
+
+#include <functional>
+
+//////////////////////////////////////////////////////////////////////////
+/// TaskNotifier delivers the completion of a task running in the thread
+/// pool to a receiver living in another thread. Notifier is created in
+/// the thread of the receiver when the task is started and is only posted
+/// to by the task. The receiver is checked in its own thread on delivery,
+/// so it can be destroyed while the task is running. Notifier deletes
+/// itself after the delivery, notify has to be called exactly once.
+
+class TaskNotifier : public QObject {
+    Q_OBJECT
+
+  public:
+    TaskNotifier(QObject *receiver, const char *member);
+
+    /// Invoke the member of the receiver in its thread. Called by the task
+    void notify();
+    /// Call the callback with the receiver in its thread. Called by the task
+    void notify(const std::function<void(QObject *receiver)> &callback);
+
+  private slots:
+    void deliver();
+
+  private:
+    QPointer<QObject> m_receiver; ///< Used only in the thread of the receiver
+    QByteArray m_member;
+    std::function<void(QObject *)> m_callback;
+};
+
+#endif // TASKNOTIFIER_H
@@ -0,0 +1,359 @@
+#include "threadedtexturenode.h"
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+
+#if IS_QT5
+#include "qt5/textureplain.h"
+#endif
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QtQuick/QQuickWindow>
+
+#include <QDebug>
+
+//////////////////////////////////////////
+/// RenderThread
+
+RenderThread::RenderThread(QMapLibre::Map *map, QOpenGLContext *shareContext,
+                           const QSharedPointer<QOffscreenSurface> &surface)
+    : QThread(), m_map(map), m_surface(surface) {
+    m_context.reset(new QOpenGLContext);
+    m_context->setFormat(shareContext->format());
+    m_context->setShareContext(shareContext);
+    if (!m_context->create())
+        qWarning() << "RenderThread: failed to create shared GL context";
+    m_context->moveToThread(this);
+}
+
+RenderThread::~RenderThread() { stop(); }
+
+void RenderThread::setSize(const QSize &size, const QSize &fboSize) {
+    QMutexLocker lk(&m_mutex);
+    m_size = size;
+    m_fbo_size = fboSize;
+}
+
+void RenderThread::requestFrame() {
+    QMutexLocker lk(&m_mutex);
+    if (m_stop)
+        return;
+    m_requested = true;
+    m_busy = true;
+    m_condition.wakeOne();
+}
+
+void RenderThread::stop() {
+    {
+        QMutexLocker lk(&m_mutex);
+        m_stop = true;
+        m_busy = false;
+        m_condition.wakeOne();
+    }
+    wait();
+}
+
+bool RenderThread::busy() const {
+    QMutexLocker lk(&m_mutex);
+    return m_busy;
+}
+
+qint64 RenderThread::droppedFrames() const {
+    QMutexLocker lk(&m_mutex);
+    return m_dropped;
+}
+
+qint64 RenderThread::fboAllocations() const {
+    QMutexLocker lk(&m_mutex);
+    return m_allocations;
+}
+
+qint64 RenderThread::frameTime() const {
+    QMutexLocker lk(&m_mutex);
+    return m_frame_time;
+}
+
+bool RenderThread::takeFrame(GLuint &texture, QSize &textureSize, QSize &size) {
+    QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+    GLsync fence;
+    bool released = false;
+    {
+        QMutexLocker lk(&m_mutex);
+        if (m_finished < 0 || m_finished == m_shown)
+            return false;
+
+        // commands sampling the previously shown frame have been issued
+        // already, the frame can be reused once they are done
+        if (m_shown >= 0 && m_use_fences) {
+            Frame &previous = m_frames[m_shown];
+            if (previous.released)
+                f->glDeleteSync(previous.released);
+            previous.released = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            released = true;
+        }
+
+        m_shown = m_finished;
+        Frame &frame = m_frames[m_shown];
+        texture = frame.fbo->texture();
+        textureSize = frame.fbo->size();
+        size = frame.size;
+        fence = frame.fence;
+        frame.fence = nullptr;
+    }
+
+    // fence has to be flushed before it is waited for in the render thread
+    if (released)
+        f->glFlush();
+
+    // scene graph commands using the frame are queued after the
+    // rendering of the frame on GPU without waiting for it on CPU
+    if (fence) {
+        f->glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+        f->glDeleteSync(fence);
+    }
+    return true;
+}
+
+/// Reads of the frame are fenced by MapImageReader for fetching the pixels
+/// and its fence is deleted when the pixels are fetched. So, a separate
+/// fence is used to protect the frame
+void RenderThread::fenceShownFrameRead() {
+    QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+    {
+        QMutexLocker lk(&m_mutex);
+        if (m_shown < 0 || !m_use_fences)
+            return;
+        Frame &frame = m_frames[m_shown];
+        if (frame.read)
+            f->glDeleteSync(frame.read);
+        frame.read = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    f->glFlush();
+}
+
+void RenderThread::run() {
+    if (!m_context->makeCurrent(m_surface.data())) {
+        qWarning() << "RenderThread: failed to make GL context current, map is not rendered";
+        QMutexLocker lk(&m_mutex);
+        m_stop = true;
+        m_busy = false;
+        return;
+    }
+
+    QOpenGLExtraFunctions *f = m_context->extraFunctions();
+    const QSurfaceFormat format = m_context->format();
+    if (m_context->isOpenGLES())
+        m_use_fences = format.majorVersion() >= 3;
+    else
+        m_use_fences =
+            format.version() >= qMakePair(3, 2) || m_context->hasExtension("GL_ARB_sync");
+
+    // renderer is created and destroyed with the context of this thread current as
+    // its vertex arrays and framebuffers are not shared with the scene graph context
+    m_map->createRenderer();
+
+    forever {
+        int target = 0;
+        QSize size, fbSize;
+        GLsync released, read;
+        {
+            QMutexLocker lk(&m_mutex);
+            while (!m_requested && !m_stop)
+                m_condition.wait(&m_mutex);
+            if (m_stop)
+                break;
+            m_requested = false;
+            while (target == m_shown || target == m_finished)
+                ++target;
+            size = m_size;
+            fbSize = m_fbo_size;
+            released = m_frames[target].released;
+            read = m_frames[target].read;
+            m_frames[target].released = nullptr;
+            m_frames[target].read = nullptr;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+
+        // frame is not shown by the scene graph, commands that used it
+        // before are finished on GPU before the frame is changed
+        Frame &frame = m_frames[target];
+        for (GLsync sync : {released, read})
+            if (sync) {
+                f->glWaitSync(sync, 0, GL_TIMEOUT_IGNORED);
+                f->glDeleteSync(sync);
+            }
+        if (frame.fence) {
+            f->glDeleteSync(frame.fence);
+            frame.fence = nullptr;
+        }
+
+        bool allocated = false;
+        if (!frame.fbo || !BaseTextureNode::fboFits(frame.fbo->size(), fbSize)) {
+            QOpenGLFramebufferObjectFormat fmt;
+            fmt.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+            fmt.setTextureTarget(GL_TEXTURE_2D);
+            fmt.setInternalTextureFormat(GL_RGBA);
+            frame.fbo.reset(new QOpenGLFramebufferObject(BaseTextureNode::fboSize(fbSize), fmt));
+            allocated = true;
+        }
+        frame.size = size;
+
+        f->glViewport(0, 0, size.width(), size.height());
+        frame.fbo->bind();
+        m_map->setOpenGLFramebufferObject(static_cast<quint32>(frame.fbo->handle()), size);
+        m_map->render();
+        frame.fbo->release();
+
+        GLsync fence = nullptr;
+        if (m_use_fences) {
+            fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            f->glFlush();
+        } else
+            f->glFinish();
+        const qint64 elapsed = timer.nsecsElapsed();
+
+        {
+            QMutexLocker lk(&m_mutex);
+            frame.fence = fence;
+            m_frame_time = elapsed;
+            if (allocated)
+                m_allocations++;
+            if (m_finished >= 0 && m_finished != m_shown)
+                m_dropped++;
+            m_finished = target;
+            m_busy = false;
+        }
+
+        emit frameReady();
+    }
+
+    for (Frame &frame : m_frames) {
+        if (frame.fence)
+            f->glDeleteSync(frame.fence);
+        if (frame.released)
+            f->glDeleteSync(frame.released);
+        if (frame.read)
+            f->glDeleteSync(frame.read);
+        frame.fence = nullptr;
+        frame.released = nullptr;
+        frame.read = nullptr;
+        frame.fbo.reset();
+    }
+
+    m_map->destroyRenderer();
+    m_context->doneCurrent();
+}
+
+//////////////////////////////////////////
+/// ThreadedTextureNode
+
+ThreadedTextureNode::ThreadedTextureNode(const QMapLibre::Settings &settings, const QSize &size,
+                                         qreal devicePixelRatio, qreal pixelRatio,
+                                         QQuickItem *item,
+                                         const QSharedPointer<QOffscreenSurface> &surface)
+    : BaseTextureNode(settings, size, devicePixelRatio, pixelRatio, item), m_surface(surface) {
+    qInfo() << "Using ThreadedTextureNode for map rendering."
+            << "devicePixelRatio:" << devicePixelRatio;
+
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context || !m_surface) {
+        qWarning() << "ThreadedTextureNode: no current QOpenGLContext or surface, map is not "
+                      "rendered";
+    } else {
+        m_thread.reset(new RenderThread(m_map.data(), context, m_surface));
+        QObject::connect(m_thread.get(), &RenderThread::frameReady, item, &QQuickItem::update);
+    }
+
+    resize(size, pixelRatio);
+
+    if (m_thread)
+        m_thread->start();
+}
+
+ThreadedTextureNode::~ThreadedTextureNode() {
+    // GL resources of the map are released in the render thread
+    if (m_thread)
+        m_thread->stop();
+}
+
+void ThreadedTextureNode::resize(const QSize &size, qreal pixelRatio) {
+    const QSize minSize = size.expandedTo(MIN_TEXTURE_SIZE);
+    BaseNode::resize(minSize, pixelRatio);
+
+    const QSize fbSize = minSize * m_device_pixel_ratio;         // physical pixels
+    m_map_size = minSize * m_device_pixel_ratio / m_pixel_ratio; // ensure zoom
+
+    m_map->resize(m_map_size);
+    if (m_thread)
+        m_thread->setSize(renderSize(fbSize), fbSize);
+
+    setRect(QRectF(QPointF(), minSize));
+}
+
+void ThreadedTextureNode::render(QQuickWindow *) {
+    if (m_thread)
+        m_thread->requestFrame();
+}
+
+bool ThreadedTextureNode::present(QQuickWindow *window) {
+    GLuint id;
+    QSize textureSize, size;
+    if (!m_thread || !m_thread->takeFrame(id, textureSize, size))
+        return false;
+
+#if IS_QT5
+    Q_UNUSED(window);
+    MLNQT5::TexturePlain *t = static_cast<MLNQT5::TexturePlain *>(texture());
+    if (!t) {
+        t = new MLNQT5::TexturePlain;
+        t->setOwnsTexture(false); // texture is owned by framebuffer
+        setTexture(t);
+        setOwnsTexture(true);
+    }
+    t->setTextureId(id);
+    t->setTextureSize(textureSize);
+#else
+    std::unique_ptr<QSGTexture> &entry = m_textures[id];
+    if (!entry || entry->textureSize() != textureSize) {
+        std::unique_ptr<QSGTexture> t(QNativeInterface::QSGOpenGLTexture::fromNative(
+            id, window, textureSize, QQuickWindow::TextureHasAlphaChannel));
+        setTexture(t.get());
+        entry = std::move(t);
+    } else
+        setTexture(entry.get());
+    setOwnsTexture(false);
+
+    // framebuffers with the old textureSize are dropped by the render thread
+    if (textureSize != m_texture_size)
+        for (auto i = m_textures.begin(); i != m_textures.end();)
+            if (i->first != id)
+                i = m_textures.erase(i);
+            else
+                ++i;
+    m_texture_size = textureSize;
+#endif
+
+    m_shown_texture = id;
+    m_shown_size = size;
+    setMapTextureRect(size);
+    return true;
+}
+
+bool ThreadedTextureNode::readImage(const MapImageReader::Request &request) {
+    if (!m_thread || !BaseTextureNode::readImage(request))
+        return false;
+    m_thread->fenceShownFrameRead();
+    return true;
+}
+
+bool ThreadedTextureNode::shownTexture(GLuint &texture, QSize &size) const {
+    if (!m_shown_texture)
+        return false;
+    texture = m_shown_texture;
+    size = m_shown_size;
+    return true;
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef THREADEDTEXTURENODE_H
+#define THREADEDTEXTURENODE_H
+
+#include "macros.h"
+
+#if IS_QT5 || defined(MLN_RENDER_BACKEND_OPENGL)
+
+#include "basetexturenode.h"
+
+#include <QMutex>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QSharedPointer>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtGui/qopengl.h>
+
+#include <map>
+#include <memory>
+
+//////////////////////////////////////////////////////////////////////////
+/// RenderThread renders the map in its own thread using GL context shared
+/// with the scene graph. Frames are rendered into a ring of three
+/// framebuffers: one shown by the scene graph, one finished last, and
+/// one rendered into. Finishing of GPU commands of a frame is marked by
+/// a fence that the scene graph waits for on GPU before using the frame.
+/// In the same way, when the scene graph stops showing a frame, a fence is
+/// inserted behind its last use and the render thread waits for it on GPU
+/// before rendering into the frame again. Reads of the shown frame into
+/// map images are fenced as well.
+///
+/// Map is changed by the scene graph thread only while no frame is
+/// rendered, see busy().
+
+class RenderThread : public QThread {
+    Q_OBJECT
+
+  public:
+    RenderThread(QMapLibre::Map *map, QOpenGLContext *shareContext,
+                 const QSharedPointer<QOffscreenSurface> &surface);
+    ~RenderThread();
+
+    /// Size of the map in physical pixels and of the framebuffers allocated for it
+    void setSize(const QSize &size, const QSize &fboSize);
+    void requestFrame();             ///< Start rendering of the next frame
+    void stop();                     ///< Finish rendering and release GL resources
+
+    bool busy() const; ///< Frame is rendered
+
+    /// Take the last finished frame if it has not been taken yet. Map of
+    /// the given size is in the bottom left corner of the texture. Has to
+    /// be called with the scene graph context current
+    bool takeFrame(GLuint &texture, QSize &textureSize, QSize &size);
+
+    /// Insert a fence behind the commands reading the shown frame. The
+    /// frame is not rendered into before the fence is signaled. Has to be
+    /// called with the scene graph context current
+    void fenceShownFrameRead();
+
+    qint64 droppedFrames() const; ///< Frames finished but replaced before taken
+    qint64 fboAllocations() const;
+    qint64 frameTime() const; ///< Time used to render the last frame, in nanoseconds
+
+  signals:
+    void frameReady();
+
+  protected:
+    void run() override;
+
+  private:
+    struct Frame {
+        std::unique_ptr<QOpenGLFramebufferObject> fbo;
+        QSize size; ///< Part of the framebuffer used by the map
+        GLsync fence{nullptr};    ///< Rendering of the frame finished
+        GLsync released{nullptr}; ///< Scene graph finished using the frame
+        GLsync read{nullptr};     ///< Frame was read into map images
+    };
+
+    static const int FrameCount = 3;
+
+    QMapLibre::Map *m_map;
+    QSharedPointer<QOffscreenSurface> m_surface;
+    std::unique_ptr<QOpenGLContext> m_context;
+    bool m_use_fences{false};
+
+    mutable QMutex m_mutex; ///< Protects the state below
+    QWaitCondition m_condition;
+    Frame m_frames[FrameCount];
+    QSize m_size;
+    QSize m_fbo_size;
+    int m_shown{-1};    ///< Frame used by the scene graph
+    int m_finished{-1}; ///< Last finished frame
+    bool m_requested{false};
+    bool m_busy{false};
+    bool m_stop{false};
+    qint64 m_dropped{0};
+    qint64 m_allocations{0};
+    qint64 m_frame_time{0};
+};
+
+//////////////////////////////////////////////////////////////////////////
+/// ThreadedTextureNode shows the map rendered by RenderThread
+
+class ThreadedTextureNode : public BaseTextureNode {
+    Q_OBJECT
+
+  public:
+    ThreadedTextureNode(const QMapLibre::Settings &, const QSize &, qreal devicePixelRatio,
+                        qreal pixelRatio, QQuickItem *item,
+                        const QSharedPointer<QOffscreenSurface> &surface);
+    ~ThreadedTextureNode();
+
+    void resize(const QSize &size, qreal pixelRatio) override;
+    void render(QQuickWindow *) override;
+
+    bool busy() const override { return m_thread && m_thread->busy(); }
+    bool present(QQuickWindow *window) override;
+    bool readImage(const MapImageReader::Request &request) override;
+    qint64 droppedFrames() const override { return m_thread ? m_thread->droppedFrames() : 0; }
+    qint64 fboAllocations() const override { return m_thread ? m_thread->fboAllocations() : 0; }
+    qint64 frameTime() const override { return m_thread ? m_thread->frameTime() : -1; }
+
+  protected:
+    bool shownTexture(GLuint &texture, QSize &size) const override;
+
+  private:
+    std::unique_ptr<RenderThread> m_thread;
+    QSharedPointer<QOffscreenSurface> m_surface;
+    GLuint m_shown_texture{0};
+    QSize m_shown_size; ///< Part of the shown texture used by the map
+#if IS_QT6
+    std::map<GLuint, std::unique_ptr<QSGTexture>> m_textures; ///< Textures of the framebuffers
+    QSize m_texture_size;
+#endif
+};
+
+#endif
+
+#endif // THREADEDTEXTURENODE_H
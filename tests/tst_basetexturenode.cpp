@@ -0,0 +1,77 @@
+#include "basetexturenode.h"
+
+#include <QtTest/QtTest>
+
+//////////////////////////////////////////////////////////////////////////
+/// Tests of the framebuffer size buckets shared by the texture nodes
+
+class TestBaseTextureNode : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void fboSize_data();
+    void fboSize();
+    void fboFits_data();
+    void fboFits();
+    void resizeSteps();
+};
+
+void TestBaseTextureNode::fboSize_data() {
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<QSize>("expected");
+    QTest::newRow("smallest") << QSize(1, 1) << QSize(128, 128);
+    QTest::newRow("step") << QSize(128, 256) << QSize(128, 256);
+    QTest::newRow("above step") << QSize(129, 257) << QSize(256, 384);
+    QTest::newRow("phone") << QSize(1080, 2340) << QSize(1152, 2432);
+}
+
+/// Framebuffer is allocated in steps of 128 pixels
+void TestBaseTextureNode::fboSize() {
+    QFETCH(QSize, size);
+    QFETCH(QSize, expected);
+    QCOMPARE(BaseTextureNode::fboSize(size), expected);
+}
+
+void TestBaseTextureNode::fboFits_data() {
+    QTest::addColumn<QSize>("fbo");
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<bool>("expected");
+    QTest::newRow("same bucket") << QSize(256, 256) << QSize(200, 150) << true;
+    QTest::newRow("bucket below") << QSize(256, 256) << QSize(100, 100) << true;
+    QTest::newRow("too small") << QSize(256, 256) << QSize(300, 200) << false;
+    QTest::newRow("too small height") << QSize(256, 256) << QSize(200, 257) << false;
+    QTest::newRow("too large") << QSize(384, 256) << QSize(100, 200) << false;
+}
+
+/// Framebuffer is reused if it is large enough and at most one step
+/// larger than the bucket of the map
+void TestBaseTextureNode::fboFits() {
+    QFETCH(QSize, fbo);
+    QFETCH(QSize, size);
+    QFETCH(bool, expected);
+    QCOMPARE(BaseTextureNode::fboFits(fbo, size), expected);
+}
+
+/// Framebuffer allocated for a size fits it, and resizing back and forth
+/// across a bucket boundary allocates only once
+void TestBaseTextureNode::resizeSteps() {
+    for (int w = 1; w <= 1000; w += 7) {
+        const QSize size(w, 1000 - w);
+        QVERIFY(BaseTextureNode::fboFits(BaseTextureNode::fboSize(size), size));
+    }
+
+    QSize fbo = BaseTextureNode::fboSize(QSize(500, 300));
+    int allocations = 0;
+    for (int i = 0; i < 10; ++i) {
+        const QSize size = i % 2 ? QSize(500, 300) : QSize(520, 300);
+        if (!BaseTextureNode::fboFits(fbo, size)) {
+            fbo = BaseTextureNode::fboSize(size);
+            ++allocations;
+        }
+    }
+    QCOMPARE(allocations, 1);
+}
+
+QTEST_GUILESS_MAIN(TestBaseTextureNode)
+
+#include "tst_basetexturenode.moc"
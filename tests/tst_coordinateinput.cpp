@@ -0,0 +1,184 @@
+#include "coordinateinput.h"
+
+#include <QGeoCoordinate>
+#include <QJSEngine>
+#include <QJSValue>
+#include <QJsonDocument>
+#include <QtTest/QtTest>
+
+//////////////////////////////////////////////////////////////////////////
+/// Tests of reading coordinates given through the API and benchmarks
+/// comparing construction of line sources from lists of QGeoCoordinate
+/// through GeoJSON with the typed array path
+
+class TestCoordinateInput : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void arrayBuffer();
+    void typedArrayView();
+    void indexedMap();
+    void invalidInput();
+    void points();
+
+    void lineGeoJson_data();
+    void lineGeoJson();
+    void lineGeoCoordinates_data();
+    void lineGeoCoordinates();
+    void lineTypedArray_data();
+    void lineTypedArray();
+
+  private:
+    QJSEngine m_engine;
+};
+
+namespace {
+void addCounts() {
+    QTest::addColumn<int>("count");
+    for (int count : {1000, 10000, 100000})
+        QTest::newRow(qPrintable(QString::number(count))) << count;
+}
+
+QVariantList geoLine(int count) {
+    QVariantList line;
+    for (int i = 0; i < count; ++i)
+        line.append(QVariant::fromValue(QGeoCoordinate(59 + i * 1e-5, 24 + i * 1e-5)));
+    return line;
+}
+
+QByteArray lonLatLine(int count) {
+    QByteArray bytes(count * 2 * sizeof(double), Qt::Uninitialized);
+    double *d = reinterpret_cast<double *>(bytes.data());
+    for (int i = 0; i < count; ++i) {
+        d[2 * i] = 24 + i * 1e-5;
+        d[2 * i + 1] = 59 + i * 1e-5;
+    }
+    return bytes;
+}
+
+QMapLibre::Feature lineFeature(const QMapLibre::Coordinates &coordinates) {
+    return QMapLibre::Feature(
+        QMapLibre::Feature::LineStringType,
+        QMapLibre::CoordinatesCollections(1, QMapLibre::CoordinatesCollection(1, coordinates)));
+}
+} // namespace
+
+void TestCoordinateInput::arrayBuffer() {
+    QMapLibre::Coordinates coordinates;
+    QVERIFY(CoordinateInput::lonLat(lonLatLine(3), coordinates));
+    QCOMPARE(coordinates.size(), 3);
+    QCOMPARE(coordinates[1].first, 59 + 1e-5);
+    QCOMPARE(coordinates[1].second, 24 + 1e-5);
+}
+
+/// Only the elements of the view are used, not its full buffer
+void TestCoordinateInput::typedArrayView() {
+    const QJSValue view =
+        m_engine.evaluate("new Float64Array([0, 1, 2, 3, 4, 5, 6, 7]).subarray(2, 6)");
+    QVERIFY(!view.isError());
+
+    QMapLibre::Coordinates coordinates;
+    QVERIFY(CoordinateInput::lonLat(QVariant::fromValue(view), coordinates));
+    QCOMPARE(coordinates.size(), 2);
+    QCOMPARE(coordinates[0], QMapLibre::Coordinate(3, 2));
+    QCOMPARE(coordinates[1], QMapLibre::Coordinate(5, 4));
+
+    QVector<double> values;
+    QVERIFY(CoordinateInput::doubles(QVariant::fromValue(view), values));
+    QCOMPARE(values, QVector<double>({2, 3, 4, 5}));
+}
+
+/// Typed arrays are given by Qt 5 as a map with indices as keys
+void TestCoordinateInput::indexedMap() {
+    QVariantMap map;
+    for (int i = 0; i < 12; ++i)
+        map.insert(QString::number(i), double(i));
+
+    QVector<double> values;
+    QVERIFY(CoordinateInput::doubles(map, values));
+    QCOMPARE(values.size(), 12);
+    for (int i = 0; i < values.size(); ++i)
+        QCOMPARE(values[i], double(i));
+}
+
+void TestCoordinateInput::invalidInput() {
+    QMapLibre::Coordinates coordinates;
+    QVERIFY(!CoordinateInput::lonLat(QByteArray(3 * sizeof(double), 0), coordinates));
+    QVERIFY(!CoordinateInput::lonLat(QVariantList({1.0, 2.0, 3.0}), coordinates));
+
+    QVector<double> values;
+    QVERIFY(!CoordinateInput::doubles(QByteArray(12, 0), values));
+    const QJSValue ints = m_engine.evaluate("new Int32Array([1, 2])");
+    QVERIFY(!CoordinateInput::doubles(QVariant::fromValue(ints), values));
+}
+
+/// Pixels are given as points or interleaved x and y. Odd number of values
+/// and buffers with size that is not a multiple of 16 bytes are rejected
+void TestCoordinateInput::points() {
+    QVector<QPointF> points;
+    QVERIFY(CoordinateInput::points(QVariantList({QPointF(1, 2), QPointF(3, 4)}), points));
+    QCOMPARE(points, QVector<QPointF>({QPointF(1, 2), QPointF(3, 4)}));
+
+    QVERIFY(CoordinateInput::points(QVariantList({1.0, 2.0, 3.0, 4.0}), points));
+    QCOMPARE(points, QVector<QPointF>({QPointF(1, 2), QPointF(3, 4)}));
+
+    QVERIFY(!CoordinateInput::points(QVariantList({1.0, 2.0, 3.0}), points));
+    QVERIFY(!CoordinateInput::points(QByteArray(3 * sizeof(double), 0), points));
+    QVERIFY(!CoordinateInput::points(QByteArray(20, 0), points));
+}
+
+void TestCoordinateInput::lineGeoJson_data() { addCounts(); }
+
+/// Line given as QGeoCoordinate list and converted into GeoJSON, as done
+/// before the typed array path
+void TestCoordinateInput::lineGeoJson() {
+    QFETCH(int, count);
+    const QVariantList line = geoLine(count);
+
+    QBENCHMARK {
+        QVariantList coor;
+        for (const QVariant &v : line) {
+            const QGeoCoordinate c = v.value<QGeoCoordinate>();
+            coor.append(QVariant(QVariantList({c.longitude(), c.latitude()})));
+        }
+        QVariantMap geometry({{"type", "LineString"}, {"coordinates", coor}});
+        QVariantMap data(
+            {{"type", "Feature"}, {"properties", QVariantMap()}, {"geometry", geometry}});
+        QVERIFY(!QJsonDocument::fromVariant(data).toJson(QJsonDocument::Compact).isEmpty());
+    }
+}
+
+void TestCoordinateInput::lineGeoCoordinates_data() { addCounts(); }
+
+/// Line given as QGeoCoordinate list and passed to the map as a feature
+void TestCoordinateInput::lineGeoCoordinates() {
+    QFETCH(int, count);
+    const QVariantList line = geoLine(count);
+
+    QBENCHMARK {
+        QMapLibre::Coordinates coordinates;
+        int invalid = -1;
+        QVERIFY(CoordinateInput::geo(line, coordinates, invalid));
+        QCOMPARE(lineFeature(coordinates).geometry.first().first().size(), count);
+    }
+}
+
+void TestCoordinateInput::lineTypedArray_data() { addCounts(); }
+
+/// Line given as Float64Array and passed to the map as a feature
+void TestCoordinateInput::lineTypedArray() {
+    QFETCH(int, count);
+    const QJSValue buffer = m_engine.toScriptValue(lonLatLine(count));
+    m_engine.globalObject().setProperty("lineBuffer", buffer);
+    const QVariant line = QVariant::fromValue(m_engine.evaluate("new Float64Array(lineBuffer)"));
+
+    QBENCHMARK {
+        QMapLibre::Coordinates coordinates;
+        QVERIFY(CoordinateInput::lonLat(line, coordinates));
+        QCOMPARE(lineFeature(coordinates).geometry.first().first().size(), count);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestCoordinateInput)
+
+#include "tst_coordinateinput.moc"
@@ -0,0 +1,339 @@
+#include "featurequery.h"
+
+#include <QJsonDocument>
+#include <QMapLibre/Map>
+#include <QMapLibre/Settings>
+#include <QPolygonF>
+#include <QtTest/QtTest>
+
+//////////////////////////////////////////////////////////////////////////
+/// Tests of the filters of both syntaxes and of the hit test used to
+/// find features drawn by the layers within an area of the map
+
+class TestFeatureQuery : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();
+
+    void isExpression_data();
+    void isExpression();
+    void legacyFilter_data();
+    void legacyFilter();
+    void expressionFilter_data();
+    void expressionFilter();
+    void invalidFilter_data();
+    void invalidFilter();
+    void tolerance_data();
+    void tolerance();
+    void hitTest_data();
+    void hitTest();
+    void find();
+
+  private:
+    QMapLibre::Feature feature(QMapLibre::Feature::Type type, const QVector<QPolygonF> &rings,
+                               const QVariantMap &properties = QVariantMap()) const;
+
+  private:
+    QScopedPointer<QMapLibre::Map> m_map;
+};
+
+namespace {
+const QSize mapSize(400, 300);
+const QPointF center(200, 150);
+const double zoom = 12;
+
+/// Filters and styles are given as JSON, as they are in the styles
+QVariant json(const QString &text) {
+    QJsonParseError error;
+    const QJsonDocument doc = QJsonDocument::fromJson(text.toUtf8(), &error);
+    if (error.error != QJsonParseError::NoError)
+        qFatal("Invalid JSON in test data: %s", qPrintable(text));
+    return doc.toVariant();
+}
+
+/// Feature used by the filter tests
+QMapLibre::Feature filtered() {
+    QVariantMap properties;
+    properties.insert("name", "Main street");
+    properties.insert("kind", "cafe");
+    properties.insert("rank", 3);
+    properties.insert("open", true);
+    const QMapLibre::Coordinates coordinates{QMapLibre::Coordinate(59.43, 24.74)};
+    const QMapLibre::CoordinatesCollection collection{coordinates};
+    return QMapLibre::Feature(QMapLibre::Feature::PointType, {collection}, properties, "a");
+}
+
+void addFilterColumns() {
+    QTest::addColumn<QString>("filter");
+    QTest::addColumn<bool>("expected");
+}
+
+QRectF point(const QPointF &p) { return QRectF(p, QSizeF()); }
+} // namespace
+
+void TestFeatureQuery::initTestCase() {
+    QMapLibre::Settings settings;
+    settings.setCacheDatabasePath(":memory:");
+    m_map.reset(new QMapLibre::Map(nullptr, settings, mapSize, 1));
+    m_map->setCoordinateZoom(QMapLibre::Coordinate(59.43, 24.74), zoom);
+}
+
+/// Feature with the geometry given in map pixels
+QMapLibre::Feature TestFeatureQuery::feature(QMapLibre::Feature::Type type,
+                                             const QVector<QPolygonF> &rings,
+                                             const QVariantMap &properties) const {
+    QMapLibre::CoordinatesCollection collection;
+    for (const QPolygonF &ring : rings) {
+        QMapLibre::Coordinates coordinates;
+        for (const QPointF &p : ring)
+            coordinates.append(m_map->coordinateForPixel(p));
+        collection.append(coordinates);
+    }
+    return QMapLibre::Feature(type, {collection}, properties);
+}
+
+void TestFeatureQuery::isExpression_data() {
+    addFilterColumns();
+    QTest::newRow("legacy ==") << R"(["==", "kind", "cafe"])" << false;
+    QTest::newRow("expression ==") << R"(["==", ["get", "kind"], "cafe"])" << true;
+    QTest::newRow("has property") << R"(["has", "rank"])" << true;
+    QTest::newRow("has $id") << R"(["has", "$id"])" << false;
+    QTest::newRow("in") << R"(["in", "kind", "cafe"])" << false;
+    QTest::newRow("all legacy") << R"(["all", ["==", "kind", "cafe"]])" << false;
+    QTest::newRow("all expression") << R"(["all", ["==", ["get", "kind"], "cafe"], true])" << true;
+    QTest::newRow("match") << R"(["match", ["get", "kind"], "cafe", true, false])" << true;
+}
+
+void TestFeatureQuery::isExpression() {
+    QFETCH(QString, filter);
+    QFETCH(bool, expected);
+    QCOMPARE(FeatureFilter::isExpression(json(filter)), expected);
+    QCOMPARE(FeatureFilter(json(filter)).isLegacy(), !expected);
+}
+
+void TestFeatureQuery::legacyFilter_data() {
+    addFilterColumns();
+    QTest::newRow("==") << R"(["==", "kind", "cafe"])" << true;
+    QTest::newRow("!=") << R"(["!=", "kind", "cafe"])" << false;
+    QTest::newRow(">") << R"([">", "rank", 2])" << true;
+    QTest::newRow("< with string") << R"(["<", "rank", "4"])" << false;
+    QTest::newRow("== with string") << R"(["==", "rank", "3"])" << false;
+    QTest::newRow("in") << R"(["in", "kind", "bar", "cafe"])" << true;
+    QTest::newRow("!in") << R"(["!in", "kind", "bar", "cafe"])" << false;
+    QTest::newRow("in is not substring") << R"(["in", "name", "street"])" << false;
+    QTest::newRow("!has") << R"(["!has", "rank"])" << false;
+    QTest::newRow("has $id") << R"(["has", "$id"])" << true;
+    QTest::newRow("$type") << R"(["==", "$type", "Point"])" << true;
+    QTest::newRow("$id") << R"(["==", "$id", "a"])" << true;
+    QTest::newRow("all") << R"(["all", ["==", "kind", "cafe"], ["in", "rank", 1, 2]])" << false;
+    QTest::newRow("any") << R"(["any", ["==", "kind", "bar"], ["in", "rank", 3]])" << true;
+    QTest::newRow("none") << R"(["none", ["==", "kind", "bar"]])" << true;
+}
+
+void TestFeatureQuery::legacyFilter() {
+    QFETCH(QString, filter);
+    QFETCH(bool, expected);
+    const FeatureFilter f(json(filter));
+    QVERIFY2(f.isValid(), qPrintable(f.error()));
+    QVERIFY(f.isLegacy());
+    QCOMPARE(f.matches(filtered(), zoom), expected);
+}
+
+void TestFeatureQuery::expressionFilter_data() {
+    addFilterColumns();
+    QTest::newRow("==") << R"(["==", ["get", "kind"], "cafe"])" << true;
+    QTest::newRow(">=") << R"([">=", ["get", "rank"], 3])" << true;
+    QTest::newRow("< with string") << R"(["<", ["get", "rank"], "4"])" << false;
+    QTest::newRow("== with string") << R"(["==", ["get", "rank"], "3"])" << false;
+    QTest::newRow("has") << R"(["has", "rank"])" << true;
+    QTest::newRow("! has") << R"(["!", ["has", "missing"]])" << true;
+    QTest::newRow("geometry-type") << R"(["==", ["geometry-type"], "Point"])" << true;
+    QTest::newRow("id") << R"(["==", ["id"], "a"])" << true;
+    QTest::newRow("in array") << R"(["!", ["in", ["get", "kind"], ["literal", ["bar"]]]])" << true;
+    QTest::newRow("in substring") << R"(["case", ["in", "street", ["get", "name"]], true, false])"
+                                  << true;
+    QTest::newRow("match") << R"(["match", ["get", "kind"], ["bar", "cafe"], true, false])"
+                           << true;
+    QTest::newRow("zoom") << R"(["all", ["==", ["get", "kind"], "cafe"], [">", ["zoom"], 10]])"
+                          << true;
+    QTest::newRow("to-number") << R"(["==", ["to-number", ["get", "rank"]], 3])" << true;
+    QTest::newRow("coalesce") << R"(["coalesce", ["get", "missing"], ["get", "open"]])" << true;
+    QTest::newRow("boolean property") << R"(["get", "open"])" << true;
+    QTest::newRow("string result") << R"(["get", "name"])" << false;
+    QTest::newRow("string in any") << R"(["any", ["get", "name"], true])" << false;
+}
+
+void TestFeatureQuery::expressionFilter() {
+    QFETCH(QString, filter);
+    QFETCH(bool, expected);
+    const FeatureFilter f(json(filter));
+    QVERIFY2(f.isValid(), qPrintable(f.error()));
+    QVERIFY(!f.isLegacy());
+    QCOMPARE(f.matches(filtered(), zoom), expected);
+}
+
+void TestFeatureQuery::invalidFilter_data() {
+    QTest::addColumn<QString>("filter");
+    QTest::newRow("unsupported expression") << R"(["within", 1])";
+    QTest::newRow("unsupported operator") << R"(["=~", "kind", "c"])";
+    QTest::newRow("get without key") << R"(["get"])";
+    QTest::newRow("== with one argument") << R"(["==", ["get", "kind"]])";
+    QTest::newRow("case without fallback") << R"(["case", true, false])";
+    QTest::newRow("expression in legacy")
+        << R"(["all", ["==", ["get", "kind"], "cafe"], ["in", "kind", "cafe"]])";
+    QTest::newRow("unsupported legacy") << R"(["none", ["~", "kind"]])";
+}
+
+/// Unsupported filters are reported and match no features
+void TestFeatureQuery::invalidFilter() {
+    QFETCH(QString, filter);
+    const FeatureFilter f(json(filter));
+    QVERIFY(!f.isValid());
+    QVERIFY(!f.error().isEmpty());
+    QVERIFY(!f.matches(filtered(), zoom));
+
+    // missing filter matches all
+    QVERIFY(FeatureFilter().isValid());
+    QVERIFY(FeatureFilter().matches(filtered(), zoom));
+}
+
+void TestFeatureQuery::tolerance_data() {
+    QTest::addColumn<QString>("type");
+    QTest::addColumn<QString>("paint");
+    QTest::addColumn<QString>("layout");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<qreal>("expected");
+
+    QTest::newRow("fill") << "fill" << "{}" << "{}" << true << 0.0;
+    QTest::newRow("circle default") << "circle" << "{}" << "{}" << true << 5.0;
+    QTest::newRow("circle") << "circle" << R"({"circle-radius": 8, "circle-stroke-width": 2})"
+                            << "{}" << true << 10.0;
+    QTest::newRow("circle expression") << "circle" << R"({"circle-radius": ["get", "size"]})"
+                                       << "{}" << false << 0.0;
+    QTest::newRow("line default") << "line" << "{}" << "{}" << true << 0.5;
+    QTest::newRow("line") << "line" << R"({"line-width": 4})" << "{}" << true << 2.0;
+    QTest::newRow("line gap")
+        << "line" << R"({"line-width": 4, "line-gap-width": 6, "line-offset": -1})" << "{}"
+        << true << 8.0;
+    QTest::newRow("icon") << "symbol" << "{}" << R"({"icon-image": "pin", "icon-size": 2})"
+                          << true << 30.0;
+    QTest::newRow("missing icon") << "symbol" << "{}" << R"({"icon-image": "missing"})" << false
+                                  << 0.0;
+    QTest::newRow("text") << "symbol" << "{}" << R"({"text-field": "name"})" << false << 0.0;
+    QTest::newRow("heatmap") << "heatmap" << "{}" << "{}" << false << 0.0;
+}
+
+void TestFeatureQuery::tolerance() {
+    QFETCH(QString, type);
+    QFETCH(QString, paint);
+    QFETCH(QString, layout);
+    QFETCH(bool, valid);
+    QFETCH(qreal, expected);
+
+    QHash<QString, QSize> icons;
+    icons.insert("pin", QSize(20, 30));
+    qreal tolerance = -1;
+    QString error;
+    QCOMPARE(FeatureQuery::tolerance(type, json(paint).toMap(), json(layout).toMap(), icons,
+                                     tolerance, error),
+             valid);
+    QCOMPARE(error.isEmpty(), valid);
+    if (valid)
+        QCOMPARE(tolerance, expected);
+}
+
+void TestFeatureQuery::hitTest_data() {
+    QTest::addColumn<int>("type");
+    QTest::addColumn<QVector<QPolygonF>>("rings");
+    QTest::addColumn<QString>("layerType");
+    QTest::addColumn<qreal>("tolerance");
+    QTest::addColumn<QRectF>("area");
+    QTest::addColumn<bool>("expected");
+
+    const int pt = QMapLibre::Feature::PointType;
+    const int ln = QMapLibre::Feature::LineStringType;
+    const int pg = QMapLibre::Feature::PolygonType;
+    const QVector<QPolygonF> off({QPolygonF({QPointF(210, 150)})});
+    const QVector<QPolygonF> line({QPolygonF({QPointF(100, 160), QPointF(300, 160)})});
+    const QPolygonF outer(QRectF(150, 100, 100, 100));
+    const QPolygonF hole(QRectF(180, 130, 40, 40));
+
+    QTest::newRow("circle miss") << pt << off << "circle" << 9.0 << point(center) << false;
+    QTest::newRow("circle hit") << pt << off << "circle" << 11.0 << point(center) << true;
+    QTest::newRow("icon hit") << pt << off << "symbol" << 11.0 << point(center) << true;
+    QTest::newRow("point as fill") << pt << off << "fill" << 11.0 << point(center) << false;
+    QTest::newRow("line miss") << ln << line << "line" << 9.0 << point(center) << false;
+    QTest::newRow("line hit") << ln << line << "line" << 11.0 << point(center) << true;
+    QTest::newRow("line as fill") << ln << line << "fill" << 11.0 << point(center) << false;
+    QTest::newRow("line as symbol") << ln << line << "symbol" << 11.0 << point(center) << false;
+    QTest::newRow("line vertex") << ln << line << "circle" << 11.0 << point(center) << false;
+    QTest::newRow("line crossing area")
+        << ln << QVector<QPolygonF>({QPolygonF({QPointF(50, -50), QPointF(50, 200)})}) << "line"
+        << 0.0 << QRectF(0, 0, 120, 120) << true;
+    QTest::newRow("fill inside") << pg << QVector<QPolygonF>({outer}) << "fill" << 0.0
+                                 << point(center) << true;
+    QTest::newRow("fill outside") << pg << QVector<QPolygonF>({outer}) << "fill" << 0.0
+                                  << point(QPointF(255, 150)) << false;
+    QTest::newRow("fill hole") << pg << QVector<QPolygonF>({outer, hole}) << "fill" << 0.0
+                               << point(center) << false;
+    QTest::newRow("fill overlapping area")
+        << pg << QVector<QPolygonF>({outer}) << "fill" << 0.0 << QRectF(240, 0, 100, 120) << true;
+    QTest::newRow("outline inside") << pg << QVector<QPolygonF>({outer}) << "line" << 5.0
+                                    << point(center) << false;
+    QTest::newRow("outline near") << pg << QVector<QPolygonF>({outer}) << "line" << 5.0
+                                  << point(QPointF(253, 150)) << true;
+}
+
+void TestFeatureQuery::hitTest() {
+    QFETCH(int, type);
+    QFETCH(QVector<QPolygonF>, rings);
+    QFETCH(QString, layerType);
+    QFETCH(qreal, tolerance);
+    QFETCH(QRectF, area);
+    QFETCH(bool, expected);
+
+    const FeatureQuery query(area, m_map.data(), 1);
+    QCOMPARE(query.intersects(feature(QMapLibre::Feature::Type(type), rings), layerType,
+                              tolerance),
+             expected);
+}
+
+/// Features are listed in the order of the layers and filtered by each of them
+void TestFeatureQuery::find() {
+    const QVector<QPolygonF> at({QPolygonF({center})});
+    QVariantMap cafe, shop;
+    cafe.insert("kind", "cafe");
+    shop.insert("kind", "shop");
+
+    FeatureQuery::Layer top;
+    top.id = "top";
+    top.source = "points";
+    top.type = "circle";
+    top.tolerance = 5;
+    top.filter = FeatureFilter(json(R"(["==", "kind", "cafe"])"));
+    top.features = {feature(QMapLibre::Feature::PointType, at, shop),
+                    feature(QMapLibre::Feature::PointType, at, cafe)};
+
+    FeatureQuery::Layer bottom;
+    bottom.id = "bottom";
+    bottom.source = "areas";
+    bottom.type = "fill";
+    bottom.features = {
+        feature(QMapLibre::Feature::PolygonType, {QPolygonF(QRectF(150, 100, 100, 100))})};
+
+    const FeatureQuery query(point(center), m_map.data(), 1);
+    const QVariantList found = query.find({top, bottom}, zoom);
+    QCOMPARE(found.size(), 2);
+    const QVariantMap first = found[0].toMap();
+    QCOMPARE(first.value("layer").toString(), QString("top"));
+    QCOMPARE(first.value("source").toString(), QString("points"));
+    QCOMPARE(first.value("properties").toMap().value("kind").toString(), QString("cafe"));
+    const QVariantMap second = found[1].toMap();
+    QCOMPARE(second.value("layer").toString(), QString("bottom"));
+    QCOMPARE(second.value("type").toString(), QString("Polygon"));
+}
+
+QTEST_GUILESS_MAIN(TestFeatureQuery)
+
+#include "tst_featurequery.moc"
@@ -0,0 +1,90 @@
+#include "headlessrenderer.h"
+
+#include <QColor>
+#include <QMapLibre/Settings>
+#include <QtTest/QtTest>
+
+//////////////////////////////////////////////////////////////////////////
+/// Tests of rendering the map into an image without a window. Styles are
+/// given inline with a background layer only, so no resources are loaded
+/// over network. Run with software OpenGL on machines without GPU.
+
+class TestHeadlessRenderer : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void background();
+    void styleChange();
+
+  private:
+    QScopedPointer<HeadlessRenderer> m_renderer;
+};
+
+namespace {
+const QSize imageSize(64, 48);
+
+QString backgroundStyle(const QColor &color) {
+    return QStringLiteral(R"({"version": 8, "sources": {}, "layers": [)"
+                          R"({"id": "background", "type": "background",)"
+                          R"( "paint": {"background-color": "%1"}}]})")
+        .arg(color.name());
+}
+
+/// Color of the pixel matches within the tolerance of the rasterizer
+bool hasColor(const QImage &image, const QPoint &p, const QColor &expected) {
+    const QColor c = image.pixelColor(p);
+    return qAbs(c.red() - expected.red()) <= 2 && qAbs(c.green() - expected.green()) <= 2 &&
+           qAbs(c.blue() - expected.blue()) <= 2 && c.alpha() == 255;
+}
+
+void verifyColor(const QImage &image, const QColor &expected) {
+    const QPoint points[] = {QPoint(0, 0), QPoint(image.width() - 1, 0),
+                             QPoint(image.width() / 2, image.height() / 2),
+                             QPoint(0, image.height() - 1),
+                             QPoint(image.width() - 1, image.height() - 1)};
+    for (const QPoint &p : points)
+        if (!hasColor(image, p, expected))
+            QFAIL(qPrintable(QString("Pixel (%1, %2) is %3 instead of %4")
+                                 .arg(p.x())
+                                 .arg(p.y())
+                                 .arg(image.pixelColor(p).name(QColor::HexArgb))
+                                 .arg(expected.name(QColor::HexArgb))));
+}
+} // namespace
+
+void TestHeadlessRenderer::initTestCase() {
+    QMapLibre::Settings settings;
+    settings.setCacheDatabasePath(":memory:");
+    m_renderer.reset(new HeadlessRenderer(settings, imageSize, 1));
+    if (!m_renderer->isValid())
+        QSKIP("OpenGL context is not available");
+    m_renderer->setCamera(QGeoCoordinate(59.437, 24.745), 12);
+}
+
+/// GL resources are released before the application
+void TestHeadlessRenderer::cleanupTestCase() { m_renderer.reset(); }
+
+void TestHeadlessRenderer::background() {
+    m_renderer->map()->setStyleJson(backgroundStyle(QColor(255, 0, 0)));
+    const QImage image = m_renderer->grab(10000);
+    QVERIFY(!image.isNull());
+    QCOMPARE(image.size(), imageSize);
+    verifyColor(image, QColor(255, 0, 0));
+}
+
+/// Map is kept between the grabs and follows changes of style and size
+void TestHeadlessRenderer::styleChange() {
+    m_renderer->map()->setStyleJson(backgroundStyle(QColor(0, 128, 255)));
+    m_renderer->resize(imageSize * 2, 1);
+    const QImage image = m_renderer->grab(10000);
+    QVERIFY(!image.isNull());
+    QCOMPARE(image.size(), imageSize * 2);
+    verifyColor(image, QColor(0, 128, 255));
+}
+
+QTEST_MAIN(TestHeadlessRenderer)
+
+#include "tst_headlessrenderer.moc"
@@ -0,0 +1,132 @@
+#include "linesimplifier.h"
+
+#include <QRandomGenerator>
+#include <QtTest/QtTest>
+
+#include <math.h>
+
+//////////////////////////////////////////////////////////////////////////
+/// Tests of the line simplification used for source lines together with
+/// a benchmark of building the hierarchy for long lines
+
+class TestLineSimplifier : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void empty();
+    void straightLine();
+    void zoomBuckets();
+    void nestedLevels();
+    void buildScaling_data();
+    void buildScaling();
+};
+
+namespace {
+/// Tolerance for the zoom bucket in Web Mercator units of the world
+double bucketTolerance(int zoom) {
+    return LineSimplifier::tolerance / (512.0 * pow(2.0, zoom + 1));
+}
+
+/// Random walk, reproducible between runs
+QMapLibre::Coordinates makeTrack(int count) {
+    QRandomGenerator random(count);
+    QMapLibre::Coordinates coordinates;
+    double lat = 59.4, lon = 24.7;
+    for (int i = 0; i < count; ++i) {
+        lat += 1e-4 * (random.generateDouble() - 0.5);
+        lon += 1e-4 * random.generateDouble();
+        coordinates.append(QMapLibre::Coordinate(lat, lon));
+    }
+    return coordinates;
+}
+
+/// All vertices of a are found in b in the same order
+bool isSubsequence(const QMapLibre::Coordinates &a, const QMapLibre::Coordinates &b) {
+    int j = 0;
+    for (const QMapLibre::Coordinate &c : a) {
+        while (j < b.size() && b[j] != c)
+            ++j;
+        if (j == b.size())
+            return false;
+        ++j;
+    }
+    return true;
+}
+} // namespace
+
+void TestLineSimplifier::empty() {
+    LineSimplifier simplifier((QMapLibre::Coordinates()));
+    QVERIFY(!simplifier.ready());
+    simplifier.build();
+    QVERIFY(simplifier.ready());
+    QVERIFY(simplifier.simplified(0).isEmpty());
+}
+
+/// Vertices on a straight line are dropped below the maximal zoom
+void TestLineSimplifier::straightLine() {
+    QMapLibre::Coordinates line;
+    for (int i = 0; i <= 10; ++i)
+        line.append(QMapLibre::Coordinate(0, i * 0.1));
+    LineSimplifier simplifier(line);
+    simplifier.build();
+
+    const QMapLibre::Coordinates ends{line.first(), line.last()};
+    for (int zoom = 0; zoom < LineSimplifier::maximalZoom; ++zoom)
+        QCOMPARE(simplifier.simplified(zoom), ends);
+    QCOMPARE(simplifier.simplified(LineSimplifier::maximalZoom), line);
+}
+
+/// Vertex is kept in the bucket where its deviation exceeds the tolerance
+/// at the largest zoom of the bucket. Near the equator, latitude in
+/// degrees divided by 360 gives the deviation in world units
+void TestLineSimplifier::zoomBuckets() {
+    const double deviation = 1.5 * bucketTolerance(10);
+    const QMapLibre::Coordinates line{{0, -0.01}, {deviation * 360, 0}, {0, 0.01}};
+    LineSimplifier simplifier(line);
+    simplifier.build();
+
+    QCOMPARE(simplifier.simplified(9).size(), 2);
+    QCOMPARE(simplifier.simplified(10), line);
+    QCOMPARE(simplifier.simplified(11), line);
+}
+
+/// Lines of higher zoom levels contain the lines of lower zoom levels
+void TestLineSimplifier::nestedLevels() {
+    const QMapLibre::Coordinates track = makeTrack(5000);
+    LineSimplifier simplifier(track);
+    simplifier.build();
+
+    QMapLibre::Coordinates previous = simplifier.simplified(0);
+    QCOMPARE(previous.first(), track.first());
+    QCOMPARE(previous.last(), track.last());
+    for (int zoom = 1; zoom <= LineSimplifier::maximalZoom; ++zoom) {
+        const QMapLibre::Coordinates current = simplifier.simplified(zoom);
+        QVERIFY(current.size() >= previous.size());
+        QVERIFY(isSubsequence(previous, current));
+        previous = current;
+    }
+    QCOMPARE(previous, track);
+    QVERIFY(simplifier.simplified(10).size() < track.size());
+}
+
+void TestLineSimplifier::buildScaling_data() {
+    QTest::addColumn<int>("count");
+    for (int count : {1000, 10000, 100000})
+        QTest::newRow(qPrintable(QString::number(count))) << count;
+}
+
+/// Build of the hierarchy for a GPS track
+void TestLineSimplifier::buildScaling() {
+    QFETCH(int, count);
+    const QMapLibre::Coordinates track = makeTrack(count);
+
+    QBENCHMARK {
+        LineSimplifier simplifier(track);
+        simplifier.build();
+        QVERIFY(simplifier.ready());
+    }
+}
+
+QTEST_GUILESS_MAIN(TestLineSimplifier)
+
+#include "tst_linesimplifier.moc"
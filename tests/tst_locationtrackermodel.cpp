@@ -0,0 +1,183 @@
+#include "locationtrackermodel.h"
+
+#include <QAbstractItemModelTester>
+#include <QThread>
+#include <QtTest/QtTest>
+
+//////////////////////////////////////////////////////////////////////////
+/// Tests of the list model of location trackers, with positions recorded
+/// from the render thread and applied in the GUI thread
+
+class TestLocationTrackerModel : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void init();
+    void cleanup();
+
+    void roles();
+    void addUpdateRemove();
+    void flushRange();
+    void postFlush();
+    void positionFromThread();
+    void clear();
+
+  private:
+    QScopedPointer<LocationTrackerModel> m_model;
+    QScopedPointer<QAbstractItemModelTester> m_tester;
+};
+
+namespace {
+QStringList ids(const LocationTrackerModel &model) {
+    QStringList result;
+    for (int r = 0; r < model.rowCount(); ++r)
+        result.append(model.index(r).data(LocationTrackerModel::TrackerIdRole).toString());
+    return result;
+}
+
+QVariant value(const LocationTrackerModel &model, int row, int role) {
+    return model.index(row).data(role);
+}
+} // namespace
+
+/// Each test gets a new model checked by QAbstractItemModelTester
+void TestLocationTrackerModel::init() {
+    qRegisterMetaType<QVector<int>>(); // roles of dataChanged recorded by QSignalSpy
+    m_model.reset(new LocationTrackerModel);
+    m_tester.reset(new QAbstractItemModelTester(m_model.get()));
+}
+
+void TestLocationTrackerModel::cleanup() {
+    m_tester.reset();
+    m_model.reset();
+}
+
+void TestLocationTrackerModel::roles() {
+    const QHash<int, QByteArray> names = m_model->roleNames();
+    QCOMPARE(names.value(LocationTrackerModel::TrackerIdRole), QByteArray("trackerId"));
+    QCOMPARE(names.value(LocationTrackerModel::CoordinateRole), QByteArray("coordinate"));
+    QCOMPARE(names.value(LocationTrackerModel::XRole), QByteArray("x"));
+    QCOMPARE(names.value(LocationTrackerModel::YRole), QByteArray("y"));
+    QCOMPARE(names.value(LocationTrackerModel::VisibleRole), QByteArray("visible"));
+
+    const QGeoCoordinate c(59.43, 24.74);
+    m_model->setTracker("a", c);
+    QCOMPARE(value(*m_model, 0, LocationTrackerModel::CoordinateRole).value<QGeoCoordinate>(), c);
+    QCOMPARE(value(*m_model, 0, LocationTrackerModel::VisibleRole).toBool(), false);
+    QVERIFY(!value(*m_model, 1, LocationTrackerModel::TrackerIdRole).isValid());
+}
+
+/// Rows are kept in the order of addition, with ids mapped to rows after removal
+void TestLocationTrackerModel::addUpdateRemove() {
+    QSignalSpy inserted(m_model.get(), &QAbstractItemModel::rowsInserted);
+    QSignalSpy changed(m_model.get(), &QAbstractItemModel::dataChanged);
+    for (const QString &id : {"a", "b", "c"})
+        m_model->setTracker(id, QGeoCoordinate(59, 24));
+    QCOMPARE(inserted.count(), 3);
+    QCOMPARE(ids(*m_model), QStringList({"a", "b", "c"}));
+
+    // existing tracker is updated in place
+    m_model->setTracker("b", QGeoCoordinate(60, 25));
+    QCOMPARE(m_model->rowCount(), 3);
+    QCOMPARE(changed.count(), 1);
+    QCOMPARE(changed.first().at(0).toModelIndex().row(), 1);
+    QCOMPARE(value(*m_model, 1, LocationTrackerModel::CoordinateRole).value<QGeoCoordinate>(),
+             QGeoCoordinate(60, 25));
+
+    m_model->removeTracker("a");
+    m_model->removeTracker("missing");
+    QCOMPARE(ids(*m_model), QStringList({"b", "c"}));
+
+    // rows of the remaining trackers follow the removal
+    m_model->setPosition("c", QPoint(10, 20), true);
+    m_model->flush();
+    QCOMPARE(value(*m_model, 1, LocationTrackerModel::XRole).toInt(), 10);
+    QCOMPARE(value(*m_model, 1, LocationTrackerModel::YRole).toInt(), 20);
+    QCOMPARE(value(*m_model, 1, LocationTrackerModel::VisibleRole).toBool(), true);
+}
+
+/// Positions recorded in a frame are announced by a single signal
+/// covering the changed rows. Positions of unknown trackers are ignored
+void TestLocationTrackerModel::flushRange() {
+    for (const QString &id : {"a", "b", "c", "d"})
+        m_model->setTracker(id, QGeoCoordinate(59, 24));
+
+    QSignalSpy changed(m_model.get(), &QAbstractItemModel::dataChanged);
+    m_model->setPosition("b", QPoint(1, 1), true);
+    m_model->setPosition("c", QPoint(2, 2), true);
+    m_model->setPosition("b", QPoint(3, 3), false);
+    m_model->setPosition("missing", QPoint(4, 4), true);
+    m_model->flush();
+
+    QCOMPARE(changed.count(), 1);
+    QCOMPARE(changed.first().at(0).toModelIndex().row(), 1);
+    QCOMPARE(changed.first().at(1).toModelIndex().row(), 2);
+    QCOMPARE(value(*m_model, 1, LocationTrackerModel::XRole).toInt(), 3);
+    QCOMPARE(value(*m_model, 1, LocationTrackerModel::VisibleRole).toBool(), false);
+    QCOMPARE(m_model->rowCount(), 4);
+
+    // nothing is announced without recorded positions
+    m_model->flush();
+    QCOMPARE(changed.count(), 1);
+}
+
+/// Flush is posted once for all positions recorded before it runs
+void TestLocationTrackerModel::postFlush() {
+    m_model->setTracker("a", QGeoCoordinate(59, 24));
+    QSignalSpy changed(m_model.get(), &QAbstractItemModel::dataChanged);
+
+    m_model->postFlush();
+    QCoreApplication::processEvents();
+    QCOMPARE(changed.count(), 0);
+
+    m_model->setPosition("a", QPoint(1, 1), true);
+    m_model->postFlush();
+    m_model->setPosition("a", QPoint(2, 2), true);
+    m_model->postFlush();
+    QCOMPARE(changed.count(), 0);
+    QTRY_COMPARE(changed.count(), 1);
+    QCOMPARE(value(*m_model, 0, LocationTrackerModel::XRole).toInt(), 2);
+
+    QCoreApplication::processEvents();
+    QCOMPARE(changed.count(), 1);
+}
+
+/// Positions are recorded in another thread and applied in the thread of the model
+void TestLocationTrackerModel::positionFromThread() {
+    for (int i = 0; i < 100; ++i)
+        m_model->setTracker(QString::number(i), QGeoCoordinate(59, 24));
+
+    QSignalSpy changed(m_model.get(), &QAbstractItemModel::dataChanged);
+    QScopedPointer<QThread> thread(QThread::create([this]() {
+        for (int i = 0; i < 100; ++i)
+            m_model->setPosition(QString::number(i), QPoint(i, -i), true);
+        m_model->postFlush();
+    }));
+    thread->start();
+    QVERIFY(thread->wait(5000));
+
+    QTRY_COMPARE(changed.count(), 1);
+    for (int i = 0; i < 100; ++i) {
+        QCOMPARE(value(*m_model, i, LocationTrackerModel::XRole).toInt(), i);
+        QCOMPARE(value(*m_model, i, LocationTrackerModel::YRole).toInt(), -i);
+    }
+}
+
+/// Positions recorded before clear are dropped
+void TestLocationTrackerModel::clear() {
+    m_model->setTracker("a", QGeoCoordinate(59, 24));
+    m_model->setPosition("a", QPoint(1, 1), true);
+
+    QSignalSpy reset(m_model.get(), &QAbstractItemModel::modelReset);
+    m_model->clear();
+    QCOMPARE(reset.count(), 1);
+    QCOMPARE(m_model->rowCount(), 0);
+
+    m_model->setTracker("a", QGeoCoordinate(59, 24));
+    m_model->flush();
+    QCOMPARE(value(*m_model, 0, LocationTrackerModel::VisibleRole).toBool(), false);
+}
+
+QTEST_GUILESS_MAIN(TestLocationTrackerModel)
+
+#include "tst_locationtrackermodel.moc"
@@ -0,0 +1,462 @@
+#include "locationtrackermodel.h"
+#include "macros.h"
+#include "qquickitemmapboxgl.h"
+
+#include <QColor>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QOpenGLContext>
+#include <QQuickWindow>
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+
+//////////////////////////////////////////////////////////////////////////
+/// Tests of the map item rendered in a window. Changes are made through
+/// the API used from QML and observed through the queries answered on
+/// sync with the map. Styles are given inline with a background layer
+/// only, so no resources are loaded over network. Run with software
+/// OpenGL on machines without GPU.
+
+class TestMapItem : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+    void appendSourceLine();
+    void lineToFeatures();
+    void featuresToLine();
+    void clustersToFeatures();
+    void trackerReprojection();
+    void renderSkipping();
+    void adaptiveScale();
+    void framePacing();
+    void imageReadback();
+    void threadedLifecycle();
+    void fboReuse();
+    void loadingRefreshBackoff();
+
+  private:
+    void createMap(bool threaded);
+
+  private:
+    QScopedPointer<QQuickWindow> m_window;
+    QQuickItemMapboxGL *m_map{nullptr};
+    QTemporaryDir m_cache;
+};
+
+namespace {
+const QSize windowSize(128, 96);
+
+QString backgroundStyle(const QColor &color = QColor(255, 0, 0)) {
+    return QStringLiteral(R"({"version": 8, "sources": {}, "layers": [)"
+                          R"({"id": "background", "type": "background",)"
+                          R"( "paint": {"background-color": "%1"}}]})")
+        .arg(color.name());
+}
+
+/// Coordinates given as longitude and latitude pairs
+QVariant lonLat(std::initializer_list<QPointF> points) {
+    return QVariant::fromValue(QVector<QPointF>(points));
+}
+
+/// Features of the source as applied to the map, answered on the next sync
+QVariantList sourceFeatures(QQuickItemMapboxGL *map, const QString &sourceID) {
+    QSignalSpy spy(map, &QQuickItemMapboxGL::replySourceFeatures);
+    emit map->querySourceFeatures(sourceID);
+    if (!spy.wait(1000))
+        return QVariantList();
+    return spy.takeFirst().at(1).toList();
+}
+
+/// Coordinate shown at the pixel as longitude and latitude, answered on the next sync
+QPointF lonLatAt(QQuickItemMapboxGL *map, const QPointF &pixel) {
+    QSignalSpy spy(map, &QQuickItemMapboxGL::replyCoordinateForPixel);
+    emit map->queryCoordinateForPixel(pixel);
+    if (!spy.wait(1000))
+        return QPointF();
+    const QGeoCoordinate c = spy.takeFirst().at(1).value<QGeoCoordinate>();
+    return QPointF(c.longitude(), c.latitude());
+}
+
+/// Features drawn at the pixel, answered on the next sync
+QVariantList featuresAt(QQuickItemMapboxGL *map, const QPointF &pixel) {
+    QSignalSpy spy(map, &QQuickItemMapboxGL::replyFeaturesAt);
+    emit map->queryFeaturesAt(pixel);
+    if (!spy.wait(1000))
+        return QVariantList();
+    const QList<QVariant> reply = spy.takeFirst();
+    if (!reply.at(2).toString().isEmpty())
+        qWarning() << reply.at(2).toString();
+    return reply.at(0).toList();
+}
+
+/// Geometry types and ids of the source features, sorted to be independent
+/// of the order of the features
+QStringList describe(QQuickItemMapboxGL *map, const QString &sourceID) {
+    QStringList result;
+    for (const QVariant &v : sourceFeatures(map, sourceID)) {
+        const QVariantMap f = v.toMap();
+        result.append(f.value("type").toString() + QLatin1Char(':') + f.value("id").toString());
+    }
+    result.sort();
+    return result;
+}
+
+/// Statistic of the map as a number
+qint64 stat(QQuickItemMapboxGL *map, const QString &name) {
+    return map->stats().value(name).toLongLong();
+}
+
+/// Wait until the loaded map stops requesting frames, syncing it with
+/// queries. Returns the number of rendered frames
+qint64 settle(QQuickItemMapboxGL *map) {
+    qint64 rendered = stat(map, "renderedFrames");
+    for (int i = 0; i < 50; ++i) {
+        sourceFeatures(map, QString());
+        const qint64 r = stat(map, "renderedFrames");
+        if (r == rendered)
+            break;
+        rendered = r;
+    }
+    return rendered;
+}
+
+/// Image of the shown map, read on the next sync
+QImage mapImage(QQuickItemMapboxGL *map) {
+    QSignalSpy spy(map, &QQuickItemMapboxGL::replyMapImage);
+    emit map->queryMapImage();
+    if (!spy.wait(1000))
+        return QImage();
+    return spy.takeFirst().at(0).value<QImage>();
+}
+
+/// Color of the pixel, given relative to the image size, within the
+/// tolerance of the rasterizer
+bool hasColor(const QImage &image, const QColor &expected, const QPointF &at = QPointF(0.5, 0.5)) {
+    if (image.isNull())
+        return false;
+    const QColor c = image.pixelColor(at.x() * image.width(), at.y() * image.height());
+    return qAbs(c.red() - expected.red()) <= 2 && qAbs(c.green() - expected.green()) <= 2 &&
+           qAbs(c.blue() - expected.blue()) <= 2;
+}
+} // namespace
+
+void TestMapItem::initTestCase() {
+    qRegisterMetaType<QGeoCoordinate>();
+#if IS_QT6
+    QQuickWindow::setGraphicsApi(QSGRendererInterface::OpenGL);
+#endif
+    QOpenGLContext context;
+    if (!context.create())
+        QSKIP("OpenGL context is not available");
+    QVERIFY(m_cache.isValid());
+
+    m_window.reset(new QQuickWindow);
+    m_window->resize(windowSize);
+    m_window->show();
+    QVERIFY(QTest::qWaitForWindowExposed(m_window.get()));
+}
+
+void TestMapItem::cleanupTestCase() { m_window.reset(); }
+
+/// Each test gets a new map with the style loaded
+void TestMapItem::init() { createMap(false); }
+
+void TestMapItem::createMap(bool threaded) {
+    m_map = new QQuickItemMapboxGL(m_window->contentItem());
+    m_map->setRenderThreaded(threaded);
+    m_map->setCacheDatabasePath(m_cache.filePath("cache.db"));
+    m_map->setSize(windowSize);
+    m_map->setSourceUpdateInterval(0);
+    m_map->setStyleJson(backgroundStyle());
+
+    QSignalSpy ready(m_map, &QQuickItemMapboxGL::overlaysReady);
+    m_map->update();
+    QVERIFY(ready.wait(10000));
+}
+
+void TestMapItem::cleanup() {
+    delete m_map;
+    m_map = nullptr;
+}
+
+/// Line is extended by the appended coordinates and is found where it is drawn
+void TestMapItem::appendSourceLine() {
+    const QPointF a = lonLatAt(m_map, QPointF(20, 48));
+    const QPointF b = lonLatAt(m_map, QPointF(64, 48));
+    const QPointF c = lonLatAt(m_map, QPointF(108, 48));
+
+    m_map->appendSourceLineArray("s", lonLat({a, b}));
+    QTRY_COMPARE(describe(m_map, "s"), QStringList({"LineString:"}));
+    m_map->addLayer("line", {{"type", "line"},
+                             {"source", "s"},
+                             {"paint", QVariantMap({{"line-width", 6}})}});
+    QTRY_COMPARE(featuresAt(m_map, QPointF(42, 48)).size(), 1);
+    QCOMPARE(featuresAt(m_map, QPointF(86, 48)).size(), 0);
+
+    m_map->appendSourceLine("s", {QVariant::fromValue(QGeoCoordinate(c.y(), c.x()))});
+    QTRY_COMPARE(featuresAt(m_map, QPointF(86, 48)).size(), 1);
+    QCOMPARE(describe(m_map, "s"), QStringList({"LineString:"}));
+
+    QSignalSpy error(m_map, &QQuickItemMapboxGL::errorChanged);
+    m_map->appendSourceLine("s", {QVariant::fromValue(QGeoCoordinate(100, 0))});
+    QCOMPARE(error.count(), 1);
+}
+
+/// Line is dropped when the source is turned into a feature table, and the
+/// table cannot be appended to as a line
+void TestMapItem::lineToFeatures() {
+    m_map->addSourceLine("s", {QVariant::fromValue(QGeoCoordinate(59.43, 24.74)),
+                               QVariant::fromValue(QGeoCoordinate(59.44, 24.75))});
+    QTRY_COMPARE(describe(m_map, "s"), QStringList({"LineString:"}));
+
+    m_map->upsertSourceFeatures("s", {"a", "b"}, lonLat({{24.74, 59.43}, {24.75, 59.44}}));
+    QTRY_COMPARE(describe(m_map, "s"), QStringList({"Point:a", "Point:b"}));
+
+    QSignalSpy error(m_map, &QQuickItemMapboxGL::errorChanged);
+    m_map->appendSourceLineArray("s", lonLat({{24.76, 59.45}}));
+    QCOMPARE(error.count(), 1);
+
+    m_map->upsertSourceFeatures("s", {"c"}, lonLat({{24.76, 59.45}}));
+    QTRY_COMPARE(describe(m_map, "s"), QStringList({"Point:a", "Point:b", "Point:c"}));
+}
+
+/// Feature table is dropped when the source is turned into a line
+void TestMapItem::featuresToLine() {
+    m_map->upsertSourceFeatures("s", {"a", "b"}, lonLat({{24.74, 59.43}, {24.75, 59.44}}));
+    QTRY_COMPARE(describe(m_map, "s"), QStringList({"Point:a", "Point:b"}));
+
+    m_map->updateSourceLineArray("s", lonLat({{24.74, 59.43}, {24.75, 59.44}}));
+    QTRY_COMPARE(describe(m_map, "s"), QStringList({"LineString:"}));
+
+    // removal from the dropped table leaves the line as it is
+    m_map->removeSourceFeatures("s", {"a"});
+    m_map->appendSourceLineArray("s", lonLat({{24.76, 59.45}}));
+    QTRY_COMPARE(describe(m_map, "s"), QStringList({"LineString:"}));
+}
+
+/// Clusters built after the source is turned into a feature table are
+/// not published
+void TestMapItem::clustersToFeatures() {
+    m_map->updateSourceClusteredPoints("s", lonLat({{24.74, 59.43}, {24.75, 59.44}}));
+    m_map->upsertSourceFeatures("s", {"a"}, lonLat({{24.74, 59.43}}));
+    QVERIFY(QThreadPool::globalInstance()->waitForDone(10000));
+    QTRY_COMPARE(describe(m_map, "s"), QStringList({"Point:a"}));
+
+    // map is synced with clusters again on camera change
+    m_map->setZoomLevel(m_map->zoomLevel() + 1);
+    QTest::qWait(100);
+    QCOMPARE(describe(m_map, "s"), QStringList({"Point:a"}));
+}
+
+/// Trackers are projected when added and when the camera changes, and
+/// their positions are given by the signal and the tracker model
+void TestMapItem::trackerReprojection() {
+    const QPointF ll = lonLatAt(m_map, QPointF(48, 36));
+    QSignalSpy changed(m_map, &QQuickItemMapboxGL::locationChanged);
+    m_map->trackLocation("t", QGeoCoordinate(ll.y(), ll.x()));
+    QTRY_COMPARE(changed.count(), 1);
+
+    auto near = [](const QPoint &p, const QPoint &expected) {
+        return (p - expected).manhattanLength() <= 2;
+    };
+    QList<QVariant> args = changed.takeFirst();
+    QCOMPARE(args.at(0).toString(), QString("t"));
+    QVERIFY(args.at(1).toBool());
+    QVERIFY(near(args.at(2).toPoint(), QPoint(48, 36)));
+
+    // trackers are not projected again without camera change
+    mapImage(m_map);
+    mapImage(m_map);
+    QCOMPARE(changed.count(), 0);
+
+    // zoom around the center moves the tracker away from it
+    m_map->setZoomLevel(m_map->zoomLevel() + 1);
+    QTRY_COMPARE(changed.count(), 1);
+    args = changed.takeFirst();
+    QVERIFY(near(args.at(2).toPoint(), QPoint(32, 24)));
+
+    QAbstractItemModel *model = m_map->trackerModel();
+    QTRY_COMPARE(model->rowCount(), 1);
+    const QModelIndex index = model->index(0, 0);
+    QTRY_VERIFY(near(QPoint(index.data(LocationTrackerModel::XRole).toInt(),
+                            index.data(LocationTrackerModel::YRole).toInt()),
+                     QPoint(32, 24)));
+    QVERIFY(index.data(LocationTrackerModel::VisibleRole).toBool());
+}
+
+/// Frames with queries only are not rendered, camera change is
+void TestMapItem::renderSkipping() {
+    const qint64 rendered = settle(m_map);
+    const qint64 skipped = stat(m_map, "skippedFrames");
+    const qint64 queryOnly = stat(m_map, "queryOnlyFrames");
+
+    for (int i = 0; i < 3; ++i)
+        sourceFeatures(m_map, QString());
+    QCOMPARE(stat(m_map, "renderedFrames"), rendered);
+    QVERIFY(stat(m_map, "skippedFrames") >= skipped + 3);
+    QVERIFY(stat(m_map, "queryOnlyFrames") >= queryOnly + 3);
+
+    m_map->setZoomLevel(m_map->zoomLevel() + 1);
+    QTRY_VERIFY(stat(m_map, "renderedFrames") > rendered);
+}
+
+/// Resolution is lowered during gestures and restored once the map is idle
+void TestMapItem::adaptiveScale() {
+    m_map->setMinimumResolutionScale(0.01);
+    QCOMPARE(m_map->minimumResolutionScale(), 0.1);
+    m_map->setMinimumResolutionScale(0.5);
+
+    // without adaptive resolution, gestures are rendered at full resolution
+    m_map->setGestureInProgress(true);
+    m_map->setZoomLevel(m_map->zoomLevel() + 0.5);
+    settle(m_map);
+    QCOMPARE(m_map->stats().value("renderScale").toReal(), 1.0);
+    QCOMPARE(stat(m_map, "reducedFrames"), 0);
+    m_map->setGestureInProgress(false);
+
+    m_map->setAdaptiveResolution(true);
+    m_map->setGestureInProgress(true);
+    m_map->setZoomLevel(m_map->zoomLevel() + 0.5);
+    QTRY_COMPARE(m_map->stats().value("renderScale").toReal(), 0.5);
+    QTRY_VERIFY(stat(m_map, "reducedFrames") > 0);
+
+    m_map->setGestureInProgress(false);
+    QTRY_COMPARE(m_map->stats().value("renderScale").toReal(), 1.0);
+    QTRY_VERIFY(hasColor(mapImage(m_map), QColor(255, 0, 0)));
+}
+
+/// Camera changes are coalesced into frames paced by the frame rate cap
+void TestMapItem::framePacing() {
+    const int interval = 200;
+    m_map->setMaximumFrameRate(1000 / interval);
+    const qint64 rendered = settle(m_map);
+    const qint64 coalesced = stat(m_map, "coalescedFrames");
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < 10; ++i) {
+        m_map->setZoomLevel(m_map->zoomLevel() + 0.1);
+        QTest::qWait(20);
+    }
+    const qint64 elapsed = timer.elapsed();
+    QVERIFY(stat(m_map, "coalescedFrames") > coalesced);
+    QVERIFY(stat(m_map, "renderedFrames") - rendered <= elapsed / interval + 1);
+
+    // coalesced changes are rendered on the paced frames
+    QTRY_VERIFY(stat(m_map, "renderedFrames") > rendered);
+
+    m_map->setMaximumFrameRate(-1);
+    QCOMPARE(m_map->maximumFrameRate(), 0);
+}
+
+/// Image is read in the orientation of the window, scaled, and saved,
+/// with every request answered
+void TestMapItem::imageReadback() {
+    // blue polygon covers the upper half of the map
+    QVariantList ring;
+    for (const QPointF &p : {QPointF(-10, -10), QPointF(138, -10), QPointF(138, 48),
+                             QPointF(-10, 48), QPointF(-10, -10)}) {
+        const QPointF ll = lonLatAt(m_map, p);
+        ring.append(QVariant(QVariantList({ll.x(), ll.y()})));
+    }
+    const QVariantList coordinates{QVariant(ring)};
+    const QVariantMap polygon({{"type", "Polygon"}, {"coordinates", coordinates}});
+    m_map->addSource("top", {{"type", "geojson"}, {"data", polygon}});
+    m_map->addLayer("top", {{"type", "fill"},
+                            {"source", "top"},
+                            {"paint", QVariantMap({{"fill-color", "#0000ff"}})}});
+
+    const qreal dpr = m_window->devicePixelRatio();
+    auto split = [](const QImage &image) {
+        return hasColor(image, QColor(0, 0, 255), QPointF(0.5, 0.25)) &&
+               hasColor(image, QColor(255, 0, 0), QPointF(0.5, 0.75));
+    };
+    QTRY_VERIFY(split(mapImage(m_map)));
+    QCOMPARE(mapImage(m_map).size(), windowSize * dpr);
+
+    QSignalSpy spy(m_map, &QQuickItemMapboxGL::replyMapImage);
+    const QString fileName = m_cache.filePath("map.png");
+    emit m_map->queryMapImage(1, 0.25);
+    emit m_map->queryMapImage(2, 1, fileName);
+    emit m_map->queryMapImage(3, 0.001);
+    QTRY_COMPARE(spy.count(), 3);
+
+    QHash<int, QList<QVariant>> replies;
+    for (const QList<QVariant> &reply : spy)
+        replies.insert(reply.at(2).toInt(), reply);
+    QCOMPARE(replies.size(), 3);
+
+    const QImage thumbnail = replies[1].at(0).value<QImage>();
+    QCOMPARE(thumbnail.size(), windowSize * dpr * 0.25);
+    QVERIFY(split(thumbnail));
+
+    QCOMPARE(replies[2].at(1).toString(), fileName);
+    const QImage saved(fileName);
+    QCOMPARE(saved.size(), windowSize * dpr);
+    QVERIFY(split(saved));
+
+    // scale is limited to 0.01
+    QCOMPARE(replies[3].at(0).value<QImage>().size(),
+             (windowSize * dpr * 0.01).expandedTo(QSize(1, 1)));
+}
+
+/// Map rendered in its own thread follows changes of style and size, and
+/// its render thread is stopped with the node
+void TestMapItem::threadedLifecycle() {
+    for (int i = 0; i < 3; ++i) {
+        cleanup();
+        createMap(true);
+        QVERIFY(m_map->renderThreaded());
+        QTRY_VERIFY(hasColor(mapImage(m_map), QColor(255, 0, 0)));
+    }
+
+    m_map->setStyleJson(backgroundStyle(QColor(0, 128, 255)));
+    QTRY_VERIFY(hasColor(mapImage(m_map), QColor(0, 128, 255)));
+
+    const qreal dpr = m_window->devicePixelRatio();
+    for (const QSize &size : {windowSize / 2, windowSize, windowSize * 2}) {
+        m_map->setSize(size);
+        QTRY_COMPARE(mapImage(m_map).size(), size * dpr);
+        QTRY_VERIFY(hasColor(mapImage(m_map), QColor(0, 128, 255)));
+    }
+    QVERIFY(m_map->stats().value("renderedFrames").toInt() > 0);
+}
+
+/// Framebuffer is allocated again only when the map leaves its size bucket
+void TestMapItem::fboReuse() {
+    const qreal dpr = m_window->devicePixelRatio();
+    QTRY_VERIFY(hasColor(mapImage(m_map), QColor(255, 0, 0)));
+    const qint64 allocations = m_map->stats().value("fboAllocations").toLongLong();
+    QVERIFY(allocations > 0);
+
+    const QSize smaller = windowSize - QSize(8, 8);
+    m_map->setSize(smaller);
+    QTRY_COMPARE(mapImage(m_map).size(), smaller * dpr);
+    QCOMPARE(m_map->stats().value("fboAllocations").toLongLong(), allocations);
+
+    m_map->setSize(windowSize * 3);
+    QTRY_COMPARE(mapImage(m_map).size(), windowSize * 3 * dpr);
+    QVERIFY(m_map->stats().value("fboAllocations").toLongLong() > allocations);
+}
+
+/// Refresh interval is doubled while nothing progresses, up to its limit
+void TestMapItem::loadingRefreshBackoff() {
+    QList<int> intervals{250};
+    while (intervals.size() < 7)
+        intervals.append(QQuickItemMapboxGL::loadingRefreshBackoff(intervals.last(), 250));
+    QCOMPARE(intervals, QList<int>({250, 500, 1000, 2000, 4000, 4000, 4000}));
+
+    QCOMPARE(QQuickItemMapboxGL::loadingRefreshBackoff(3000, 250), 4000);
+
+    m_map->setLoadingRefreshInterval(-5);
+    QCOMPARE(m_map->loadingRefreshInterval(), 0);
+}
+
+QTEST_MAIN(TestMapItem)
+
+#include "tst_mapitem.moc"
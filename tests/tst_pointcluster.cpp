@@ -0,0 +1,175 @@
+#include "pointcluster.h"
+
+#include <QRandomGenerator>
+#include <QtTest/QtTest>
+
+//////////////////////////////////////////////////////////////////////////
+/// Tests of the clustering index used by clustered point sources together
+/// with a benchmark showing the scaling of its build with the number of
+/// points
+
+class TestPointCluster : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void notReady();
+    void clusterFeatures();
+    void separatePoints();
+    void antimeridian();
+    void leaves();
+    void expansionZoom();
+    void buildScaling_data();
+    void buildScaling();
+};
+
+namespace {
+/// Index built in the calling thread
+QSharedPointer<PointCluster> makeCluster(const QMapLibre::Coordinates &coordinates,
+                                         const QStringList &names = QStringList()) {
+    QSharedPointer<PointCluster> cluster(new PointCluster(coordinates, names));
+    cluster->build();
+    return cluster;
+}
+
+/// Points spread uniformly around the given center, reproducible between runs
+QMapLibre::Coordinates makePoints(int count, double lat, double lon, double spread) {
+    QRandomGenerator random(count);
+    QMapLibre::Coordinates coordinates;
+    for (int i = 0; i < count; ++i)
+        coordinates.append(QMapLibre::Coordinate(lat + spread * (random.generateDouble() - 0.5),
+                                                 lon + spread * (random.generateDouble() - 0.5)));
+    return coordinates;
+}
+
+QVector<QMapLibre::Feature> worldFeatures(const PointCluster &cluster, int zoom) {
+    return cluster.features(-180, -90, 180, 90, zoom);
+}
+
+int pointCount(const QMapLibre::Feature &feature) {
+    return feature.properties.value("cluster").toBool()
+               ? feature.properties.value("point_count").toInt()
+               : 1;
+}
+} // namespace
+
+void TestPointCluster::notReady() {
+    PointCluster cluster(makePoints(10, 59.4, 24.7, 0.1), QStringList());
+    QVERIFY(!cluster.ready());
+    QVERIFY(worldFeatures(cluster, 0).isEmpty());
+    QCOMPARE(cluster.expansionZoom(10), -1);
+}
+
+/// Close points are merged into a single cluster with all points counted
+void TestPointCluster::clusterFeatures() {
+    const QMapLibre::Coordinates points = makePoints(100, 59.4, 24.7, 0.1);
+    QSharedPointer<PointCluster> cluster = makeCluster(points);
+
+    const QVector<QMapLibre::Feature> features = worldFeatures(*cluster, 0);
+    QCOMPARE(features.size(), 1);
+    const QMapLibre::Feature &f = features.first();
+    QCOMPARE(f.type, QMapLibre::Feature::PointType);
+    QVERIFY(f.properties.value("cluster").toBool());
+    QCOMPARE(f.properties.value("point_count").toInt(), 100);
+    QCOMPARE(f.properties.value("point_count_abbreviated").toString(), QString("100"));
+    QCOMPARE(f.id, f.properties.value("cluster_id"));
+
+    // cluster is placed at the center of its points
+    const QMapLibre::Coordinate &c = f.geometry.first().first().first();
+    QVERIFY(qAbs(c.first - 59.4) < 0.05);
+    QVERIFY(qAbs(c.second - 24.7) < 0.05);
+
+    // points are kept on every zoom level, as points or in clusters
+    for (int zoom = PointCluster::minZoom; zoom <= PointCluster::maxZoom + 1; ++zoom) {
+        int count = 0;
+        for (const QMapLibre::Feature &feature : worldFeatures(*cluster, zoom))
+            count += pointCount(feature);
+        QCOMPARE(count, points.size());
+    }
+}
+
+/// Points further away than the cluster radius are returned as they are
+void TestPointCluster::separatePoints() {
+    const QMapLibre::Coordinates points{{0, 0}, {0, 100}};
+    QSharedPointer<PointCluster> cluster = makeCluster(points, {"a", "b"});
+
+    const QVector<QMapLibre::Feature> features = worldFeatures(*cluster, 0);
+    QCOMPARE(features.size(), 2);
+    QStringList names;
+    for (const QMapLibre::Feature &f : features) {
+        QVERIFY(!f.properties.contains("cluster"));
+        QVERIFY(!f.id.isValid());
+        names.append(f.properties.value("name").toString());
+    }
+    names.sort();
+    QCOMPARE(names, QStringList({"a", "b"}));
+
+    // only the points within bounds are returned
+    QCOMPARE(cluster->features(-10, -10, 10, 10, 0).size(), 1);
+}
+
+/// Bounds crossing the antimeridian are given with longitudes beyond 180
+void TestPointCluster::antimeridian() {
+    const QMapLibre::Coordinates points{{0, 179.5}, {0, -179.5}, {0, 0}};
+    QSharedPointer<PointCluster> cluster = makeCluster(points);
+
+    QCOMPARE(cluster->features(179, -1, 181, 1, PointCluster::maxZoom).size(), 2);
+    QCOMPARE(cluster->features(-181, -1, -179, 1, PointCluster::maxZoom).size(), 2);
+    QCOMPARE(cluster->features(-200, -1, 200, 1, PointCluster::maxZoom).size(), 3);
+}
+
+/// Leaves are returned once, in pages given by limit and offset
+void TestPointCluster::leaves() {
+    QSharedPointer<PointCluster> cluster = makeCluster(makePoints(25, 59.4, 24.7, 0.1));
+    const int id = worldFeatures(*cluster, 0).first().id.toInt();
+
+    QVector<int> all = cluster->leaves(id, 100, 0);
+    QCOMPARE(all.size(), 25);
+    std::sort(all.begin(), all.end());
+    for (int i = 0; i < all.size(); ++i)
+        QCOMPARE(all[i], i);
+
+    QVector<int> paged;
+    for (int offset = 0; offset < 25; offset += 10) {
+        const QVector<int> page = cluster->leaves(id, 10, offset);
+        QCOMPARE(page.size(), qMin(10, 25 - offset));
+        paged += page;
+    }
+    std::sort(paged.begin(), paged.end());
+    QCOMPARE(paged, all);
+}
+
+/// Two points 0.01 degrees apart on the equator are clustered up to zoom
+/// level 11 as the cluster radius at zoom z is 40 / (512 * 2^z) of the world
+void TestPointCluster::expansionZoom() {
+    QSharedPointer<PointCluster> cluster = makeCluster({{0, 0}, {0, 0.01}});
+
+    const QVector<QMapLibre::Feature> clustered = worldFeatures(*cluster, 11);
+    QCOMPARE(clustered.size(), 1);
+    QCOMPARE(worldFeatures(*cluster, 12).size(), 2);
+
+    const int id = worldFeatures(*cluster, 0).first().id.toInt();
+    QCOMPARE(cluster->expansionZoom(id), 12);
+    QCOMPARE(cluster->expansionZoom(clustered.first().id.toInt()), 12);
+}
+
+void TestPointCluster::buildScaling_data() {
+    QTest::addColumn<int>("count");
+    for (int count : {1000, 10000, 100000})
+        QTest::newRow(qPrintable(QString::number(count))) << count;
+}
+
+/// Build of the index for points spread over a country sized area
+void TestPointCluster::buildScaling() {
+    QFETCH(int, count);
+    const QMapLibre::Coordinates points = makePoints(count, 59.0, 25.0, 4.0);
+
+    QBENCHMARK {
+        PointCluster cluster(points, QStringList());
+        cluster.build();
+        QVERIFY(cluster.ready());
+    }
+}
+
+QTEST_GUILESS_MAIN(TestPointCluster)
+
+#include "tst_pointcluster.moc"
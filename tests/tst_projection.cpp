@@ -0,0 +1,198 @@
+#include "projection.h"
+
+#include <QMapLibre/Map>
+#include <QMapLibre/Settings>
+#include <QThread>
+#include <QtTest/QtTest>
+
+#include <math.h>
+
+Q_DECLARE_METATYPE(Projection::Kernel)
+
+//////////////////////////////////////////////////////////////////////////
+/// Tests of the batch projection against the map and benchmarks of its
+/// kernels compared to projection of each point by the map
+
+class TestProjection : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();
+
+    void accuracy_data();
+    void accuracy();
+    void throughput_data();
+    void throughput();
+    void snapshot();
+
+  private:
+    void setCamera(double zoom, double bearing, double pitch);
+    QMapLibre::Coordinates visibleCoordinates(int count, double pitch) const;
+
+  private:
+    QScopedPointer<QMapLibre::Map> m_map;
+};
+
+namespace {
+const QSize mapSize(800, 600);
+const QMapLibre::Coordinate center(60.170448, 24.942046);
+
+QString kernelName(Projection::Kernel kernel) {
+    switch (kernel) {
+    case Projection::Kernel::Sse2:
+        return "sse2";
+    case Projection::Kernel::Avx2:
+        return "avx2";
+    case Projection::Kernel::Neon:
+        return "neon";
+    default:
+        return "scalar";
+    }
+}
+} // namespace
+
+void TestProjection::initTestCase() {
+    QMapLibre::Settings settings;
+    settings.setCacheDatabasePath(":memory:");
+    m_map.reset(new QMapLibre::Map(nullptr, settings, mapSize, 1));
+}
+
+void TestProjection::setCamera(double zoom, double bearing, double pitch) {
+    m_map->setCoordinateZoom(center, zoom);
+    m_map->setBearing(bearing);
+    m_map->setPitch(pitch);
+}
+
+/// Coordinates of pixels spread over the viewport. For pitched map, the
+/// pixels are taken from the lower half of the viewport to stay below horizon
+QMapLibre::Coordinates TestProjection::visibleCoordinates(int count, double pitch) const {
+    const double top = pitch > 0 ? mapSize.height() / 2.0 : 0;
+    const int side = qMax(2, int(ceil(sqrt(double(count)))));
+    QMapLibre::Coordinates coordinates;
+    for (int i = 0; coordinates.size() < count; ++i) {
+        const double x = (i % side + 0.5) * mapSize.width() / side;
+        const double y = top + ((i / side) % side + 0.5) * (mapSize.height() - top) / side;
+        coordinates.append(m_map->coordinateForPixel(QPointF(x, y)));
+    }
+    return coordinates;
+}
+
+void TestProjection::accuracy_data() {
+    QTest::addColumn<double>("zoom");
+    QTest::addColumn<double>("bearing");
+    QTest::addColumn<double>("pitch");
+
+    QTest::newRow("world") << 2.0 << 0.0 << 0.0;
+    QTest::newRow("city") << 12.0 << 0.0 << 0.0;
+    QTest::newRow("rotated") << 14.0 << 45.0 << 0.0;
+    QTest::newRow("pitched") << 15.0 << 30.0 << 45.0;
+    QTest::newRow("navigation") << 17.0 << -120.0 << 60.0;
+}
+
+/// All kernels agree with the map within the tolerance of the projection
+void TestProjection::accuracy() {
+    QFETCH(double, zoom);
+    QFETCH(double, bearing);
+    QFETCH(double, pitch);
+
+    setCamera(zoom, bearing, pitch);
+    const Projection projection = Projection::fromMap(m_map.data(), 1);
+    QVERIFY(projection.isValid());
+
+    const QMapLibre::Coordinates coordinates = visibleCoordinates(1001, pitch);
+    QVector<QPointF> expected(coordinates.size());
+    for (int i = 0; i < coordinates.size(); ++i)
+        expected[i] = m_map->pixelForCoordinate(coordinates[i]);
+
+    for (Projection::Kernel kernel : Projection::kernels()) {
+        QVector<QPointF> pixels(coordinates.size());
+        projection.project(coordinates.constData(), pixels.data(), coordinates.size(), kernel);
+
+        double error = 0;
+        for (int i = 0; i < coordinates.size(); ++i)
+            error = qMax(error, qMax(fabs(pixels[i].x() - expected[i].x()),
+                                     fabs(pixels[i].y() - expected[i].y())));
+        if (error >= 0.5)
+            QFAIL(qPrintable(QString("Kernel %1 error %2 px").arg(kernelName(kernel)).arg(error)));
+    }
+}
+
+void TestProjection::throughput_data() {
+    QTest::addColumn<int>("count");
+    QTest::addColumn<bool>("useMap");
+    QTest::addColumn<Projection::Kernel>("kernel");
+
+    for (int count : {1000, 10000, 100000}) {
+        QTest::newRow(qPrintable(QString("map-%1").arg(count)))
+            << count << true << Projection::Kernel::Scalar;
+        for (Projection::Kernel kernel : Projection::kernels())
+            QTest::newRow(qPrintable(QString("%1-%2").arg(kernelName(kernel)).arg(count)))
+                << count << false << kernel;
+    }
+}
+
+/// Projection of coordinates for a pitched and rotated camera, either by the
+/// map one at a time or by the batch projection with the given kernel
+void TestProjection::throughput() {
+    QFETCH(int, count);
+    QFETCH(bool, useMap);
+    QFETCH(Projection::Kernel, kernel);
+
+    setCamera(15, 30, 45);
+    const Projection projection = Projection::fromMap(m_map.data(), 1);
+    QVERIFY(projection.isValid());
+    const QMapLibre::Coordinates coordinates = visibleCoordinates(count, 45);
+    QVector<QPointF> pixels(count);
+
+    if (useMap) {
+        QBENCHMARK {
+            for (int i = 0; i < count; ++i)
+                pixels[i] = m_map->pixelForCoordinate(coordinates[i]);
+        }
+    } else {
+        QBENCHMARK {
+            projection.project(coordinates.constData(), pixels.data(), count, kernel);
+        }
+    }
+}
+
+/// Projections published by one thread are read whole by another one
+void TestProjection::snapshot() {
+    ProjectionSnapshot snapshot;
+    QVERIFY(!snapshot.current().isValid());
+
+    QVector<Projection> projections;
+    for (double zoom : {10.0, 14.0}) {
+        setCamera(zoom, 0, 0);
+        projections.append(Projection::fromMap(m_map.data(), 1));
+        QVERIFY(projections.last().isValid());
+    }
+    // pixels of two coordinates differ between the projections
+    const QMapLibre::Coordinate a = m_map->coordinateForPixel(QPointF(0, 0));
+    const QMapLibre::Coordinate b =
+        m_map->coordinateForPixel(QPointF(mapSize.width(), mapSize.height()));
+    const QPointF pixelsA[] = {projections[0].project(a), projections[1].project(a)};
+    const QPointF pixelsB[] = {projections[0].project(b), projections[1].project(b)};
+
+    QScopedPointer<QThread> writer(QThread::create([&snapshot, &projections]() {
+        for (int i = 0; i < 20000; ++i)
+            snapshot.publish(projections[i % 2]);
+    }));
+    writer->start();
+    int mismatches = 0;
+    while (!writer->isFinished()) {
+        const Projection p = snapshot.current();
+        if (!p.isValid())
+            continue;
+        const int i = p.project(a) == pixelsA[0] ? 0 : 1;
+        if (p.project(a) != pixelsA[i] || p.project(b) != pixelsB[i])
+            mismatches++;
+    }
+    writer->wait();
+    QCOMPARE(mismatches, 0);
+    QVERIFY(snapshot.current().isValid());
+}
+
+QTEST_MAIN(TestProjection)
+
+#include "tst_projection.moc"
@@ -0,0 +1,218 @@
+#include "sync.h"
+
+#include <QStringList>
+#include <QtTest/QtTest>
+
+using namespace QMapLibreSync;
+
+//////////////////////////////////////////////////////////////////////////
+/// Tests of the asset containers used by QMapLibreSync together with
+/// benchmarks showing their scaling with the number of assets
+
+class TestSync : public QObject {
+    Q_OBJECT
+
+  private slots:
+    void indexedListOrder();
+    void indexedListCopy();
+    void layerCompact();
+    void sourceContains();
+    void conversionReceiver();
+    void conversionReceiverDeleted();
+    void indexedListScaling_data();
+    void indexedListScaling();
+    void sourceStackScaling_data();
+    void sourceStackScaling();
+    void layerStackScaling_data();
+    void layerStackScaling();
+};
+
+namespace {
+void addCounts() {
+    QTest::addColumn<int>("count");
+    for (int count : {10, 100, 1000, 10000})
+        QTest::newRow(qPrintable(QString::number(count))) << count;
+}
+
+/// Receiver of the finished data conversion
+class ConversionReceiver : public QObject {
+    Q_OBJECT
+
+  public:
+    int calls{0};
+    QThread *thread{nullptr};
+
+  public slots:
+    void onConverted() {
+        calls++;
+        thread = QThread::currentThread();
+    }
+};
+
+QStringList makeIds(int count) {
+    QStringList ids;
+    for (int i = 0; i < count; ++i)
+        ids.append(QStringLiteral("asset-%1").arg(i));
+    return ids;
+}
+} // namespace
+
+void TestSync::indexedListOrder() {
+    IndexedList<Asset> list;
+    list.append("a", Asset("a", QVariantMap()));
+    list.append("b", Asset("b", QVariantMap()));
+    list.append("c", Asset("c", QVariantMap()));
+
+    // replaced element is moved to the end
+    list.append("a", Asset("a", QVariantMap{{"x", 1}}));
+    QStringList order;
+    for (const Asset &asset : list)
+        order.append(asset.id);
+    QCOMPARE(order, QStringList({"b", "c", "a"}));
+    QCOMPARE(list.find("a")->params.value("x").toInt(), 1);
+
+    QVERIFY(list.remove("c"));
+    QVERIFY(!list.remove("c"));
+    QVERIFY(!list.contains("c"));
+    QCOMPARE(list.size(), 2);
+    QCOMPARE(list.first().id, QString("b"));
+}
+
+/// Copy has its own index that refers to the copied elements
+void TestSync::indexedListCopy() {
+    IndexedList<Asset> list;
+    list.append("a", Asset("a", QVariantMap()));
+    list.append("b", Asset("b", QVariantMap()));
+
+    IndexedList<Asset> copy(list);
+    copy.find("a")->params.insert("x", 1);
+    QVERIFY(copy.remove("b"));
+    QVERIFY(list.find("a")->params.isEmpty());
+    QVERIFY(list.contains("b"));
+    QCOMPARE(copy.size(), 1);
+
+    list = copy;
+    QCOMPARE(list.find("a")->params.value("x").toInt(), 1);
+    QVERIFY(list.find("a") != copy.find("a"));
+    list.append("c", Asset("c", QVariantMap()));
+    QVERIFY(!copy.contains("c"));
+
+    QStringList order;
+    for (const Asset &asset : list)
+        order.append(asset.id);
+    QCOMPARE(order, QStringList({"a", "c"}));
+}
+
+/// Layers added and removed within a batch are compacted into removal,
+/// unless other layers are placed relative to them
+void TestSync::layerCompact() {
+    LayerList layers;
+    layers.add("a", QVariantMap(), QString());
+    layers.remove("a");
+    layers.add("b", QVariantMap(), QString());
+    layers.add("c", QVariantMap(), "b");
+    layers.remove("b");
+    layers.remove("d");
+    QCOMPARE(layers.compact(), QSet<QString>({"a"}));
+
+    // nothing is left to compact
+    QVERIFY(layers.compact().isEmpty());
+}
+
+/// Pending actions are taken into account before their application
+void TestSync::sourceContains() {
+    SourceList sources;
+    QVERIFY(!sources.contains("a"));
+    sources.add("a", QVariantMap{{"type", "geojson"}});
+    QVERIFY(sources.contains("a"));
+    sources.remove("a");
+    QVERIFY(!sources.contains("a"));
+}
+
+/// Finished conversion is delivered in the thread of the receiver
+void TestSync::conversionReceiver() {
+    ConversionReceiver receiver;
+    QSharedPointer<DataConversion> conversion(
+        new DataConversion(QVariantMap{{"type", "FeatureCollection"}}));
+    DataConversion::start(conversion, &receiver, "onConverted");
+    QTRY_COMPARE(receiver.calls, 1);
+    QCOMPARE(receiver.thread, QThread::currentThread());
+    QVERIFY(conversion->done());
+    QVERIFY(!conversion->result().isEmpty());
+}
+
+/// Receiver can be destroyed while the conversion is running
+void TestSync::conversionReceiverDeleted() {
+    QSharedPointer<DataConversion> conversion(
+        new DataConversion(QVariantMap{{"type", "FeatureCollection"}}));
+    {
+        ConversionReceiver receiver;
+        DataConversion::start(conversion, &receiver, "onConverted");
+    }
+    QVERIFY(QThreadPool::globalInstance()->waitForDone(10000));
+    QCoreApplication::processEvents();
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    QVERIFY(conversion->done());
+}
+
+void TestSync::indexedListScaling_data() { addCounts(); }
+
+/// Append, lookup, and removal of all assets, linear in their number
+void TestSync::indexedListScaling() {
+    QFETCH(int, count);
+    const QStringList ids = makeIds(count);
+
+    QBENCHMARK {
+        IndexedList<Asset> list;
+        for (const QString &id : ids)
+            list.append(id, Asset(id, QVariantMap()));
+        for (const QString &id : ids)
+            QVERIFY(list.find(id) != nullptr);
+        for (int i = 0; i < count; i += 2)
+            list.remove(ids[i]);
+        QCOMPARE(list.size(), count / 2);
+    }
+}
+
+void TestSync::sourceStackScaling_data() { addCounts(); }
+
+/// Sources are added, updated, and removed before application, replacing
+/// earlier actions with the same id in the pending stack
+void TestSync::sourceStackScaling() {
+    QFETCH(int, count);
+    const QStringList ids = makeIds(count);
+    const QVariantMap params{{"type", "geojson"}};
+
+    QBENCHMARK {
+        SourceList sources;
+        for (const QString &id : ids)
+            sources.add(id, params);
+        for (const QString &id : ids)
+            sources.update(id, params);
+        for (int i = 0; i < count; i += 2)
+            sources.remove(ids[i]);
+    }
+}
+
+void TestSync::layerStackScaling_data() { addCounts(); }
+
+/// Layers are added with placement before the previous layer and half of
+/// them are removed in the same batch
+void TestSync::layerStackScaling() {
+    QFETCH(int, count);
+    const QStringList ids = makeIds(count);
+    const QVariantMap params{{"type", "line"}, {"source", "source"}};
+
+    QBENCHMARK {
+        LayerList layers;
+        for (int i = 0; i < count; ++i)
+            layers.add(ids[i], params, i > 0 ? ids[i - 1] : QString());
+        for (int i = 1; i < count; i += 2)
+            layers.remove(ids[i]);
+        layers.compact();
+    }
+}
+
+QTEST_GUILESS_MAIN(TestSync)
+
+#include "tst_sync.moc"